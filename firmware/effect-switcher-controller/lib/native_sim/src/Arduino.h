@@ -0,0 +1,116 @@
+#pragma once
+
+// Subset of the Arduino core used by the sources built for the native environment
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+
+#include "sim_clock.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define MSBFIRST 1
+
+// Binary constants of the sources built for the native environment
+#define B00000001 1
+#define B00000010 2
+#define B00000011 3
+#define B00000100 4
+#define B00000101 5
+#define B00000110 6
+#define B00001100 12
+#define B10000000 128
+
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+inline unsigned long micros() {
+  return SimClock::now();
+}
+
+inline unsigned long millis() {
+  return SimClock::now() / 1000;
+}
+
+inline void delay(unsigned long t_ms) {
+  SimClock::advance(t_ms * 1000);
+}
+
+inline void delayMicroseconds(unsigned int t_us) {
+  SimClock::advance(t_us);
+}
+
+void pinMode(uint8_t t_pin, uint8_t t_mode);
+void digitalWrite(uint8_t t_pin, uint8_t t_value);
+int digitalRead(uint8_t t_pin);
+
+/// @brief Serial port at 115200 baud. Written bytes go through a 64-byte TX buffer drained at the
+/// line rate of the simulated clock, a write blocks while the buffer is full like on the target.
+/// The test side feeds the RX line and takes what was sent.
+class HardwareSerial {
+  private:
+    static constexpr uint8_t c_txBufferSize = 64;
+
+    std::deque<uint8_t> m_rx;
+    std::deque<uint8_t> m_tx;       // Everything sent, until taken by the test
+    uint8_t m_txPending = 0;        // Bytes in the TX buffer, not on the line yet
+    uint32_t m_lastDrainTime = 0;   // Time (us) the TX buffer was last drained
+    bool m_echo = false;
+
+    /// @brief Move the bytes sent since the last call out of the TX buffer
+    void drain();
+
+  public:
+    void begin(unsigned long t_baud) { }
+    void end() { }
+
+    size_t write(uint8_t t_data);
+    size_t write(const uint8_t* t_data, size_t t_length);
+    size_t print(const char* t_text);
+    size_t print(long t_value);
+    size_t println(const char* t_text);
+    size_t println(long t_value);
+    size_t println();
+
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush();
+
+    /// @brief Put bytes on the RX line
+    /// @param t_data Bytes
+    /// @param t_length Number of bytes
+    void simFeed(const uint8_t* t_data, size_t t_length);
+
+    /// @brief Take the bytes sent, oldest first
+    /// @param t_data Buffer
+    /// @param t_maxLength Size of the buffer
+    /// @return size_t Number of bytes taken
+    size_t simTake(uint8_t* t_data, size_t t_maxLength);
+
+    /// @brief Print what is sent on stdout as well, for the logs of a test
+    /// @param t_echo Echo enabled
+    void simSetEcho(bool t_echo);
+
+    /// @brief Drop everything sent and received, with an empty TX buffer
+    void simReset();
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,39 @@
+#pragma once
+
+// SPI class of the Arduino core for the switch matrix and the LED drivers of the native build,
+// the bytes are clocked out to no device and take their time on the bus
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+
+class SPISettings {
+  public:
+    uint32_t m_clock;
+
+    SPISettings(uint32_t t_clock = 4000000, uint8_t t_bitOrder = MSBFIRST, uint8_t t_dataMode = SPI_MODE0) :
+      m_clock(t_clock) { }
+};
+
+class SPIClass {
+  private:
+    uint32_t m_clock = 4000000;  // Clock (Hz) of the current transaction
+
+  public:
+    void begin() { }
+    void end() { }
+    void beginTransaction(const SPISettings& t_settings);
+    void endTransaction() { }
+
+    /// @brief Clock a byte out, nothing is read back
+    /// @param t_data Byte
+    /// @return uint8_t 0
+    uint8_t transfer(uint8_t t_data);
+
+    /// @brief Clock two bytes out, nothing is read back
+    /// @param t_data Word
+    /// @return uint16_t 0
+    uint16_t transfer16(uint16_t t_data);
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+
+HardwareSerial Serial;
+
+// The native sources don't drive pins, the chip selects are handled by SpiBus
+void pinMode(uint8_t t_pin, uint8_t t_mode) { }
+
+void digitalWrite(uint8_t t_pin, uint8_t t_value) { }
+
+int digitalRead(uint8_t t_pin) {
+  return HIGH;
+}
+
+void HardwareSerial::drain() {
+  uint32_t now = SimClock::now();
+  uint32_t sent = (now - m_lastDrainTime) / SimClock::c_serialByteTime;
+
+  if (sent >= m_txPending) {
+    m_txPending = 0;
+    m_lastDrainTime = now;
+  }
+  else {
+    m_txPending -= sent;
+    m_lastDrainTime += sent * SimClock::c_serialByteTime;
+  }
+}
+
+size_t HardwareSerial::write(uint8_t t_data) {
+  drain();
+
+  // The target spins until the UART makes room
+  if (m_txPending == c_txBufferSize - 1) {
+    SimClock::advance(m_lastDrainTime + SimClock::c_serialByteTime - SimClock::now());
+    drain();
+  }
+
+  if (m_txPending == 0) {
+    m_lastDrainTime = SimClock::now();
+  }
+
+  m_txPending++;
+  m_tx.push_back(t_data);
+
+  if (m_echo) {
+    putchar(t_data);
+  }
+
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* t_data, size_t t_length) {
+  for (size_t i = 0; i < t_length; i++) {
+    write(t_data[i]);
+  }
+
+  return t_length;
+}
+
+size_t HardwareSerial::print(const char* t_text) {
+  return write(reinterpret_cast<const uint8_t*>(t_text), strlen(t_text));
+}
+
+size_t HardwareSerial::print(long t_value) {
+  char text[12];
+  snprintf(text, sizeof(text), "%ld", t_value);
+
+  return print(text);
+}
+
+size_t HardwareSerial::println(const char* t_text) {
+  return print(t_text) + println();
+}
+
+size_t HardwareSerial::println(long t_value) {
+  return print(t_value) + println();
+}
+
+size_t HardwareSerial::println() {
+  return print("\r\n");
+}
+
+int HardwareSerial::available() {
+  return m_rx.size();
+}
+
+int HardwareSerial::read() {
+  if (m_rx.empty()) {
+    return -1;
+  }
+
+  uint8_t data = m_rx.front();
+  m_rx.pop_front();
+
+  return data;
+}
+
+int HardwareSerial::peek() {
+  return m_rx.empty() ? -1 : m_rx.front();
+}
+
+int HardwareSerial::availableForWrite() {
+  drain();
+
+  return c_txBufferSize - 1 - m_txPending;
+}
+
+void HardwareSerial::flush() {
+  drain();
+  SimClock::advance(m_txPending * SimClock::c_serialByteTime);
+  drain();
+}
+
+void HardwareSerial::simFeed(const uint8_t* t_data, size_t t_length) {
+  m_rx.insert(m_rx.end(), t_data, t_data + t_length);
+}
+
+size_t HardwareSerial::simTake(uint8_t* t_data, size_t t_maxLength) {
+  size_t length = 0;
+
+  while (length < t_maxLength && !m_tx.empty()) {
+    t_data[length++] = m_tx.front();
+    m_tx.pop_front();
+  }
+
+  return length;
+}
+
+void HardwareSerial::simSetEcho(bool t_echo) {
+  m_echo = t_echo;
+}
+
+void HardwareSerial::simReset() {
+  m_rx.clear();
+  m_tx.clear();
+  m_txPending = 0;
+  m_lastDrainTime = SimClock::now();
+}
@@ -0,0 +1,264 @@
+#include <string.h>
+
+#include "m95256_model.h"
+#include "sim_clock.h"
+
+namespace {
+  constexpr uint8_t c_read = 0x03;
+  constexpr uint8_t c_write = 0x02;
+  constexpr uint8_t c_wren = 0x06;
+  constexpr uint8_t c_wrdi = 0x04;
+  constexpr uint8_t c_rdsr = 0x05;
+  constexpr uint8_t c_wrsr = 0x01;
+}
+
+M95256Model eepromModel;
+
+M95256Model::M95256Model() {
+  erase();
+}
+
+bool M95256Model::isBusy() const {
+  return int32_t(m_busyUntil - SimClock::now()) > 0;
+}
+
+bool M95256Model::isProtected(uint16_t t_address) const {
+  switch ((m_status & c_statusBp) >> 2) {
+    case 1:
+      return t_address >= c_size - c_size / 4;
+    case 2:
+      return t_address >= c_size / 2;
+    case 3:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void M95256Model::program(uint16_t t_address, uint8_t t_data) {
+  if (m_cutAfter == 0) {
+    m_cutAfter = -1;
+    powerCycle();
+    throw PowerCut();
+  }
+
+  if (m_cutAfter > 0) {
+    m_cutAfter--;
+  }
+
+  m_array[t_address] = t_data;
+  m_cellWrites[t_address]++;
+  m_stats.programmedBytes++;
+}
+
+void M95256Model::startWriteCycle() {
+  if (m_instruction == c_write) {
+    // The page is the one of the address sent, the address counter only wrapped inside it
+    uint16_t page = m_address & ~uint16_t(c_pageSize - 1);
+
+    if (isProtected(page)) {
+      m_stats.protectedWrites++;
+      m_writeEnabled = false;
+      return;
+    }
+
+    m_stats.writeCycles++;
+    m_busyUntil = SimClock::now() + c_writeTime;
+    m_writeEnabled = false;
+
+    for (uint8_t i = 0; i < c_pageSize; i++) {
+      if ((m_latched >> i) & 1) {
+        program(page + i, m_latch[i]);
+      }
+    }
+    return;
+  }
+
+  // WRSR: SRWD with the W pin low locks the register
+  if ((m_status & c_statusSrwd) && !m_writeProtectPin) {
+    m_writeEnabled = false;
+    return;
+  }
+
+  m_stats.writeCycles++;
+  m_busyUntil = SimClock::now() + c_writeTime;
+  m_writeEnabled = false;
+  m_status = m_statusLatch & (c_statusSrwd | c_statusBp);
+}
+
+void M95256Model::select() {
+  if (m_selected) {
+    return;
+  }
+
+  m_selected = true;
+  m_instruction = 0;
+  m_addressBytes = 0;
+  m_dataBytes = 0;
+  m_latched = 0;
+  m_decoded = false;
+  m_stats.transactions++;
+}
+
+void M95256Model::deselect() {
+  if (!m_selected) {
+    return;
+  }
+
+  m_selected = false;
+
+  // A write instruction is executed on the rising edge of CS, once a data byte was latched
+  bool writeInstruction = m_instruction == c_write || m_instruction == c_wrsr;
+  if (m_decoded && writeInstruction && m_writeEnabled && m_dataBytes > 0 &&
+    (m_instruction == c_wrsr || m_addressBytes == 2)) {
+    startWriteCycle();
+  }
+}
+
+uint8_t M95256Model::transfer(uint8_t t_data) {
+  SimClock::advance(SimClock::c_spiByteTime);
+
+  if (!m_selected) {
+    return 0xFF;
+  }
+
+  m_stats.bytes++;
+
+  if (m_instruction == 0) {
+    m_instruction = t_data;
+
+    // During a write cycle only RDSR is decoded
+    m_decoded = !isBusy() || t_data == c_rdsr;
+    if (!m_decoded) {
+      m_stats.ignoredInstructions++;
+      return 0xFF;
+    }
+
+    switch (t_data) {
+      case c_wren:
+        m_writeEnabled = true;
+        break;
+      case c_wrdi:
+        m_writeEnabled = false;
+        break;
+      case c_read:
+        m_stats.readInstructions++;
+        break;
+      case c_rdsr:
+        m_stats.statusReads++;
+        break;
+    }
+    return 0xFF;
+  }
+
+  if (!m_decoded) {
+    return 0xFF;
+  }
+
+  switch (m_instruction) {
+    case c_rdsr:
+      return getStatusRegister();
+
+    case c_wrsr:
+      m_statusLatch = t_data;
+      if (m_dataBytes < 0xFF) {
+        m_dataBytes++;
+      }
+      return 0xFF;
+
+    case c_read:
+    case c_write:
+      if (m_addressBytes < 2) {
+        // The 256 Kbit array ignores the top address bit
+        m_address = m_addressBytes == 0 ? (t_data & 0x7F) << 8 : m_address | t_data;
+        m_addressBytes++;
+        return 0xFF;
+      }
+
+      if (m_instruction == c_read) {
+        // A sequential read rolls over to the start of the array
+        uint8_t data = m_array[m_address];
+        m_address = (m_address + 1) % c_size;
+        return data;
+      }
+
+      // The page latch keeps the last byte clocked at each address, the counter wraps in the page
+      {
+        uint8_t offset = m_address % c_pageSize;
+        m_latch[offset] = t_data;
+        m_latched |= uint64_t(1) << offset;
+        m_address = (m_address & ~uint16_t(c_pageSize - 1)) | ((offset + 1) % c_pageSize);
+        if (m_dataBytes < 0xFF) {
+          m_dataBytes++;
+        }
+      }
+      return 0xFF;
+
+    default:
+      return 0xFF;
+  }
+}
+
+void M95256Model::powerCycle() {
+  m_selected = false;
+  m_instruction = 0;
+  m_writeEnabled = false;
+  m_busyUntil = SimClock::now();
+}
+
+void M95256Model::erase() {
+  memset(m_array, 0xFF, sizeof(m_array));
+  memset(m_cellWrites, 0, sizeof(m_cellWrites));
+  m_status = 0;
+  m_cutAfter = -1;
+  powerCycle();
+  resetStats();
+}
+
+uint8_t M95256Model::peek(uint16_t t_address) const {
+  return m_array[t_address % c_size];
+}
+
+void M95256Model::poke(uint16_t t_address, uint8_t t_data) {
+  m_array[t_address % c_size] = t_data;
+}
+
+void M95256Model::setStatusRegister(uint8_t t_status) {
+  m_status = t_status & (c_statusSrwd | c_statusBp);
+}
+
+uint8_t M95256Model::getStatusRegister() const {
+  return m_status | (m_writeEnabled ? c_statusWel : 0) | (isBusy() ? c_statusWip : 0);
+}
+
+void M95256Model::setWriteProtectPin(bool t_level) {
+  m_writeProtectPin = t_level;
+}
+
+uint32_t M95256Model::getCellWrites(uint16_t t_address) const {
+  return m_cellWrites[t_address % c_size];
+}
+
+uint32_t M95256Model::getMaxCellWrites() const {
+  uint32_t maxWrites = 0;
+
+  for (uint16_t i = 0; i < c_size; i++) {
+    if (m_cellWrites[i] > maxWrites) {
+      maxWrites = m_cellWrites[i];
+    }
+  }
+
+  return maxWrites;
+}
+
+void M95256Model::cutPowerAfter(int32_t t_bytes) {
+  m_cutAfter = t_bytes;
+}
+
+const M95256Stats& M95256Model::getStats() const {
+  return m_stats;
+}
+
+void M95256Model::resetStats() {
+  m_stats = M95256Stats();
+}
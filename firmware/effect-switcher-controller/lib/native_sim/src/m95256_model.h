@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+/// @brief Bus and array activity of the simulated EEPROM
+struct M95256Stats {
+  uint32_t transactions = 0;         // Chip selects
+  uint32_t bytes = 0;                // Bytes clocked while selected
+  uint32_t readInstructions = 0;
+  uint32_t statusReads = 0;          // RDSR instructions, the WIP polls
+  uint32_t writeCycles = 0;          // Internal write cycles started by WRITE or WRSR
+  uint32_t programmedBytes = 0;      // Array bytes programmed by the write cycles
+  uint32_t ignoredInstructions = 0;  // Instructions other than RDSR sent during a write cycle
+  uint32_t protectedWrites = 0;      // WRITE instructions dropped by the block protection
+};
+
+/// @brief Thrown by the model when the power is cut in the middle of a write cycle
+struct PowerCut { };
+
+/// @brief Model of the M95256 SPI EEPROM, 32 KB in 64-byte pages, as seen on its pins.
+/// - READ, WRITE, WREN, WRDI, RDSR and WRSR, a WRITE wraps around inside its page.
+/// - The write enable latch is needed by WRITE and WRSR and reset when they are done.
+/// - A write cycle starts when the chip is deselected and lasts 5 ms of simulated time, only
+///   RDSR is decoded meanwhile.
+/// - BP1 and BP0 protect the upper quarter, half or all of the array, SRWD with the W pin low
+///   locks the status register.
+/// - Each cell counts its write cycles, and the power can be cut after a number of programmed
+///   bytes to leave a torn page behind.
+class M95256Model {
+  public:
+    static constexpr uint16_t c_size = 32768;
+    static constexpr uint8_t c_pageSize = 64;
+    static constexpr uint32_t c_writeTime = 5000;  // Time (us) of a write cycle, the datasheet maximum
+
+    static constexpr uint8_t c_statusWip = 0x01;
+    static constexpr uint8_t c_statusWel = 0x02;
+    static constexpr uint8_t c_statusBp = 0x0C;
+    static constexpr uint8_t c_statusSrwd = 0x80;
+
+  private:
+    uint8_t m_array[c_size];
+    uint32_t m_cellWrites[c_size];
+    uint8_t m_status = 0;             // Non-volatile bits: SRWD, BP1, BP0
+    bool m_writeEnabled = false;      // WEL
+    uint32_t m_busyUntil = 0;         // Time (us) the write cycle ends
+    bool m_writeProtectPin = true;    // W pin level, high leaves the status register writable
+
+    bool m_selected = false;
+    uint8_t m_instruction = 0;        // First byte of the selected transaction, 0 before it
+    uint8_t m_addressBytes = 0;       // Address bytes received
+    uint16_t m_address = 0;           // Address counter
+    uint8_t m_dataBytes = 0;          // Data bytes received by WRITE or WRSR, saturated
+    uint8_t m_latch[c_pageSize];      // Page latch of a WRITE
+    uint64_t m_latched = 0;           // One bit per latched byte of the page
+    uint8_t m_statusLatch = 0;        // Data byte of a WRSR
+    bool m_decoded = false;           // The instruction is decoded, false when it arrived during a write cycle
+
+    int32_t m_cutAfter = -1;          // Programmed bytes before the power cut, -1 without cut
+
+    M95256Stats m_stats;
+
+    /// @brief Check if a write cycle is running
+    bool isBusy() const;
+
+    /// @brief Check if an address is in the blocks protected by BP1 and BP0
+    bool isProtected(uint16_t t_address) const;
+
+    /// @brief Program a byte of the array, the power may be cut before
+    void program(uint16_t t_address, uint8_t t_data);
+
+    /// @brief Run the write cycle of the WRITE or WRSR instruction that just ended
+    void startWriteCycle();
+
+  public:
+    M95256Model();
+
+    /// @brief CS falling edge
+    void select();
+
+    /// @brief CS rising edge, starts the write cycle of a complete WRITE or WRSR
+    void deselect();
+
+    /// @brief Clock a byte in and out while the chip is selected
+    /// @param t_data Byte on the D pin
+    /// @return uint8_t Byte on the Q pin, 0xFF when it is high impedance
+    uint8_t transfer(uint8_t t_data);
+
+    /// @brief Back to the power up state, the array and the non-volatile status bits are kept
+    void powerCycle();
+
+    /// @brief Erase the array to 0xFF, clear the status register and the cell counters
+    void erase();
+
+    /// @brief Read a byte of the array without going through the bus
+    uint8_t peek(uint16_t t_address) const;
+
+    /// @brief Write a byte of the array without going through the bus nor counting it
+    void poke(uint16_t t_address, uint8_t t_data);
+
+    /// @brief Set the non-volatile status bits without going through the bus
+    void setStatusRegister(uint8_t t_status);
+
+    /// @brief Get the status register as RDSR reads it
+    uint8_t getStatusRegister() const;
+
+    /// @brief Set the level of the W pin
+    void setWriteProtectPin(bool t_level);
+
+    /// @brief Get the write cycles of a cell
+    uint32_t getCellWrites(uint16_t t_address) const;
+
+    /// @brief Get the write cycles of the most written cell
+    uint32_t getMaxCellWrites() const;
+
+    /// @brief Cut the power after a number of programmed bytes, the write cycle throws PowerCut
+    /// @param t_bytes Bytes programmed before the cut, -1 to keep the power on
+    void cutPowerAfter(int32_t t_bytes);
+
+    const M95256Stats& getStats() const;
+    void resetStats();
+};
+
+/// @brief The EEPROM of the native build, every SpiBus talks to it
+extern M95256Model eepromModel;
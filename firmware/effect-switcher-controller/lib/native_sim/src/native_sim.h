@@ -0,0 +1,13 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "m95256_model.h"
+#include "sim_clock.h"
+
+/// @brief Start a test from power up: time 0, an erased EEPROM and an idle serial port
+inline void resetSimulation() {
+  SimClock::reset();
+  eepromModel.erase();
+  Serial.simReset();
+}
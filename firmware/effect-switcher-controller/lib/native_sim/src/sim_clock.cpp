@@ -0,0 +1,17 @@
+#include "sim_clock.h"
+
+namespace {
+  uint32_t s_now = 0;
+}
+
+uint32_t SimClock::now() {
+  return s_now;
+}
+
+void SimClock::advance(uint32_t t_time) {
+  s_now += t_time;
+}
+
+void SimClock::reset() {
+  s_now = 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+/// @brief Simulated time of the native build. It only moves when the simulated peripherals spend
+/// time or `delay` is called, so a run is repeatable and its timings don't depend on the host.
+namespace SimClock {
+  // Time (us) of a byte on the SPI bus at 4 MHz
+  constexpr uint32_t c_spiByteTime = 2;
+
+  // Time (us) of a byte on the serial port at 115200 baud, 10 bits per byte
+  constexpr uint32_t c_serialByteTime = 87;
+
+  /// @brief Get the simulated time
+  /// @return uint32_t Time (us) since the last reset
+  uint32_t now();
+
+  /// @brief Let time pass
+  /// @param t_time Time (us)
+  void advance(uint32_t t_time);
+
+  /// @brief Go back to time 0
+  void reset();
+} // namespace SimClock
@@ -0,0 +1,19 @@
+#include "peripherals/spi_bus.h"
+#include "m95256_model.h"
+
+// The EEPROM is the only SpiBus device of the native build, whatever the CS pin. The switch matrix
+// and the LED drivers go through the SPI class of SPI.h.
+
+void SpiBus::begin() { }
+
+void SpiBus::select() {
+  eepromModel.select();
+}
+
+void SpiBus::deselect() {
+  eepromModel.deselect();
+}
+
+uint8_t SpiBus::transfer(uint8_t t_data) {
+  return eepromModel.transfer(t_data);
+}
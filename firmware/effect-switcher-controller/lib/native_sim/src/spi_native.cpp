@@ -0,0 +1,17 @@
+#include <SPI.h>
+
+SPIClass SPI;
+
+void SPIClass::beginTransaction(const SPISettings& t_settings) {
+  m_clock = t_settings.m_clock;
+}
+
+uint8_t SPIClass::transfer(uint8_t t_data) {
+  SimClock::advance(8000000UL / m_clock);
+  return 0;
+}
+
+uint16_t SPIClass::transfer16(uint16_t t_data) {
+  SimClock::advance(16000000UL / m_clock);
+  return 0;
+}
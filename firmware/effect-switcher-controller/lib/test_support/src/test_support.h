@@ -0,0 +1,169 @@
+#pragma once
+
+// Helpers shared by the test suites: seeded presets, EEPROM images, store snapshots and host timing
+
+#include <unity.h>
+#include <native_sim.h>
+#include <chrono>
+#include <string.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+#include "logic/routing.h"
+
+/// @brief Records of every preset of the store, indexed by bank then preset
+typedef uint8_t PresetRecords[c_presetsCount][c_presetSize];
+
+namespace TestSupport {
+  /// @brief Next byte of a xorshift generator, a seed gives the same bytes on every host
+  /// @param t_state Generator state, never 0
+  /// @return uint8_t Pseudo-random byte
+  inline uint8_t nextRandom(uint32_t& t_state) {
+    t_state ^= t_state << 13;
+    t_state ^= t_state >> 17;
+    t_state ^= t_state << 5;
+    return t_state >> 24;
+  }
+
+  /// @brief Make a preset from a seed, the same seed gives the same preset. Loop N uses send N and
+  /// return N like the default routing table, the MIDI messages mix Control Changes and Program
+  /// Changes on two channels.
+  /// @param t_bank Bank of the preset
+  /// @param t_presetIndex Preset index in the bank
+  /// @param t_loopsCount Number of loops
+  /// @param t_midiMessagesCount Number of MIDI messages
+  /// @param t_seed Seed of the loop states, orders and MIDI messages
+  /// @return Preset Preset
+  inline Preset makePreset(uint8_t t_bank, uint8_t t_presetIndex, uint8_t t_loopsCount, uint8_t t_midiMessagesCount, uint32_t t_seed) {
+    Preset preset(t_bank, t_presetIndex, t_loopsCount, t_midiMessagesCount);
+    uint32_t state = t_seed * 2654435761u + 1;
+
+    for (uint8_t i = 0; i < t_loopsCount; i++) {
+      preset.setLoopState(i, nextRandom(state) & 1);
+      preset.setLoopOrder(i, nextRandom(state) % c_maxLoops);
+      preset.setLoopSend(i, i);
+      preset.setLoopReturn(i, i);
+    }
+
+    for (uint8_t j = 0; j < t_midiMessagesCount; j++) {
+      uint8_t type = (nextRandom(state) & 1) ? 0xB0 : 0xC0;
+      preset.setMidiMessageStatusByte(j, type | (nextRandom(state) & 1));
+      preset.setMidiMessageDataByte1(j, nextRandom(state) & 0x7F);
+      preset.setMidiMessageDataByte2(j, type == 0xB0 ? nextRandom(state) & 0x7F : 255);
+    }
+
+    return preset;
+  }
+
+  /// @brief Make the preset of the largest record: every loop, every MIDI message a Control Change
+  /// with its own status byte
+  /// @param t_bank Bank of the preset
+  /// @param t_presetIndex Preset index in the bank
+  /// @return Preset Preset
+  inline Preset makeLargestPreset(uint8_t t_bank, uint8_t t_presetIndex) {
+    Preset preset(t_bank, t_presetIndex, c_maxRoutedLoops, c_maxMidiMessages);
+
+    for (uint8_t i = 0; i < c_maxRoutedLoops; i++) {
+      preset.setLoopState(i, i % 2);
+      preset.setLoopOrder(i, i);
+      preset.setLoopSend(i, i);
+      preset.setLoopReturn(i, i);
+    }
+
+    for (uint8_t j = 0; j < c_maxMidiMessages; j++) {
+      preset.setMidiMessageStatusByte(j, 0xB0 | (j % 2));
+      preset.setMidiMessageDataByte1(j, j);
+      preset.setMidiMessageDataByte2(j, 127 - j);
+    }
+
+    return preset;
+  }
+
+  /// @brief Read bytes of the simulated EEPROM without a bus transaction
+  /// @param t_address First address
+  /// @param t_data Buffer to read into
+  /// @param t_length Number of bytes
+  inline void peekArray(uint16_t t_address, uint8_t* t_data, uint16_t t_length) {
+    for (uint16_t i = 0; i < t_length; i++) {
+      t_data[i] = eepromModel.peek(t_address + i);
+    }
+  }
+
+  /// @brief Write bytes of the simulated EEPROM without a bus transaction, to build a store
+  /// @param t_address First address
+  /// @param t_data Bytes to write
+  /// @param t_length Number of bytes
+  inline void pokeArray(uint16_t t_address, const uint8_t* t_data, uint16_t t_length) {
+    for (uint16_t i = 0; i < t_length; i++) {
+      eepromModel.poke(t_address + i, t_data[i]);
+    }
+  }
+
+  /// @brief Read the record of every preset, a preset never saved reads as zeros
+  /// @param t_memoryManager Store to read
+  /// @param t_records Records read
+  inline void snapshotRecords(MemoryManager& t_memoryManager, PresetRecords& t_records) {
+    for (uint16_t i = 0; i < c_presetsCount; i++) {
+      memset(t_records[i], 0, c_presetSize);
+      t_memoryManager.loadPresetRecord(i / c_presetsPerBank, i % c_presetsPerBank, t_records[i]);
+    }
+  }
+
+  /// @brief Check that a store holds the records of a snapshot
+  /// @param t_memoryManager Store to read
+  /// @param t_records Snapshot
+  /// @return true if every record is the same
+  inline bool isStoreHolding(MemoryManager& t_memoryManager, const PresetRecords& t_records) {
+    uint8_t record[c_presetSize];
+
+    for (uint16_t i = 0; i < c_presetsCount; i++) {
+      memset(record, 0, c_presetSize);
+      t_memoryManager.loadPresetRecord(i / c_presetsPerBank, i % c_presetsPerBank, record);
+      if (memcmp(t_records[i], record, c_presetSize) != 0) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /// @brief Assert that a store holds the records of a snapshot, the first record that differs fails
+  /// @param t_memoryManager Store to read
+  /// @param t_records Snapshot
+  inline void assertRecordsKept(MemoryManager& t_memoryManager, const PresetRecords& t_records) {
+    uint8_t record[c_presetSize];
+
+    for (uint16_t i = 0; i < c_presetsCount; i++) {
+      memset(record, 0, c_presetSize);
+      t_memoryManager.loadPresetRecord(i / c_presetsPerBank, i % c_presetsPerBank, record);
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(t_records[i], record, c_presetSize);
+    }
+  }
+
+  /// @brief Run the main loop for a while, in steps of 1 ms of simulated time
+  /// @param t_presetManager Preset manager to poll
+  /// @param t_memoryManager Memory manager to poll
+  /// @param t_time Time to run (ms)
+  inline void pollFor(PresetManager& t_presetManager, MemoryManager& t_memoryManager, uint32_t t_time) {
+    uint32_t startTime = millis();
+
+    while (millis() - startTime < t_time) {
+      t_presetManager.poll();
+      t_memoryManager.poll();
+      SimClock::advance(1000);
+    }
+  }
+
+  /// @brief Read the host clock, for the benchmarks of the code run on the host
+  /// @return double Time (ns)
+  inline double nowNs() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /// @brief Keep a benchmarked result from being optimized away
+  /// @param t_value Result
+  inline void keep(uint32_t t_value) {
+    static volatile uint32_t s_sink;
+    s_sink = s_sink + t_value;
+  }
+} // namespace TestSupport
@@ -2,6 +2,8 @@
 
 MemoryManager memoryManager(0);
 PresetManager presetManager(memoryManager);
+LatencyTracer latencyTracer;
+StoreTransfer storeTransfer(memoryManager, presetManager, latencyTracer);
 
 Encoder menuEncoder(12, 13);
 MomentarySwitch menuEncoderSwitch(14, 1000);
@@ -15,12 +17,12 @@ MomentarySwitch footSwitch2(26);
 MomentarySwitch footSwitch3(27);
 MomentarySwitch footSwitch4(28);
 MomentarySwitch footSwitch5(29);
+MomentarySwitch* footSwitches[] = {&footSwitch0, &footSwitch1, &footSwitch2, &footSwitch3, &footSwitch4, &footSwitch5};
 
-// LedDriver16 presetLed(1);
+LedDriver16 presetLed(1);
 
-// SwitchMatrix matrix(2);
-
-Preset presetBank[c_maxPresets];
+SwitchMatrix matrix(2);
+PresetSwitcher presetSwitcher(presetManager, matrix, presetLed, latencyTracer);
 
 MenuManager menuManager;
 DisplayManager displayManager(128, 64);
@@ -92,27 +94,25 @@ void Hardware::processFootSwitchAction(uint8_t t_footSwitch, bool t_longPress) {
         break;
 
       case FootSwitchMode::kBankSelect:
+        // The view is updated by `poll` once the bank is loaded
+        latencyTracer.begin(footSwitches[t_footSwitch]->getEdgeTime());
         if (presetManager.getFootSwitchTargetBank(t_footSwitch) == 1) {
           // Up
           presetManager.setPresetBankUp();
-          m_presetView = createPresetView(presetManager.getCurrentPreset());
-          homeMenu.setCurrentPreset(presetManager.getCurrentPreset());
-          menuManager.update();
         }
         else {
           // Down
           presetManager.setPresetBankDown();
-          m_presetView = createPresetView(presetManager.getCurrentPreset());
-          homeMenu.setCurrentPreset(presetManager.getCurrentPreset());
-          menuManager.update();
         }
         break;
 
       case FootSwitchMode::kPresetSelect:
+        latencyTracer.begin(footSwitches[t_footSwitch]->getEdgeTime());
         presetManager.setCurrentPreset(presetManager.getFootSwitchTargetPreset(t_footSwitch));
-        m_presetView = createPresetView(presetManager.getCurrentPreset());
-        homeMenu.setCurrentPreset(presetManager.getCurrentPreset());
-        menuManager.update();
+        presetSwitcher.switchPreset();
+        presetSwitcher.poll();
+        // The display is redrawn by `poll` once the output is connected to the new chain
+        m_presetRedrawPending = true;
         break;
 
       case FootSwitchMode::kMute:
@@ -129,6 +129,8 @@ void Hardware::transitionToState(SystemState t_newState) {
 
   switch (t_newState) {
     case SystemState::kPresetState:
+      // Store the presets saved while in the menus
+      presetManager.writeBack();
       settingsMenu.reset();
       loopsMenu.reset();
       midiMessagesMenu.reset();
@@ -139,6 +141,8 @@ void Hardware::transitionToState(SystemState t_newState) {
       break;
 
     case SystemState::kSettingsState:
+      // Edit the bank that was selected, not the one it replaces
+      presetManager.completeBankLoad();
       menuManager.reset();
       menuManager.setMenu(&settingsMenu);
       menuManager.update();
@@ -284,6 +288,7 @@ void Hardware::processLoopsEditState() {
   if (loopsMenu.isSaveRequested()) {
     applyPresetView(presetManager.getCurrentPreset());
     presetManager.saveCurrentPreset();
+    presetSwitcher.switchPreset();
     transitionToState(kSettingsState);
   }
 
@@ -380,6 +385,13 @@ void Hardware::processFootSwitchesListState() {
   }
 }
 
+void Hardware::redrawPreset() {
+  m_presetView = createPresetView(presetManager.getCurrentPreset());
+  homeMenu.setCurrentPreset(presetManager.getCurrentPreset());
+  menuManager.update();
+  latencyTracer.mark(TraceStage::kDisplayed);
+}
+
 PresetView Hardware::createPresetView(const Preset* t_preset) {
   PresetView view;
 
@@ -436,12 +448,13 @@ void Hardware::setup() {
   footSwitch3.setup();
   footSwitch4.setup();
   footSwitch5.setup();
-  // presetLed.setup();
-  // matrix.switchMatrixSetup();
+  presetLed.setup();
+  matrix.switchMatrixSetup();
   menuManager.setMenu(&homeMenu);
 
   // Careful
   //  memoryManager.initializeTestData();
+  //  memoryManager.benchmarkStore();
   // Careful
 
   delay(100);
@@ -463,6 +476,7 @@ void Hardware::startup() {
   //Careful
 
   presetManager.initialize();
+  presetSwitcher.switchPreset();
   delay(200);
   m_presetView = createPresetView(presetManager.getCurrentPreset());
   homeMenu.setCurrentPreset(presetManager.getCurrentPreset());
@@ -471,6 +485,27 @@ void Hardware::startup() {
 }
 
 void Hardware::poll() {
+  // Pending EEPROM writes advance one page per loop
+  memoryManager.poll();
+
+  // Store dump and restore frames, a restore reloads the presets. MIDI bytes would cut the frames.
+  storeTransfer.poll();
+  presetSwitcher.setMidiEnabled(storeTransfer.getState() == TransferState::kIdle);
+
+  // Saved presets are written back once the saves stop, banks are loaded and prefetched
+  if (presetManager.poll()) {
+    presetSwitcher.switchPreset();
+    m_presetRedrawPending = true;
+  }
+
+  // Stages of the preset switch in progress, the redraw blocks the loop so it waits for the unmute
+  presetSwitcher.poll();
+
+  if (m_presetRedrawPending && !presetSwitcher.isSwitching()) {
+    m_presetRedrawPending = false;
+    redrawPreset();
+  }
+
   switch (m_systemState) {
     case kPresetState:
       pollMenuEditSwitch();
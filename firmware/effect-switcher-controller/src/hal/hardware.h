@@ -11,13 +11,14 @@
 #include "logic/midi_menu.h"
 #include "logic/preset_manager.h"
 #include "logic/preset_view.h"
+#include "logic/preset_switcher.h"
+#include "logic/store_transfer.h"
 #include "peripherals/encoder.h"
 #include "peripherals/led.h"
 #include "peripherals/switch.h"
 #include "peripherals/leddriver.h"
 #include "peripherals/switchmatrix.h"
 
-constexpr uint8_t c_maxPresets = 4;
 constexpr uint8_t c_firstLoop = 0;
 
 /// @brief Possible system states
@@ -37,6 +38,7 @@ class Hardware
     SystemState m_systemState = kPresetState;
 
     PresetView m_presetView;
+    bool m_presetRedrawPending = false;  // The home screen shows the new preset once the switch is unmuted
 
     // Hardware Triggers
     bool m_menuEncoderMove = false;
@@ -76,6 +78,8 @@ class Hardware
     void processMidiMessageEditState();
     void processFootSwitchesListState();
 
+    void redrawPreset();
+
     PresetView createPresetView(const Preset* t_preset);
     void applyPresetView(Preset* t_preset);
 
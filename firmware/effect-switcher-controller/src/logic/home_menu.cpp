@@ -5,11 +5,9 @@ void HomeMenu::update() {
 
   m_layoutManager->setHeader("Current preset");
 
-  char text[4];
-  text[0] = 'A' + m_currentPreset->getBank();
-  text[1] = '-';
-  text[2] = '0' + m_currentPreset->getPreset();
-  text[3] = '\0';
+  // Banks outnumber the letters, they are shown as numbers
+  char text[8];
+  snprintf(text, sizeof(text), "%02d-%d", m_currentPreset->getBank(), m_currentPreset->getPreset());
 
   Row row;
   row.alignment = Row::kFullScreen;
@@ -1,158 +1,1590 @@
 #include "memory.h"
+#include "logic/preset_record_view.h"
+#include "logic/routing.h"
 
-uint16_t MemoryManager::calculatePresetAddress(uint8_t t_bank, uint8_t t_presetIndex) const {
-  return c_banksStartAddress + (t_bank * c_presetsPerBank + t_presetIndex) * c_presetSize;
+uint16_t MemoryManager::calculatePresetIndexAddress(uint8_t t_bank, uint8_t t_presetIndex) const {
+  return c_presetIndexAddress + t_bank * c_bankIndexSize + t_presetIndex * c_presetIndexEntrySize;
 }
 
-uint16_t MemoryManager::calculateFootSwitchConfigAddress(uint8_t t_bank, uint8_t t_footSwitchIndex) const {
-  return c_footSwitchConfigStartAddress + (t_bank * c_footSwitchConfigPerBank + t_footSwitchIndex) * c_footSwitchConfigSize;
+bool MemoryManager::isPresetIndexEntryValid(const uint8_t* t_entry) const {
+  uint16_t address = (t_entry[0] << 8) | t_entry[1];
+  uint8_t length = t_entry[2];
+
+  return length > 0 && length <= c_presetSize &&
+    address >= c_presetHeapAddress && address <= c_presetHeapEnd - length;
+}
+
+bool MemoryManager::isPresetIndexEntryCorrupted(const uint8_t* t_entry) const {
+  bool erased = t_entry[0] == 0xFF && t_entry[1] == 0xFF && t_entry[2] == 0xFF;
+
+  return !erased && t_entry[2] != c_quarantinedLength && !isPresetIndexEntryValid(t_entry);
+}
+
+void MemoryManager::readPresetRecord(const uint8_t* t_entry, uint8_t* t_buffer) {
+  if (!isPresetIndexEntryValid(t_entry)) {
+    // Never saved
+    Preset emptyPreset(0, 0, 0, 0);
+    serializePreset(emptyPreset, t_buffer);
+    return;
+  }
+
+  uint16_t address = (t_entry[0] << 8) | t_entry[1];
+  uint8_t length = t_entry[2];
+
+  // The record walk may look past the record length
+  memset(t_buffer, 0, c_presetSize);
+  eeprom.readArray(address, t_buffer, length);
+
+  if (getPresetRecordLength(t_buffer) != length) {
+    restorePresetRecord(address, length, t_buffer);
+  }
+}
+
+void MemoryManager::scanPresetHeapTop(uint16_t t_entriesCount) {
+  uint8_t entry[c_presetIndexEntrySize];
+  bool corrupted = false;
+  m_presetHeapTop = c_presetHeapAddress;
+  m_quarantinedRecords = 0;
+
+  eeprom.beginRead(c_presetIndexAddress);
+  for (uint16_t i = 0; i < t_entriesCount; i++) {
+    eeprom.readNext(entry, c_presetIndexEntrySize);
+
+    if (isPresetIndexEntryValid(entry)) {
+      uint16_t end = ((entry[0] << 8) | entry[1]) + entry[2];
+      if (end > m_presetHeapTop) {
+        m_presetHeapTop = end;
+      }
+    }
+    else if (entry[2] == c_quarantinedLength) {
+      m_quarantinedRecords++;
+    }
+    else if (!corrupted && isPresetIndexEntryCorrupted(entry)) {
+      // The scrubber quarantines it first
+      m_scrubEntry = i;
+      corrupted = true;
+    }
+  }
+  eeprom.endRead();
+}
+
+bool MemoryManager::allocatePresetExtent(uint8_t t_length, uint16_t& t_address) {
+  if (m_presetHeapTop == 0) {
+    scanPresetHeapTop();
+  }
+
+  // The caller keeps the record and stores it again once `poll` compacted the heap
+  if (c_presetHeapEnd - m_presetHeapTop < t_length) {
+    m_compactionPending = true;
+    return false;
+  }
+
+  t_address = m_presetHeapTop;
+  m_presetHeapTop += t_length;
+  m_presetHeapGrown = true;
+
+  if (c_presetHeapEnd - m_presetHeapTop < c_compactionReserve) {
+    m_compactionPending = true;
+  }
+
+  return true;
+}
+
+void MemoryManager::beginCompaction() {
+  m_compactionPending = false;
+  m_compacting = true;
+  m_compactionTop = c_presetHeapAddress;
+  m_compactionMoved = 0;
+  m_compactionScanEntry = 0;
+  m_compactionBatchCount = 0;
+  m_compactionBatchNext = 0;
+  m_presetHeapGrown = false;
+}
+
+void MemoryManager::stepCompaction() {
+  if (m_compactionScanEntry < c_indexEntriesCount) {
+    scanCompactionBatch();
+    return;
+  }
+
+  if (m_compactionBatchNext < m_compactionBatchCount) {
+    moveCompactionRecord(m_compactionBatch[m_compactionBatchNext++]);
+    return;
+  }
+
+  // A full batch may have left records above it, and the records stored since the scan started may
+  // be anywhere above the compacted ones
+  if (m_compactionBatchCount == c_compactionBatchSize || m_presetHeapGrown) {
+    m_compactionScanEntry = 0;
+    m_compactionBatchCount = 0;
+    m_compactionBatchNext = 0;
+    m_presetHeapGrown = false;
+    return;
+  }
+
+  m_compacting = false;
+  m_presetHeapTop = m_compactionTop;
+
+  LOG_INFO("Compacted the preset heap, %d records moved, %u bytes free", m_compactionMoved,
+    c_presetHeapEnd - m_compactionTop);
+}
+
+void MemoryManager::scanCompactionBatch() {
+  uint8_t entry[c_presetIndexEntrySize];
+  uint16_t end = m_compactionScanEntry + c_compactionScanSlice;
+  if (end > c_indexEntriesCount) {
+    end = c_indexEntriesCount;
+  }
+
+  eeprom.beginRead(c_presetIndexAddress + m_compactionScanEntry * c_presetIndexEntrySize);
+  for (; m_compactionScanEntry < end; m_compactionScanEntry++) {
+    eeprom.readNext(entry, c_presetIndexEntrySize);
+
+    uint16_t address = (entry[0] << 8) | entry[1];
+    if (!isPresetIndexEntryValid(entry) || address < m_compactionTop) {
+      continue;
+    }
+
+    // Insertion in the batch sorted by address, the highest record drops out of a full batch
+    uint8_t position = m_compactionBatchCount;
+    while (position > 0 && m_compactionBatch[position - 1].address > address) {
+      position--;
+    }
+    if (position == c_compactionBatchSize) {
+      continue;
+    }
+
+    uint8_t last = m_compactionBatchCount < c_compactionBatchSize ? m_compactionBatchCount : c_compactionBatchSize - 1;
+    for (uint8_t i = last; i > position; i--) {
+      m_compactionBatch[i] = m_compactionBatch[i - 1];
+    }
+    m_compactionBatch[position].entryNumber = m_compactionScanEntry;
+    m_compactionBatch[position].address = address;
+    m_compactionBatch[position].length = entry[2];
+    if (m_compactionBatchCount < c_compactionBatchSize) {
+      m_compactionBatchCount++;
+    }
+  }
+  eeprom.endRead();
+}
+
+void MemoryManager::moveCompactionRecord(const CompactionMove& t_move) {
+  uint8_t entry[c_presetIndexEntrySize];
+  uint16_t indexAddress = c_presetIndexAddress + t_move.entryNumber * c_presetIndexEntrySize;
+  eeprom.readArray(indexAddress, entry, c_presetIndexEntrySize);
+
+  // Stored again at the top of the heap or erased since the scan, its old extent is free
+  if (!isPresetIndexEntryValid(entry) || ((entry[0] << 8) | entry[1]) != t_move.address ||
+    entry[2] != t_move.length) {
+    return;
+  }
+
+  // Records are moved down in address order, a record only overwrites freed extents or itself
+  if (t_move.address != m_compactionTop) {
+    uint8_t buffer[c_presetSize];
+    eeprom.readArray(t_move.address, buffer, t_move.length);
+
+    entry[0] = highByte(m_compactionTop);
+    entry[1] = lowByte(m_compactionTop);
+    commitRecord(m_compactionTop, buffer, t_move.length, indexAddress, entry);
+    m_compactionMoved++;
+  }
+
+  m_compactionTop += t_move.length;
+}
+
+uint8_t MemoryManager::serializePreset(const Preset& t_preset, uint8_t* t_buffer) const {
+  // Orders are packed with OR, and unused bytes compare equal to the stored record
+  memset(t_buffer, 0, c_presetSize);
+
+  // Basic preset data, the loops past the matrix channels can't be routed and aren't stored
+  uint8_t loopsCount = t_preset.getLoopsCount() < c_maxRoutedLoops ? t_preset.getLoopsCount() : c_maxRoutedLoops;
+  uint8_t midiMessagesCount = t_preset.getMidiMessagesCount();
+  t_buffer[0] = c_presetRecordVersion;
+  t_buffer[1] = loopsCount;
+  t_buffer[2] = midiMessagesCount;
+
+  // Loops data: a state bit and an order nibble per loop
+  uint16_t loopStates = 0;
+  for (uint8_t i = 0; i < loopsCount; i++) {
+    if (t_preset.getLoopState(i)) {
+      bitSet(loopStates, i);
+    }
+
+    uint8_t order = t_preset.getLoopOrder(i) & 0x0F;
+    t_buffer[c_presetOrdersOffset + i / 2] |= (i % 2 == 0) ? order << 4 : order;
+  }
+  t_buffer[3] = highByte(loopStates);
+  t_buffer[4] = lowByte(loopStates);
+
+  // MIDI messages data: start after the orders, the status byte is only stored when it changes
+  uint8_t offset = c_presetOrdersOffset + (loopsCount + 1) / 2;
+  uint8_t runningStatus = 0;
+  uint8_t storedMessagesCount = 0;
+  for (uint8_t j = 0; j < midiMessagesCount; j++) {
+    // A message without a status byte isn't sent as another message, it is left out
+    uint8_t statusByte = t_preset.getMidiMessageStatusByte(j);
+    if (!(statusByte & 0x80)) {
+      continue;
+    }
+    storedMessagesCount++;
+
+    if (statusByte != runningStatus) {
+      t_buffer[offset++] = statusByte;
+      runningStatus = statusByte;
+    }
+
+    // Data bytes are 7 bits so they can't be mistaken for a status byte
+    t_buffer[offset++] = t_preset.getMidiMessageDataByte1(j) & 0x7F;
+    if (MidiMessage::getDataBytesCount(statusByte) == 2) {
+      t_buffer[offset++] = t_preset.getMidiMessageDataByte2(j) & 0x7F;
+    }
+  }
+  t_buffer[2] = storedMessagesCount;
+
+  uint16_t crc = Utils::crc16(t_buffer, offset);
+  t_buffer[offset] = highByte(crc);
+  t_buffer[offset + 1] = lowByte(crc);
+
+  return offset + 2;
+}
+
+void MemoryManager::deserializePreset(const uint8_t* t_buffer, uint8_t t_bank, uint8_t t_presetIndex, Preset& t_preset) {
+  if (!m_routingTableLoaded) {
+    loadRoutingTable();
+  }
+
+  PresetRecordView record(t_buffer);
+
+  // Basic preset data
+  t_preset.setBank(t_bank);
+  t_preset.setPreset(t_presetIndex);
+
+  // A loop past the matrix channels, saved by an earlier firmware, is left out
+  uint8_t loopsCount = record.getLoopsCount() < c_maxRoutedLoops ? record.getLoopsCount() : c_maxRoutedLoops;
+  t_preset.setLoopsCount(loopsCount);
+
+  uint8_t midiMessageCount = record.getMidiMessagesCount();
+  t_preset.setMidiMessagesCount(midiMessageCount);
+
+  // Loops data: a state bit and an order nibble per loop, the routing comes from the table
+  for (uint8_t i = 0; i < loopsCount; i++) {
+    t_preset.setLoopState(i, record.getLoopState(i));
+    t_preset.setLoopOrder(i, record.getLoopOrder(i));
+    t_preset.setLoopSend(i, m_loopSends[i]);
+    t_preset.setLoopReturn(i, m_loopReturns[i]);
+  }
+
+  // MIDI messages data
+  MidiMessageCursor cursor = record.beginMidiMessages();
+  for (uint8_t j = 0; j < midiMessageCount; j++) {
+    uint8_t statusByte, dataByte1, dataByte2;
+    record.readMidiMessage(cursor, statusByte, dataByte1, dataByte2);
+
+    t_preset.setMidiMessageStatusByte(j, statusByte);
+    t_preset.setMidiMessageDataByte1(j, dataByte1);
+    t_preset.setMidiMessageDataByte2(j, dataByte2);
+  }
+}
+
+uint8_t MemoryManager::getPresetRecordLength(const uint8_t* t_buffer) const {
+  uint8_t loopsCount = t_buffer[1];
+  uint8_t midiMessagesCount = t_buffer[2];
+
+  if (t_buffer[0] != c_presetRecordVersion || loopsCount > c_maxLoops || midiMessagesCount > c_maxMidiMessages) {
+    return 0;
+  }
+
+  // The counts are bounded so the walk stays within `c_presetSize` bytes
+  uint8_t offset = c_presetOrdersOffset + (loopsCount + 1) / 2;
+  uint8_t runningStatus = 0;
+  for (uint8_t j = 0; j < midiMessagesCount; j++) {
+    if (t_buffer[offset] & 0x80) {
+      runningStatus = t_buffer[offset++];
+    }
+    else if (runningStatus == 0) {
+      return 0;
+    }
+
+    offset += MidiMessage::getDataBytesCount(runningStatus);
+  }
+
+  uint16_t crc = (t_buffer[offset] << 8) | t_buffer[offset + 1];
+  if (crc != Utils::crc16(t_buffer, offset)) {
+    return 0;
+  }
+
+  return offset + 2;
+}
+
+bool MemoryManager::isPresetRecordValid(const uint8_t* t_buffer) const {
+  return getPresetRecordLength(t_buffer) != 0;
+}
+
+bool MemoryManager::readShadowCopy(uint16_t t_address, uint8_t t_length, uint8_t* t_buffer) {
+  uint8_t header[c_shadowHeaderSize];
+
+  // Every write to the heap goes through the shadow area, a copy for this extent is its last write
+  return readShadowHeader(header) &&
+    ((header[1] << 8) | header[2]) == t_address &&
+    header[3] == t_length &&
+    readShadowData(header, t_buffer);
+}
+
+void MemoryManager::restorePresetRecord(uint16_t t_address, uint8_t t_length, uint8_t* t_buffer) {
+  if (readShadowCopy(t_address, t_length, t_buffer) && getPresetRecordLength(t_buffer) == t_length) {
+    LOG_ERROR("Corrupted preset at 0x%X, using its shadow copy", t_address);
+    return;
+  }
+
+  LOG_ERROR("Corrupted preset at 0x%X, using an empty preset", t_address);
+
+  Preset emptyPreset(0, 0, 0, 0);
+  serializePreset(emptyPreset, t_buffer);
+}
+
+bool MemoryManager::isIndexedRecordValid(uint16_t t_entryNumber, const uint8_t* t_buffer, uint8_t t_length) const {
+  if (t_entryNumber < c_presetsCount) {
+    return getPresetRecordLength(t_buffer) == t_length;
+  }
+
+  return isFootSwitchOverridesValid(t_buffer, t_length);
+}
+
+void MemoryManager::scrubNextEntry() {
+  uint16_t entryNumber = m_scrubEntry;
+  uint16_t indexAddress = c_presetIndexAddress + entryNumber * c_presetIndexEntrySize;
+  m_scrubEntry = (m_scrubEntry + 1) % c_indexEntriesCount;
+
+  uint8_t entry[c_presetIndexEntrySize];
+  eeprom.readArray(indexAddress, entry, c_presetIndexEntrySize);
+
+  if (isPresetIndexEntryCorrupted(entry)) {
+    LOG_ERROR("Corrupted index entry %u, quarantined", entryNumber);
+    quarantineIndexEntry(indexAddress);
+    return;
+  }
+
+  if (!isPresetIndexEntryValid(entry)) {
+    return;
+  }
+
+  uint16_t address = (entry[0] << 8) | entry[1];
+  uint8_t length = entry[2];
+  uint8_t buffer[c_presetSize];
+
+  // The record walk may look past the record length
+  memset(buffer, 0, c_presetSize);
+  eeprom.readArray(address, buffer, length);
+
+  if (isIndexedRecordValid(entryNumber, buffer, length)) {
+    return;
+  }
+
+  if (readShadowCopy(address, length, buffer) && isIndexedRecordValid(entryNumber, buffer, length)) {
+    LOG_ERROR("Corrupted record at 0x%X, rewritten from its shadow copy", address);
+    commitRecord(address, buffer, length);
+    m_repairedRecords++;
+    return;
+  }
+
+  LOG_ERROR("Corrupted record at 0x%X, index entry %u quarantined", address, entryNumber);
+  quarantineIndexEntry(indexAddress);
+}
+
+void MemoryManager::quarantineIndexEntry(uint16_t t_indexAddress) {
+  // A single byte write, the entry is either intact or quarantined
+  uint8_t length = c_quarantinedLength;
+  eeprom.queueWrite(t_indexAddress + 2, &length, 1);
+  m_quarantinedRecords++;
+}
+
+void MemoryManager::loadRoutingTable() {
+  uint8_t buffer[c_routingTableSize];
+  eeprom.readArray(c_routingTableAddress, buffer, c_routingTableSize);
+
+  uint16_t crc = (buffer[c_routingTableSize - 2] << 8) | buffer[c_routingTableSize - 1];
+  bool valid = crc == Utils::crc16(buffer, c_routingTableSize - 2);
+
+  if (valid) {
+    memcpy(m_loopSends, buffer, c_maxLoops);
+    memcpy(m_loopReturns, &buffer[c_maxLoops], c_maxLoops);
+    Routing::checkTable(m_loopSends, m_loopReturns);
+  }
+  else {
+    LOG_ERROR("Corrupted routing table, using the default routing");
+    setDefaultRoutingTable();
+  }
+
+  m_routingTableLoaded = true;
+}
+
+void MemoryManager::setDefaultRoutingTable() {
+  // Loop N uses send N and return N, the entries past the matrix channels are left unwired
+  for (uint8_t i = 0; i < c_maxLoops; i++) {
+    m_loopSends[i] = i < c_maxRoutedLoops ? i : c_unwiredChannel;
+    m_loopReturns[i] = i < c_maxRoutedLoops ? i : c_unwiredChannel;
+  }
+}
+
+bool MemoryManager::updateRoutingTable(const Preset& t_preset) {
+  if (m_storeLocked) {
+    return false;
+  }
+
+  if (!m_routingTableLoaded) {
+    loadRoutingTable();
+  }
+
+  bool changed = false;
+  uint8_t loopsCount = t_preset.getLoopsCount() < c_maxRoutedLoops ? t_preset.getLoopsCount() : c_maxRoutedLoops;
+
+  for (uint8_t i = 0; i < loopsCount; i++) {
+    if (m_loopSends[i] != t_preset.getLoopSend(i) || m_loopReturns[i] != t_preset.getLoopReturn(i)) {
+      m_loopSends[i] = t_preset.getLoopSend(i);
+      m_loopReturns[i] = t_preset.getLoopReturn(i);
+      changed = true;
+    }
+  }
+
+  if (changed) {
+    Routing::checkTable(m_loopSends, m_loopReturns);
+    writeRoutingTable();
+  }
+
+  return changed;
+}
+
+const uint8_t* MemoryManager::getLoopSends() {
+  if (!m_routingTableLoaded) {
+    loadRoutingTable();
+  }
+
+  return m_loopSends;
+}
+
+const uint8_t* MemoryManager::getLoopReturns() {
+  if (!m_routingTableLoaded) {
+    loadRoutingTable();
+  }
+
+  return m_loopReturns;
+}
+
+void MemoryManager::writeRoutingTable() {
+  uint8_t buffer[c_routingTableSize];
+  memcpy(buffer, m_loopSends, c_maxLoops);
+  memcpy(&buffer[c_maxLoops], m_loopReturns, c_maxLoops);
+
+  uint16_t crc = Utils::crc16(buffer, c_routingTableSize - 2);
+  buffer[c_routingTableSize - 2] = highByte(crc);
+  buffer[c_routingTableSize - 1] = lowByte(crc);
+
+  commitRecord(c_routingTableAddress, buffer, c_routingTableSize);
+}
+
+bool MemoryManager::readShadowHeader(uint8_t* t_header) {
+  eeprom.readArray(c_shadowHeaderAddress, t_header, c_shadowHeaderSize);
+
+  return Utils::crc8(&t_header[1], c_shadowHeaderSize - 2) == t_header[c_shadowHeaderSize - 1] &&
+    t_header[3] <= c_shadowDataSize;
+}
+
+bool MemoryManager::readShadowData(const uint8_t* t_header, uint8_t* t_buffer) {
+  uint8_t length = t_header[3];
+  eeprom.readArray(c_shadowDataAddress, t_buffer, length);
+
+  return Utils::fletcher16(t_buffer, length) == ((t_header[4] << 8) | t_header[5]);
+}
+
+void MemoryManager::serializeFootSwitchConfig(const FootSwitchConfig& t_config, uint8_t* t_buffer) const {
+  t_buffer[0] = uint8_t(t_config.getMode());
+  t_buffer[1] = t_config.getLatching();
+  t_buffer[2] = t_config.getLoopIndex();
+  t_buffer[3] = t_config.getTargetBank();
+  t_buffer[4] = t_config.getTargetPreset();
+
+  for (uint8_t i = 0 ; i < 2; i++) {
+    uint8_t baseIndex = 5 + i * 3;
+    t_buffer[baseIndex] = t_config.getMidiMessageType(i);
+    t_buffer[baseIndex + 1] = t_config.getMidiMessageDataByte1(i);
+    t_buffer[baseIndex + 2] = t_config.getMidiMessageDataByte2(i);
+  }
+}
+
+void MemoryManager::deserializeFootSwitchConfig(const uint8_t* t_buffer, FootSwitchConfig& t_config) const {
+  t_config.setMode(static_cast<FootSwitchMode>(t_buffer[0]));
+  t_config.setLatching(t_buffer[1]);
+  t_config.setLoopIndex(t_buffer[2]);
+  t_config.setTargetBank(t_buffer[3]);
+  t_config.setTargetPreset(t_buffer[4]);
+
+  for (uint8_t i = 0; i < 2; i++) {
+    uint8_t baseIndex = 5 + i * 3;
+    t_config.setMidiMessage(i, t_buffer[baseIndex], t_buffer[baseIndex + 1], t_buffer[baseIndex + 2]);
+  }
+}
+
+void MemoryManager::loadFootSwitchTable() {
+  uint8_t buffer[c_footSwitchTableSize];
+  eeprom.readArray(c_footSwitchTableAddress, buffer, c_footSwitchTableSize);
+
+  uint16_t crc = (buffer[c_footSwitchTableSize - 2] << 8) | buffer[c_footSwitchTableSize - 1];
+  if (crc == Utils::crc16(buffer, c_footSwitchTableSize - 2)) {
+    memcpy(m_footSwitchTable, buffer, c_bankFootSwitchConfigsSize);
+  }
+  else {
+    LOG_ERROR("Corrupted footswitch table, using footswitches without mode");
+
+    FootSwitchConfig config;
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      serializeFootSwitchConfig(config, &m_footSwitchTable[i * c_footSwitchConfigSize]);
+    }
+  }
+
+  m_footSwitchTableLoaded = true;
+}
+
+void MemoryManager::writeFootSwitchTable() {
+  uint8_t buffer[c_footSwitchTableSize];
+  memcpy(buffer, m_footSwitchTable, c_bankFootSwitchConfigsSize);
+
+  uint16_t crc = Utils::crc16(buffer, c_footSwitchTableSize - 2);
+  buffer[c_footSwitchTableSize - 2] = highByte(crc);
+  buffer[c_footSwitchTableSize - 1] = lowByte(crc);
+
+  commitRecord(c_footSwitchTableAddress, buffer, c_footSwitchTableSize);
+}
+
+uint8_t MemoryManager::readFootSwitchOverrides(uint8_t t_bank, uint8_t* t_buffer) {
+  uint8_t entry[c_presetIndexEntrySize];
+  eeprom.readArray(c_overrideIndexAddress + t_bank * c_presetIndexEntrySize, entry, c_presetIndexEntrySize);
+
+  // Preset records can be longer than overrides
+  if (!isPresetIndexEntryValid(entry) || entry[2] > c_footSwitchOverridesSize) {
+    return 0;
+  }
+
+  uint16_t address = (entry[0] << 8) | entry[1];
+  uint8_t length = entry[2];
+  eeprom.readArray(address, t_buffer, length);
+
+  if (isFootSwitchOverridesValid(t_buffer, length)) {
+    return t_buffer[0];
+  }
+
+  if (readShadowCopy(address, length, t_buffer) && isFootSwitchOverridesValid(t_buffer, length)) {
+    LOG_ERROR("Corrupted footswitch overrides at 0x%X, using their shadow copy", address);
+    return t_buffer[0];
+  }
+
+  LOG_ERROR("Corrupted footswitch overrides at 0x%X, using the footswitch table", address);
+  return 0;
+}
+
+bool MemoryManager::isFootSwitchOverridesValid(const uint8_t* t_buffer, uint8_t t_length) const {
+  uint8_t overrides = t_buffer[0];
+  uint8_t count = 0;
+
+  for (uint8_t i = 0; i < 8; i++) {
+    count += bitRead(overrides, i);
+  }
+
+  if (overrides >= (1 << c_footSwitchConfigPerBank) || t_length != 1 + count * c_footSwitchConfigSize + 2) {
+    return false;
+  }
+
+  uint16_t crc = (t_buffer[t_length - 2] << 8) | t_buffer[t_length - 1];
+  return crc == Utils::crc16(t_buffer, t_length - 2);
+}
+
+void MemoryManager::writeChangedBytes(uint16_t t_address, const uint8_t* t_buffer, const uint8_t* t_stored, uint16_t t_length) {
+  uint16_t pageStart = 0;
+  while (pageStart < t_length) {
+    // End of the EEPROM page holding pageStart, relative to the record
+    uint16_t pageEnd = pageStart + EEPROM_PAGE_SIZE - ((t_address + pageStart) % EEPROM_PAGE_SIZE);
+    if (pageEnd > t_length) {
+      pageEnd = t_length;
+    }
+
+    // Span of changed bytes in this page, written with a single WRITE instruction
+    uint16_t first = pageEnd;
+    uint16_t last = pageStart;
+    for (uint16_t i = pageStart; i < pageEnd; i++) {
+      if (t_stored[i] != t_buffer[i]) {
+        if (first == pageEnd) {
+          first = i;
+        }
+        last = i;
+      }
+    }
+
+    uint16_t written = 0;
+    if (first < pageEnd) {
+      written = last - first + 1;
+      eeprom.queueWrite(t_address + first, t_buffer + first, written);
+    }
+
+    m_bytesWritten += written;
+    m_bytesSkipped += (pageEnd - pageStart) - written;
+
+    pageStart = pageEnd;
+  }
+}
+
+void MemoryManager::commitRecord(uint16_t t_address, const uint8_t* t_buffer, uint16_t t_length,
+  uint16_t t_linkAddress, const uint8_t* t_link) {
+  uint8_t stored[c_shadowDataSize];
+  eeprom.readArray(t_address, stored, t_length);
+
+  uint8_t storedLink[c_presetIndexEntrySize];
+  bool hasLink = t_linkAddress != c_shadowNoLink;
+  if (hasLink) {
+    eeprom.readArray(t_linkAddress, storedLink, c_presetIndexEntrySize);
+  }
+
+  if (memcmp(stored, t_buffer, t_length) == 0 &&
+    (!hasLink || memcmp(storedLink, t_link, c_presetIndexEntrySize) == 0)) {
+    m_bytesSkipped += t_length;
+    return;
+  }
+
+  // Copy the record to the shadow area
+  eeprom.queueWrite(c_shadowDataAddress, t_buffer, t_length);
+
+  // Describe the copy while the header is still released, a torn write leaves it released
+  uint16_t dataCrc = Utils::fletcher16(t_buffer, t_length);
+  uint8_t header[c_shadowHeaderSize];
+  header[0] = c_shadowReleased;
+  header[1] = highByte(t_address);
+  header[2] = lowByte(t_address);
+  header[3] = t_length;
+  header[4] = highByte(dataCrc);
+  header[5] = lowByte(dataCrc);
+  header[6] = highByte(t_linkAddress);
+  header[7] = lowByte(t_linkAddress);
+  for (uint8_t i = 0; i < c_presetIndexEntrySize; i++) {
+    header[8 + i] = hasLink ? t_link[i] : 0;
+  }
+  header[11] = Utils::crc8(&header[1], c_shadowHeaderSize - 2);
+  eeprom.queueWrite(c_shadowHeaderAddress, header, c_shadowHeaderSize);
+
+  // Commit the copy with a single byte write, the queue writes it once the header is stored
+  uint8_t state = c_shadowCommitted;
+  eeprom.queueWrite(c_shadowHeaderAddress, &state, 1);
+
+  // Write the record itself, then the index entry pointing at it
+  writeChangedBytes(t_address, t_buffer, stored, t_length);
+
+  if (hasLink) {
+    writeChangedBytes(t_linkAddress, t_link, storedLink, c_presetIndexEntrySize);
+  }
+
+  // Release the copy
+  state = c_shadowReleased;
+  eeprom.queueWrite(c_shadowHeaderAddress, &state, 1);
+}
+
+void MemoryManager::recover() {
+  uint8_t header[c_shadowHeaderSize];
+
+  if (!readShadowHeader(header) || header[0] != c_shadowCommitted) {
+    return;
+  }
+
+  uint8_t buffer[c_shadowDataSize];
+  uint16_t address = (header[1] << 8) | header[2];
+  uint16_t linkAddress = (header[6] << 8) | header[7];
+
+  // The copy is only committed once fully stored, an interrupted record write is written again
+  if (readShadowData(header, buffer)) {
+    eeprom.writeArray(address, buffer, header[3]);
+
+    if (linkAddress != c_shadowNoLink) {
+      eeprom.writeArray(linkAddress, &header[8], c_presetIndexEntrySize);
+    }
+
+    LOG_INFO("Completed the interrupted write at 0x%X", address);
+  }
+
+  eeprom.writeInt8(c_shadowHeaderAddress, c_shadowReleased);
+}
+
+void MemoryManager::openStore() {
+  uint8_t header[c_storeHeaderSize];
+  eeprom.readArray(c_storeHeaderAddress, header, c_storeHeaderSize);
+
+  // A marked restore image is completely staged, the interrupted copy starts over from it
+  uint8_t restore = header[c_storeRestoreOffset];
+  if (header[c_storeRestoreOffset + 1] == uint8_t(~restore)) {
+    LOG_INFO("Resuming the store restore, %u pages", restore + 1);
+    copyStagedRestore(restore + 1);
+    eeprom.readArray(c_storeHeaderAddress, header, c_storeHeaderSize);
+  }
+
+  // A marked copy is complete, the interrupted rebuild starts over from it
+  uint8_t migration = header[c_storeMigrationOffset];
+  if (migration < c_storeSchemaVersion && header[c_storeMigrationOffset + 1] == uint8_t(~migration)) {
+    LOG_INFO("Resuming the migration from schema %d", migration);
+    migrateStore(migration, true);
+    return;
+  }
+
+  bool valid = ((header[0] << 8) | header[1]) == c_storeMagic && Utils::crc8(header, 3) == header[3];
+  uint8_t schema = header[2];
+
+  if (valid && schema == c_storeSchemaVersion) {
+    return;
+  }
+
+  if (valid && schema < c_storeSchemaVersion) {
+    // Schema 1 has the shadow area of the current schema, a write it interrupted is completed
+    // in its own layout before the migration moves the areas
+    if (schema > 0) {
+      recover();
+    }
+
+    LOG_INFO("Migrating the store from schema %d", schema);
+    migrateStore(schema, false);
+    return;
+  }
+
+  if (!valid && isSchema0Store()) {
+    LOG_INFO("Migrating the store from schema 0");
+    migrateStore(0, false);
+    return;
+  }
+
+  if (valid) {
+    LOG_ERROR("Store schema %d is newer than the firmware, formatting the store", schema);
+  }
+  else {
+    LOG_INFO("Formatting the store");
+  }
+
+  eraseStore();
+  saveDeviceState(0, 0);
+  flush();
+  writeStoreHeader();
+}
+
+void MemoryManager::eraseArea(uint16_t t_address, uint16_t t_length) {
+  uint8_t erased[EEPROM_PAGE_SIZE];
+  uint8_t stored[EEPROM_PAGE_SIZE];
+  memset(erased, 0xFF, EEPROM_PAGE_SIZE);
+
+  while (t_length > 0) {
+    uint16_t chunk = EEPROM_PAGE_SIZE - (t_address % EEPROM_PAGE_SIZE);
+    if (chunk > t_length) {
+      chunk = t_length;
+    }
+
+    eeprom.readArray(t_address, stored, chunk);
+    writeChangedBytes(t_address, erased, stored, chunk);
+
+    t_address += chunk;
+    t_length -= chunk;
+  }
+}
+
+void MemoryManager::eraseStore() {
+  // All the areas below the heap are contiguous, the heap is freed along with the index
+  eraseArea(c_deviceStateAddress, c_presetHeapAddress - c_deviceStateAddress);
+
+  m_presetHeapTop = 0;
+  m_compacting = m_compactionPending = false;
+  m_deviceStateSlot = 0xFF;
+  m_deviceStateBank = m_storedDeviceStateBank = 0xFF;
+  m_deviceStatePreset = m_storedDeviceStatePreset = 0xFF;
+
+  setDefaultRoutingTable();
+  m_routingTableLoaded = true;
+  writeRoutingTable();
+
+  // Footswitches without mode
+  FootSwitchConfig config;
+  for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+    serializeFootSwitchConfig(config, &m_footSwitchTable[i * c_footSwitchConfigSize]);
+  }
+  m_footSwitchTableLoaded = true;
+  writeFootSwitchTable();
+}
+
+void MemoryManager::writeStoreHeader() {
+  uint8_t header[4];
+  header[0] = highByte(c_storeMagic);
+  header[1] = lowByte(c_storeMagic);
+  header[2] = c_storeSchemaVersion;
+  header[3] = Utils::crc8(header, 3);
+  eeprom.queueWrite(c_storeHeaderAddress, header, 4);
+
+  // The queue clears the mark once the header is stored
+  uint8_t mark[2] = { 0xFF, 0xFF };
+  eeprom.queueWrite(c_storeHeaderAddress + c_storeMigrationOffset, mark, 2);
+  eeprom.flush();
+}
+
+bool MemoryManager::isSchema0Store() {
+  uint8_t buffer[4];
+
+  for (uint8_t bank = 0; bank < c_schema0BanksCount; bank++) {
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+      uint16_t address = c_schema0PresetsAddress + (bank * c_presetsPerBank + presetIndex) * c_schema0PresetSize;
+      eeprom.readArray(address, buffer, 4);
+
+      if (isSchema0PresetValid(buffer, bank, presetIndex)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool MemoryManager::isSchema0PresetValid(const uint8_t* t_buffer, uint8_t t_bank, uint8_t t_presetIndex) const {
+  return t_buffer[0] == t_bank && t_buffer[1] == t_presetIndex &&
+    t_buffer[2] <= c_maxLoops && t_buffer[3] <= c_maxMidiMessages;
+}
+
+void MemoryManager::migrateStore(uint8_t t_schema, bool t_copied) {
+  // Each step rebuilds the current schema from a copy of the old one
+  switch (t_schema) {
+    case 0:
+      // Presets and footswitches are saved again one at a time, in the current format
+      if (!t_copied) {
+        copyToMigrationScratch(0, c_schema0Size);
+      }
+      migrateFromSchema0();
+      break;
+
+    case 1:
+      if (t_copied || copySchema1FootSwitches()) {
+        migrateFromSchema1();
+      }
+      break;
+  }
+
+  writeStoreHeader();
+  LOG_INFO("Store migrated to schema %d", c_storeSchemaVersion);
+}
+
+void MemoryManager::copyToMigrationScratch(uint8_t t_schema, uint16_t t_length) {
+  uint8_t buffer[EEPROM_PAGE_SIZE];
+
+  for (uint16_t offset = 0; offset < t_length; offset += EEPROM_PAGE_SIZE) {
+    uint16_t chunk = t_length - offset < EEPROM_PAGE_SIZE ? t_length - offset : EEPROM_PAGE_SIZE;
+    eeprom.readArray(offset, buffer, chunk);
+    eeprom.queueWrite(c_migrationScratchAddress + offset, buffer, chunk);
+  }
+
+  markMigrationCopy(t_schema);
+}
+
+void MemoryManager::markMigrationCopy(uint8_t t_schema) {
+  // The queue marks the copy complete once it is stored
+  uint8_t mark[2] = { t_schema, uint8_t(~t_schema) };
+  eeprom.queueWrite(c_storeHeaderAddress + c_storeMigrationOffset, mark, 2);
+  eeprom.flush();
+}
+
+void MemoryManager::migrateFromSchema0() {
+  eraseStore();
+
+  uint8_t buffer[c_schema0PresetSize];
+
+  // Presets: each slot is converted on its own and saved as a record of the current schema
+  for (uint8_t bank = 0; bank < c_schema0BanksCount; bank++) {
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+      uint16_t slot = c_schema0PresetsAddress + (bank * c_presetsPerBank + presetIndex) * c_schema0PresetSize;
+      eeprom.readArray(c_migrationScratchAddress + slot, buffer, c_schema0PresetSize);
+
+      if (!isSchema0PresetValid(buffer, bank, presetIndex)) {
+        LOG_ERROR("Bank %d preset %d can't be migrated, using an empty preset", bank, presetIndex);
+        continue;
+      }
+
+      // The first firmware wrote the messages that don't fit in the slot past its end, they are lost
+      uint8_t loopsCount = buffer[2];
+      uint8_t midiMessagesCount = buffer[3];
+      uint8_t midiOffset = 4 + loopsCount * 4;
+      if (midiMessagesCount > (c_schema0PresetSize - midiOffset) / 4) {
+        midiMessagesCount = (c_schema0PresetSize - midiOffset) / 4;
+      }
+
+      Preset preset(bank, presetIndex, loopsCount, midiMessagesCount);
+      for (uint8_t i = 0; i < loopsCount; i++) {
+        const uint8_t* loop = &buffer[4 + i * 4];
+        preset.setLoopState(i, loop[0]);
+        preset.setLoopOrder(i, loop[1]);
+        preset.setLoopSend(i, loop[2]);
+        preset.setLoopReturn(i, loop[3]);
+      }
+
+      for (uint8_t j = 0; j < midiMessagesCount; j++) {
+        const uint8_t* message = &buffer[midiOffset + j * 4];
+        preset.setMidiMessageStatusByte(j, message[0]);
+        preset.setMidiMessageDataByte1(j, message[1]);
+        preset.setMidiMessageDataByte2(j, message[2]);
+      }
+
+      savePreset(bank, presetIndex, preset);
+    }
+  }
+
+  // FootSwitchConfigs keep their format, the footswitches of bank 0 become the footswitch table
+  // and the other banks override the ones that differ
+  for (uint8_t bank = 0; bank < c_schema0BanksCount; bank++) {
+    eeprom.readArray(c_migrationScratchAddress + c_schema0FootSwitchConfigsAddress + bank * c_bankFootSwitchConfigsSize,
+      buffer, c_bankFootSwitchConfigsSize);
+
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      FootSwitchConfig config;
+      deserializeFootSwitchConfig(&buffer[i * c_footSwitchConfigSize], config);
+
+      if (bank == 0) {
+        saveGlobalFootSwitchConfig(i, config);
+      }
+      else {
+        saveFootSwitchConfig(bank, i, config);
+      }
+    }
+  }
+
+  // Device state
+  eeprom.readArray(c_migrationScratchAddress, buffer, 2);
+  if (buffer[0] < c_schema0BanksCount && buffer[1] < c_presetsPerBank) {
+    saveDeviceState(buffer[0], buffer[1]);
+  }
+  else {
+    saveDeviceState(0, 0);
+  }
+
+  flush();
 }
 
-void MemoryManager::serializePreset(const Preset& t_preset, uint8_t* t_buffer) const {
-  // Basic preset data
-  t_buffer[0] = t_preset.getBank();
-  t_buffer[1] = t_preset.getPreset();
-  t_buffer[2] = t_preset.getLoopsCount();
-  t_buffer[3] = t_preset.getMidiMessagesCount();
+bool MemoryManager::copySchema1FootSwitches() {
+  // The index is the same as schema 1 for the schema 1 banks, their records keep their extents
+  scanPresetHeapTop(c_schema1BanksCount * c_presetsPerBank);
+
+  if (m_presetHeapTop > c_schema1ScratchAddress) {
+    LOG_ERROR("No room to migrate the footswitches, using footswitches without mode");
 
-  // Loops data: start at address 4, each loop occupies 4 bytes
-  for (uint8_t i = 0; i < t_preset.getLoopsCount(); i++) {
-    uint16_t loopOffset = 4 + i * 4;  // Start at byte 4, 4 bytes per loop
-    t_buffer[loopOffset] = t_preset.getLoopState(i);
-    t_buffer[loopOffset + 1] = t_preset.getLoopOrder(i);
-    t_buffer[loopOffset + 2] = t_preset.getLoopSend(i);
-    t_buffer[loopOffset + 3] = t_preset.getLoopReturn(i);
+    uint16_t start = c_presetIndexAddress + c_schema1BanksCount * c_bankIndexSize;
+    eraseArea(start, c_footSwitchTableAddress - start);
+
+    FootSwitchConfig config;
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      serializeFootSwitchConfig(config, &m_footSwitchTable[i * c_footSwitchConfigSize]);
+    }
+    m_footSwitchTableLoaded = true;
+    writeFootSwitchTable();
+
+    m_presetHeapTop = 0;
+    flush();
+    return false;
   }
 
-  // MIDI messages data: start after loops data, each message occupies 4 bytes
-  uint8_t midiOffset = 4 + t_preset.getLoopsCount() * 4;  // Calculate start address for MIDI messages
-  for (uint8_t j = 0; j < t_preset.getMidiMessagesCount(); j++) {
-    uint8_t msgOffset = midiOffset + j * 4;
-    t_buffer[msgOffset] = t_preset.getMidiMessageStatusByte(j);
-    t_buffer[msgOffset + 1] = t_preset.getMidiMessageDataByte1(j);
-    t_buffer[msgOffset + 2] = t_preset.getMidiMessageDataByte2(j);
+  // Scratch: the footswitch table, then the override entry of each bank
+  uint8_t table[c_footSwitchTableSize];
+  eeprom.readArray(c_schema1FootSwitchConfigsAddress, table, c_bankFootSwitchConfigsSize);
+
+  uint16_t crc = Utils::crc16(table, c_bankFootSwitchConfigsSize);
+  table[c_bankFootSwitchConfigsSize] = highByte(crc);
+  table[c_bankFootSwitchConfigsSize + 1] = lowByte(crc);
+  eeprom.queueWrite(c_schema1ScratchAddress, table, c_footSwitchTableSize);
+
+  // The overrides are written above the records, the old layout is left untouched until the copy is marked
+  for (uint8_t bank = 0; bank < c_schema1BanksCount; bank++) {
+    uint8_t configs[c_bankFootSwitchConfigsSize];
+    uint8_t record[c_footSwitchOverridesSize];
+    uint8_t length = 1;
+
+    eeprom.readArray(c_schema1FootSwitchConfigsAddress + bank * c_bankFootSwitchConfigsSize, configs, c_bankFootSwitchConfigsSize);
+
+    record[0] = 0;
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      const uint8_t* config = &configs[i * c_footSwitchConfigSize];
+
+      if (memcmp(config, &table[i * c_footSwitchConfigSize], c_footSwitchConfigSize) != 0) {
+        bitSet(record[0], i);
+        memcpy(&record[length], config, c_footSwitchConfigSize);
+        length += c_footSwitchConfigSize;
+      }
+    }
+
+    uint8_t entry[c_presetIndexEntrySize] = { 0xFF, 0xFF, 0xFF };
+
+    if (record[0] != 0 && c_schema1ScratchAddress - m_presetHeapTop < length + 2) {
+      LOG_ERROR("No room to migrate the footswitches of bank %d, using the footswitch table", bank);
+    }
+    else if (record[0] != 0) {
+      crc = Utils::crc16(record, length);
+      record[length++] = highByte(crc);
+      record[length++] = lowByte(crc);
+      eeprom.queueWrite(m_presetHeapTop, record, length);
+
+      entry[0] = highByte(m_presetHeapTop);
+      entry[1] = lowByte(m_presetHeapTop);
+      entry[2] = length;
+      m_presetHeapTop += length;
+    }
+
+    eeprom.queueWrite(c_schema1ScratchAddress + c_footSwitchTableSize + bank * c_presetIndexEntrySize,
+      entry, c_presetIndexEntrySize);
   }
+
+  m_presetHeapTop = 0;
+  markMigrationCopy(1);
+  return true;
 }
 
-void MemoryManager::deserializePreset(const uint8_t* t_buffer, Preset& t_preset) const {
-  // Basic preset data
-  t_preset.setBank(t_buffer[0]);
-  t_preset.setPreset(t_buffer[1]);
+void MemoryManager::migrateFromSchema1() {
+  // A shadow copy of the old layout must never be written again at the new offsets
+  uint8_t state = c_shadowReleased;
+  eeprom.queueWrite(c_shadowHeaderAddress, &state, 1);
 
-  uint8_t loopsCount = t_buffer[2];
-  t_preset.setLoopsCount(loopsCount);
+  // The preset entries of the new banks take the place of the schema 1 footswitches, they have no presets
+  uint16_t start = c_presetIndexAddress + c_schema1BanksCount * c_bankIndexSize;
+  eraseArea(start, c_overrideIndexAddress - start);
 
-  uint8_t midiMessageCount = t_buffer[3];
-  t_preset.setMidiMessagesCount(midiMessageCount);
+  start = c_overrideIndexAddress + c_schema1BanksCount * c_presetIndexEntrySize;
+  eraseArea(start, c_footSwitchTableAddress - start);
 
-  // Loops data: start at address 4, each loop occupies 4 bytes
-  for (uint8_t i = 0; i < loopsCount; i++) {
-    uint8_t loopOffset = 4 + i * 4;
-    t_preset.setLoopState(i, t_buffer[loopOffset]);
-    t_preset.setLoopOrder(i, t_buffer[loopOffset + 1]);
-    t_preset.setLoopSend(i, t_buffer[loopOffset + 2]);
-    t_preset.setLoopReturn(i, t_buffer[loopOffset + 3]);
+  // Override entries of the schema 1 banks and footswitch table, from the copy
+  uint8_t buffer[EEPROM_PAGE_SIZE];
+  uint16_t entriesSize = c_schema1BanksCount * c_presetIndexEntrySize;
+  for (uint16_t offset = 0; offset < entriesSize; offset += EEPROM_PAGE_SIZE) {
+    uint16_t chunk = entriesSize - offset < EEPROM_PAGE_SIZE ? entriesSize - offset : EEPROM_PAGE_SIZE;
+    eeprom.readArray(c_schema1ScratchAddress + c_footSwitchTableSize + offset, buffer, chunk);
+    eeprom.queueWrite(c_overrideIndexAddress + offset, buffer, chunk);
   }
 
-  // MIDI messages data: start after loops data, each message occupies 4 bytes
-  uint8_t midiOffset = 4 + loopsCount * 4;  // Calculate start address for MIDI messages
-  for (uint8_t j = 0; j < midiMessageCount; j++) {
-    uint8_t msgOffset = midiOffset + j * 4;
-    t_preset.setMidiMessageStatusByte(j, t_buffer[msgOffset]);
-    t_preset.setMidiMessageDataByte1(j, t_buffer[msgOffset + 1]);
-    t_preset.setMidiMessageDataByte2(j, t_buffer[msgOffset + 2]);
+  eeprom.readArray(c_schema1ScratchAddress, buffer, c_footSwitchTableSize);
+  eeprom.queueWrite(c_footSwitchTableAddress, buffer, c_footSwitchTableSize);
+
+  m_presetHeapTop = 0;
+  m_footSwitchTableLoaded = false;
+  flush();
+}
+
+bool MemoryManager::isDeviceStateDirty() const {
+  return m_deviceStateBank != m_storedDeviceStateBank || m_deviceStatePreset != m_storedDeviceStatePreset;
+}
+
+void MemoryManager::storeDeviceState() {
+  if (m_deviceStateSlot == 0xFF) {
+    uint8_t bank;
+    uint8_t preset;
+    scanDeviceStateJournal(bank, preset);
   }
+
+  m_deviceStateSlot = (m_deviceStateSlot + 1) % c_deviceStateSlotsCount;
+  m_deviceStateSequence++;
+
+  uint8_t slot[c_deviceStateSlotSize];
+  slot[0] = m_deviceStateSequence;
+  slot[1] = m_deviceStateBank;
+  slot[2] = m_deviceStatePreset;
+  slot[3] = Utils::crc8(slot, 3);
+
+  eeprom.queueWrite(c_deviceStateAddress + m_deviceStateSlot * c_deviceStateSlotSize, slot, c_deviceStateSlotSize);
+
+  m_storedDeviceStateBank = m_deviceStateBank;
+  m_storedDeviceStatePreset = m_deviceStatePreset;
 }
 
-void MemoryManager::serializeFootSwitchConfig(const FootSwitchConfig& t_config, uint8_t* t_buffer) const {
-  t_buffer[0] = uint8_t(t_config.getMode());
-  t_buffer[1] = t_config.getLatching();
-  t_buffer[2] = t_config.getLoopIndex();
-  t_buffer[3] = t_config.getTargetBank();
-  t_buffer[4] = t_config.getTargetPreset();
+bool MemoryManager::isDeviceStateSlotValid(const uint8_t* t_slot) const {
+  return Utils::crc8(t_slot, 3) == t_slot[3];
+}
 
-  for (uint8_t i = 0 ; i < 2; i++) {
-    uint8_t baseIndex = 5 + i * 3;
-    t_buffer[baseIndex] = t_config.getMidiMessageType(i);
-    t_buffer[baseIndex + 1] = t_config.getMidiMessageDataByte1(i);
-    t_buffer[baseIndex + 2] = t_config.getMidiMessageDataByte2(i);
+void MemoryManager::scanDeviceStateJournal(uint8_t& t_bank, uint8_t& t_preset) {
+  uint8_t journal[c_deviceStateJournalSize];
+  eeprom.readArray(c_deviceStateAddress, journal, c_deviceStateJournalSize);
+
+  // Find a valid slot
+  uint8_t newest = 0;
+  while (newest < c_deviceStateSlotsCount && !isDeviceStateSlotValid(&journal[newest * c_deviceStateSlotSize])) {
+    newest++;
   }
+
+  if (newest == c_deviceStateSlotsCount) {
+    // Empty journal, the first two bytes hold the state written by the former single record layout
+    t_bank = journal[0];
+    t_preset = journal[1];
+
+    // Next write goes to slot 0 with sequence 0
+    m_deviceStateSlot = c_deviceStateSlotsCount - 1;
+    m_deviceStateSequence = 0xFF;
+    return;
+  }
+
+  // Follow the consecutive sequence numbers up to the newest slot
+  for (uint8_t i = 1; i < c_deviceStateSlotsCount; i++) {
+    uint8_t next = (newest + 1) % c_deviceStateSlotsCount;
+    const uint8_t* slot = &journal[next * c_deviceStateSlotSize];
+
+    if (!isDeviceStateSlotValid(slot) || slot[0] != uint8_t(journal[newest * c_deviceStateSlotSize] + 1)) {
+      break;
+    }
+
+    newest = next;
+  }
+
+  const uint8_t* slot = &journal[newest * c_deviceStateSlotSize];
+  m_deviceStateSlot = newest;
+  m_deviceStateSequence = slot[0];
+  t_bank = slot[1];
+  t_preset = slot[2];
 }
 
-void MemoryManager::deserializeFootSwitchConfig(const uint8_t* t_buffer, FootSwitchConfig& t_config) const {
-  t_config.setMode(static_cast<FootSwitchMode>(t_buffer[0]));
-  t_config.setLatching(t_buffer[1]);
-  t_config.setLoopIndex(t_buffer[2]);
-  t_config.setTargetBank(t_buffer[3]);
-  t_config.setTargetPreset(t_buffer[4]);
+void MemoryManager::poll() {
+  if (!m_storeLocked && isDeviceStateDirty() && (millis() - m_deviceStateChangeTime) >= c_deviceStateSaveDelay) {
+    storeDeviceState();
+  }
 
-  for (uint8_t i = 0; i < 2; i++) {
-    uint8_t baseIndex = 5 + i * 3;
-    t_config.setMidiMessage(i, t_buffer[baseIndex], t_buffer[baseIndex + 1], t_buffer[baseIndex + 2]);
+  if (!m_storeLocked && (m_compacting || m_compactionPending) && eeprom.isIdle()) {
+    if (!m_compacting) {
+      beginCompaction();
+    }
+    stepCompaction();
+  }
+
+  eeprom.poll();
+}
+
+void MemoryManager::flush() {
+  if (!m_storeLocked && isDeviceStateDirty()) {
+    storeDeviceState();
+  }
+
+  eeprom.flush();
+}
+
+void MemoryManager::validateStore() {
+  scanPresetHeapTop();
+
+  if (m_quarantinedRecords > 0) {
+    LOG_ERROR("%u quarantined records in the store", m_quarantinedRecords);
+  }
+}
+
+void MemoryManager::scrub() {
+  if (m_storeLocked || !eeprom.isIdle() || (millis() - m_lastScrubTime) < c_scrubInterval) {
+    return;
   }
+
+  m_lastScrubTime = millis();
+  scrubNextEntry();
+}
+
+bool MemoryManager::isIdle() {
+  return eeprom.isIdle();
 }
 
 void MemoryManager::saveDeviceState(uint8_t t_bank, uint8_t t_preset) {
-  eeprom.writeInt8(c_deviceStateAddress, t_bank);
-  eeprom.writeInt8(c_deviceStateAddress + 1, t_preset);
+  m_deviceStateBank = t_bank;
+  m_deviceStatePreset = t_preset;
+  m_deviceStateChangeTime = millis();
 }
 
 void MemoryManager::loadDeviceState(uint8_t& t_bank, uint8_t& t_preset) {
-  t_bank = eeprom.readInt8(c_deviceStateAddress);
-  t_preset = eeprom.readInt8(c_deviceStateAddress + 1);
+  scanDeviceStateJournal(t_bank, t_preset);
+
+  m_deviceStateBank = m_storedDeviceStateBank = t_bank;
+  m_deviceStatePreset = m_storedDeviceStatePreset = t_preset;
 }
 
-void MemoryManager::savePreset(uint8_t t_bank, uint8_t t_presetIndex, const Preset& t_preset) {
-  uint16_t address = calculatePresetAddress(t_bank, t_presetIndex);
-  uint8_t buffer[c_presetSize];
+bool MemoryManager::savePreset(uint8_t t_bank, uint8_t t_presetIndex, const Preset& t_preset) {
+  if (m_storeLocked) {
+    LOG_ERROR("Store transfer in progress, bank %d preset %d not saved", t_bank, t_presetIndex);
+    return false;
+  }
 
+  updateRoutingTable(t_preset);
+
+  uint8_t buffer[c_presetSize];
   serializePreset(t_preset, buffer);
 
-  for (uint16_t i = 0; i < c_presetSize; i++) {
-      eeprom.writeInt8(address + i, buffer[i]);
+  return savePresetRecord(t_bank, t_presetIndex, buffer);
+}
+
+bool MemoryManager::savePresetRecord(uint8_t t_bank, uint8_t t_presetIndex, const uint8_t* t_record) {
+  if (m_storeLocked) {
+    LOG_ERROR("Store transfer in progress, bank %d preset %d not saved", t_bank, t_presetIndex);
+    return false;
+  }
+
+  uint8_t length = getPresetRecordLength(t_record);
+  if (length == 0) {
+    LOG_ERROR("Invalid record, bank %d preset %d not saved", t_bank, t_presetIndex);
+    return false;
+  }
+
+  if (!storeIndexedRecord(calculatePresetIndexAddress(t_bank, t_presetIndex), t_record, length)) {
+    LOG_ERROR("Preset storage full, bank %d preset %d not saved", t_bank, t_presetIndex);
+    return false;
+  }
+
+  return true;
+}
+
+bool MemoryManager::storeIndexedRecord(uint16_t t_indexAddress, const uint8_t* t_record, uint8_t t_length) {
+  uint8_t entry[c_presetIndexEntrySize];
+  eeprom.readArray(t_indexAddress, entry, c_presetIndexEntrySize);
+
+  // Same length, only the changed bytes are written in place
+  if (isPresetIndexEntryValid(entry) && entry[2] == t_length) {
+    commitRecord((entry[0] << 8) | entry[1], t_record, t_length);
+    return true;
+  }
+
+  uint16_t address;
+  if (!allocatePresetExtent(t_length, address)) {
+    return false;
   }
+
+  entry[0] = highByte(address);
+  entry[1] = lowByte(address);
+  entry[2] = t_length;
+  commitRecord(address, t_record, t_length, t_indexAddress, entry);
+
+  return true;
+}
+
+void MemoryManager::loadPresetRecord(uint8_t t_bank, uint8_t t_presetIndex, uint8_t* t_record) {
+  uint8_t entry[c_presetIndexEntrySize];
+
+  eeprom.readArray(calculatePresetIndexAddress(t_bank, t_presetIndex), entry, c_presetIndexEntrySize);
+  readPresetRecord(entry, t_record);
 }
 
 void MemoryManager::loadPreset(uint8_t t_bank, uint8_t t_presetIndex, Preset& t_preset) {
-uint16_t address = calculatePresetAddress(t_bank, t_presetIndex);
   uint8_t buffer[c_presetSize];
 
-  for (uint16_t i = 0; i < c_presetSize; i++) {
-      buffer[i] = eeprom.readInt8(address + i);
+  loadPresetRecord(t_bank, t_presetIndex, buffer);
+  deserializePreset(buffer, t_bank, t_presetIndex, t_preset);
+}
+
+bool MemoryManager::saveFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitchIndex, const FootSwitchConfig& t_config) {
+  if (m_storeLocked) {
+    LOG_ERROR("Store transfer in progress, bank %d footswitch %d not saved", t_bank, t_footSwitchIndex);
+    return false;
   }
 
-  deserializePreset(buffer, t_preset);
-}
+  if (!m_footSwitchTableLoaded) {
+    loadFootSwitchTable();
+  }
+
+  uint8_t config[c_footSwitchConfigSize];
+  serializeFootSwitchConfig(t_config, config);
+
+  uint8_t stored[c_footSwitchOverridesSize];
+  uint8_t storedOverrides = readFootSwitchOverrides(t_bank, stored);
 
-void MemoryManager::saveFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitchIndex, const FootSwitchConfig& t_config) {
-  uint16_t address = calculateFootSwitchConfigAddress(t_bank, t_footSwitchIndex);
-  uint8_t buffer[c_footSwitchConfigSize];
+  // Rebuild the overrides with the new config, a config equal to the table isn't stored
+  uint8_t record[c_footSwitchOverridesSize];
+  uint8_t length = 1;
+  uint8_t storedOffset = 1;
+  record[0] = 0;
 
-  serializeFootSwitchConfig(t_config, buffer);
+  for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+    const uint8_t* bankConfig = &m_footSwitchTable[i * c_footSwitchConfigSize];
 
-  for (uint8_t i = 0; i < c_footSwitchConfigSize; i++) {
-    eeprom.writeInt8(address + i, buffer[i]);
+    if (bitRead(storedOverrides, i)) {
+      bankConfig = &stored[storedOffset];
+      storedOffset += c_footSwitchConfigSize;
+    }
+
+    if (i == t_footSwitchIndex) {
+      bankConfig = config;
+    }
+
+    if (memcmp(bankConfig, &m_footSwitchTable[i * c_footSwitchConfigSize], c_footSwitchConfigSize) != 0) {
+      bitSet(record[0], i);
+      memcpy(&record[length], bankConfig, c_footSwitchConfigSize);
+      length += c_footSwitchConfigSize;
+    }
+  }
+
+  uint16_t indexAddress = c_overrideIndexAddress + t_bank * c_presetIndexEntrySize;
+
+  if (record[0] == 0) {
+    // No overrides left, the entry is erased and the extent is reclaimed by compaction
+    if (storedOverrides != 0) {
+      uint8_t entry[c_presetIndexEntrySize];
+      uint8_t erased[c_presetIndexEntrySize] = { 0xFF, 0xFF, 0xFF };
+      eeprom.readArray(indexAddress, entry, c_presetIndexEntrySize);
+      writeChangedBytes(indexAddress, erased, entry, c_presetIndexEntrySize);
+    }
+    return true;
+  }
+
+  uint16_t crc = Utils::crc16(record, length);
+  record[length++] = highByte(crc);
+  record[length++] = lowByte(crc);
+
+  if (!storeIndexedRecord(indexAddress, record, length)) {
+    LOG_ERROR("Preset storage full, bank %d footswitch %d not saved", t_bank, t_footSwitchIndex);
+    return false;
+  }
+
+  return true;
+}
+
+void MemoryManager::saveGlobalFootSwitchConfig(uint8_t t_footSwitchIndex, const FootSwitchConfig& t_config) {
+  if (m_storeLocked) {
+    LOG_ERROR("Store transfer in progress, footswitch %d not saved", t_footSwitchIndex);
+    return;
   }
+
+  if (!m_footSwitchTableLoaded) {
+    loadFootSwitchTable();
+  }
+
+  serializeFootSwitchConfig(t_config, &m_footSwitchTable[t_footSwitchIndex * c_footSwitchConfigSize]);
+  writeFootSwitchTable();
 }
 
 void MemoryManager::loadFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitchIndex, FootSwitchConfig& t_config) {
-  uint16_t address = calculateFootSwitchConfigAddress(t_bank, t_footSwitchIndex);
-  uint8_t buffer[c_footSwitchConfigSize];
+  FootSwitchConfig configs[c_footSwitchConfigPerBank];
+
+  loadFootSwitchConfigs(t_bank, configs);
+  t_config = configs[t_footSwitchIndex];
+}
+
+void MemoryManager::loadPresetBank(uint8_t t_bank, Preset* t_presets, FootSwitchConfig* t_configs) {
+  // The index entries of the bank are contiguous, then each record is read at its extent
+  uint8_t entries[c_bankIndexSize];
+  uint8_t presetBuffer[c_presetSize];
+
+  eeprom.readArray(calculatePresetIndexAddress(t_bank, 0), entries, c_bankIndexSize);
+  for (uint8_t i = 0; i < c_presetsPerBank; i++) {
+    readPresetRecord(&entries[i * c_presetIndexEntrySize], presetBuffer);
+    deserializePreset(presetBuffer, t_bank, i, t_presets[i]);
+  }
+
+  loadFootSwitchConfigs(t_bank, t_configs);
+}
+
+void MemoryManager::loadFootSwitchConfigs(uint8_t t_bank, FootSwitchConfig* t_configs) {
+  if (!m_footSwitchTableLoaded) {
+    loadFootSwitchTable();
+  }
+
+  uint8_t overridesBuffer[c_footSwitchOverridesSize];
+  uint8_t overrides = readFootSwitchOverrides(t_bank, overridesBuffer);
+  uint8_t offset = 1;
+
+  for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+    if (bitRead(overrides, i)) {
+      deserializeFootSwitchConfig(&overridesBuffer[offset], t_configs[i]);
+      offset += c_footSwitchConfigSize;
+    }
+    else {
+      deserializeFootSwitchConfig(&m_footSwitchTable[i * c_footSwitchConfigSize], t_configs[i]);
+    }
+  }
+}
+
+void MemoryManager::compactPresetStore() {
+  if (!m_compacting) {
+    beginCompaction();
+  }
+
+  while (m_compacting) {
+    stepCompaction();
+  }
+}
+
+bool MemoryManager::isCompacting() const {
+  return m_compacting || m_compactionPending;
+}
+
+uint16_t MemoryManager::getPresetHeapFree() {
+  if (m_presetHeapTop == 0) {
+    scanPresetHeapTop();
+  }
+
+  return c_presetHeapEnd - m_presetHeapTop;
+}
+
+uint16_t MemoryManager::getStoreImagePagesCount() {
+  if (m_presetHeapTop == 0) {
+    scanPresetHeapTop();
+  }
+
+  uint16_t usedPages = (m_presetHeapTop + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE;
+  return usedPages + (usedPages <= c_storeHeaderAddress / EEPROM_PAGE_SIZE ? 1 : 0);
+}
+
+uint16_t MemoryManager::getStoreImagePage(uint16_t t_index) {
+  if (m_presetHeapTop == 0) {
+    scanPresetHeapTop();
+  }
+
+  uint16_t usedPages = (m_presetHeapTop + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE;
+  return t_index < usedPages ? t_index : c_storeHeaderAddress / EEPROM_PAGE_SIZE;
+}
+
+void MemoryManager::readStorePage(uint16_t t_page, uint8_t* t_buffer) {
+  eeprom.readArray(t_page * EEPROM_PAGE_SIZE, t_buffer, EEPROM_PAGE_SIZE);
+}
+
+bool MemoryManager::writeStorePage(uint16_t t_page, const uint8_t* t_buffer) {
+  if (m_restorePagesCount > 0) {
+    // Image pages are staged in order, the header page last
+    if (t_page == c_storeHeaderPage) {
+      t_page = m_restorePagesCount - 1;
+    }
+    else if (t_page >= m_restorePagesCount - 1) {
+      return false;
+    }
+
+    t_page += c_storeHeaderPage - m_restorePagesCount;
+  }
+
+  writeChangedPage(t_page, t_buffer);
+  return true;
+}
+
+void MemoryManager::writeChangedPage(uint16_t t_page, const uint8_t* t_buffer) {
+  uint8_t stored[EEPROM_PAGE_SIZE];
+  eeprom.readArray(t_page * EEPROM_PAGE_SIZE, stored, EEPROM_PAGE_SIZE);
+
+  writeChangedBytes(t_page * EEPROM_PAGE_SIZE, t_buffer, stored, EEPROM_PAGE_SIZE);
+}
+
+void MemoryManager::copyStagedRestore(uint16_t t_pagesCount) {
+  uint16_t stagingPage = c_storeHeaderPage - t_pagesCount;
+  uint8_t data[EEPROM_PAGE_SIZE];
+
+  // The queue sets the mark once the staged pages are stored
+  uint8_t mark[2] = { uint8_t(t_pagesCount - 1), uint8_t(~(t_pagesCount - 1)) };
+  eeprom.queueWrite(c_storeHeaderAddress + c_storeRestoreOffset, mark, 2);
+
+  for (uint16_t i = 0; i + 1 < t_pagesCount; i++) {
+    readStorePage(stagingPage + i, data);
+    writeChangedPage(i, data);
+  }
+
+  // The header page is written up to the mark, which is cleared by a write of its own once the
+  // new header is stored
+  constexpr uint8_t markOffset = (c_storeHeaderAddress + c_storeRestoreOffset) % EEPROM_PAGE_SIZE;
+  uint8_t stored[EEPROM_PAGE_SIZE];
+  readStorePage(stagingPage + t_pagesCount - 1, data);
+  readStorePage(c_storeHeaderPage, stored);
+  writeChangedBytes(c_storeHeaderPage * EEPROM_PAGE_SIZE, data, stored, markOffset);
+
+  mark[0] = mark[1] = 0xFF;
+  eeprom.queueWrite(c_storeHeaderAddress + c_storeRestoreOffset, mark, 2);
+  eeprom.flush();
+}
+
+void MemoryManager::beginStoreDump() {
+  flush();
+  m_storeLocked = true;
+}
+
+void MemoryManager::endStoreDump() {
+  m_storeLocked = false;
+}
+
+bool MemoryManager::beginStoreRestore(uint16_t t_pagesCount) {
+  flush();
+  m_storeLocked = true;
+
+  if (m_presetHeapTop == 0) {
+    scanPresetHeapTop();
+  }
+
+  // Staging pages below the header page, clear of the current image and of the pages it is copied to
+  uint16_t usedPages = (m_presetHeapTop + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE;
+  if (t_pagesCount > 0 && t_pagesCount <= c_storeHeaderPage &&
+    c_storeHeaderPage - t_pagesCount >= usedPages && c_storeHeaderPage - t_pagesCount >= t_pagesCount - 1) {
+      m_restorePagesCount = t_pagesCount;
+      return true;
+  }
+
+  LOG_INFO("Restoring %u pages in place, no room to stage them", t_pagesCount);
+  m_restorePagesCount = 0;
+
+  uint8_t magic[2] = { 0xFF, 0xFF };
+  eeprom.queueWrite(c_storeHeaderAddress, magic, 2);
+  return false;
+}
+
+void MemoryManager::endStoreRestore() {
+  if (m_restorePagesCount > 0) {
+    copyStagedRestore(m_restorePagesCount);
+    m_restorePagesCount = 0;
+  }
+
+  eeprom.flush();
+  m_storeLocked = false;
+
+  // Nothing cached from the previous image is valid anymore
+  m_presetHeapTop = 0;
+  m_compacting = m_compactionPending = false;
+  m_scrubEntry = 0;
+  m_routingTableLoaded = false;
+  m_footSwitchTableLoaded = false;
+  m_deviceStateSlot = 0xFF;
+  m_deviceStateBank = m_storedDeviceStateBank = 0xFF;
+  m_deviceStatePreset = m_storedDeviceStatePreset = 0xFF;
 
-  for (uint8_t i = 0; i < c_footSwitchConfigSize; i++) {
-    buffer[i] = eeprom.readInt8(address + i);
+  openStore();
+  recover();
+}
+
+bool MemoryManager::abortStoreRestore() {
+  if (m_restorePagesCount == 0) {
+    endStoreRestore();
+    return false;
   }
 
-  deserializeFootSwitchConfig(buffer, t_config);
+  // The staged pages are free heap space of the current store
+  eeprom.flush();
+  m_restorePagesCount = 0;
+  m_storeLocked = false;
+  return true;
+}
+
+const EepromStats& MemoryManager::getEepromStats() const {
+  return eeprom.getStats();
+}
+
+void MemoryManager::resetEepromStats() {
+  eeprom.resetStats();
+}
+
+uint16_t MemoryManager::getRepairedRecords() const {
+  return m_repairedRecords;
+}
+
+uint16_t MemoryManager::getQuarantinedRecords() const {
+  return m_quarantinedRecords;
+}
+
+uint32_t MemoryManager::getBytesWritten() const {
+  return m_bytesWritten;
+}
+
+uint32_t MemoryManager::getBytesSkipped() const {
+  return m_bytesSkipped;
+}
+
+void MemoryManager::resetWriteStats() {
+  m_bytesWritten = 0;
+  m_bytesSkipped = 0;
 }
 
 /// Test functions
 
 void MemoryManager::initializeTestData() {
-  // Loop through 4 banks
-  for (uint8_t bank = 0; bank < 4; bank++) {
-    // Loop through 4 presets per bank
-    for (uint8_t presetIndex = 0; presetIndex < 4; presetIndex++) {
+  // Loop through all the banks
+  for (uint8_t bank = 0; bank < c_banksCount; bank++) {
+    // Loop through all the presets of the bank
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
       Preset testPreset(bank, presetIndex, 8, 1);  // Initialize Preset with 8 loops and 1 MIDI message
 
       // Set each loop's test data
@@ -171,59 +1603,60 @@ void MemoryManager::initializeTestData() {
       // Save initialized preset to EEPROM
       savePreset(bank, presetIndex, testPreset);
     }
+  }
 
-    // Configure 6 footswitches per bank
-    for (uint8_t footSwitchIndex = 0; footSwitchIndex < 6; footSwitchIndex++) {
-      FootSwitchConfig footSwitchConfig(FootSwitchMode::kNone);
+  // Configure the footswitches of every bank
+  for (uint8_t footSwitchIndex = 0; footSwitchIndex < c_footSwitchConfigPerBank; footSwitchIndex++) {
+    FootSwitchConfig footSwitchConfig(FootSwitchMode::kNone);
 
-      switch (footSwitchIndex) {
-        case 0: // Bank select 0
-          footSwitchConfig.setMode(FootSwitchMode::kBankSelect);
-          footSwitchConfig.setTargetBank(0);
-          break;
-
-        case 1: // Bank select 1
-          footSwitchConfig.setMode(FootSwitchMode::kBankSelect);
-          footSwitchConfig.setTargetBank(1);
-          break;
-
-        case 2: // Preset select 0
-          footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
-          footSwitchConfig.setTargetPreset(0);
-          break;
-
-        case 3: // Preset select 1
-          footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
-          footSwitchConfig.setTargetPreset(1);
-          break;
-
-        case 4: // Preset select 2
-          footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
-          footSwitchConfig.setTargetPreset(2);
-          break;
-
-        case 5: // Preset select 3
-          footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
-          footSwitchConfig.setTargetPreset(3);
-          break;
-      }
+    switch (footSwitchIndex) {
+      case 0: // Bank select 0
+        footSwitchConfig.setMode(FootSwitchMode::kBankSelect);
+        footSwitchConfig.setTargetBank(0);
+        break;
+
+      case 1: // Bank select 1
+        footSwitchConfig.setMode(FootSwitchMode::kBankSelect);
+        footSwitchConfig.setTargetBank(1);
+        break;
 
-      // Save footswitch configuration to EEPROM
-      saveFootSwitchConfig(bank, footSwitchIndex, footSwitchConfig);
+      case 2: // Preset select 0
+        footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
+        footSwitchConfig.setTargetPreset(0);
+        break;
+
+      case 3: // Preset select 1
+        footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
+        footSwitchConfig.setTargetPreset(1);
+        break;
+
+      case 4: // Preset select 2
+        footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
+        footSwitchConfig.setTargetPreset(2);
+        break;
+
+      case 5: // Preset select 3
+        footSwitchConfig.setMode(FootSwitchMode::kPresetSelect);
+        footSwitchConfig.setTargetPreset(3);
+        break;
     }
+
+    // Save footswitch configuration to the footswitch table
+    saveGlobalFootSwitchConfig(footSwitchIndex, footSwitchConfig);
   }
 
   saveDeviceState(1, 0); // Set initial device state
+  flush();
 }
 
 
 void MemoryManager::readTestData() {
-  // Loop through 4 banks
-  for (uint8_t bank = 0; bank < 4; bank++) {
+  // Loop through all the banks
+  for (uint8_t bank = 0; bank < c_banksCount; bank++) {
     LOG_DEBUG("Reading Bank %d:", bank);
 
-    // Loop through 4 presets per bank
-    for (uint8_t presetIndex = 0; presetIndex < 4; presetIndex++) {
+    // Loop through all the presets of the bank
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
       Preset testPreset;  // Empty preset to load data into
 
       // Load the preset from EEPROM
@@ -252,7 +1685,7 @@ void MemoryManager::readTestData() {
     }
 
     // Log footswitch configurations for each bank
-    for (uint8_t footSwitchIndex = 0; footSwitchIndex < 6; footSwitchIndex++) {
+    for (uint8_t footSwitchIndex = 0; footSwitchIndex < c_footSwitchConfigPerBank; footSwitchIndex++) {
       FootSwitchConfig footSwitchConfig(FootSwitchMode::kNone);
 
       // Load footswitch configuration from EEPROM
@@ -281,3 +1714,79 @@ void MemoryManager::readTestData() {
 
   LOG_DEBUG("Last bank: %d, Last preset: %d", lastBank, lastPreset);
 }
+
+void MemoryManager::logBenchmark(const char* t_operation, uint32_t t_startTime) const {
+  uint32_t time = micros() - t_startTime;
+  const EepromStats& stats = eeprom.getStats();
+
+  LOG_INFO("%s: %lu us, %lu transactions, %lu bytes, %u write cycles, %lu us waiting", t_operation,
+    time, stats.transactions, stats.bytes, stats.writeCycles, stats.wipWaitTime);
+}
+
+void MemoryManager::benchmarkStore() {
+  uint8_t records[c_presetsPerBank][c_presetSize];
+  FootSwitchConfig configs[c_footSwitchConfigPerBank];
+  Preset original;
+  uint32_t start;
+
+  // Every operation starts with an idle EEPROM, saves include their write cycles
+  flush();
+  eeprom.resetStats();
+  start = micros();
+  loadPreset(0, 0, original);
+  logBenchmark("Load preset", start);
+
+  eeprom.resetStats();
+  start = micros();
+  loadFootSwitchConfigs(1, configs);
+  for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+    loadPresetRecord(1, presetIndex, records[presetIndex]);
+  }
+  logBenchmark("Load bank", start);
+
+  // Largest loops section with a few MIDI messages
+  Preset preset(0, 0, c_maxRoutedLoops, 4);
+  for (uint8_t loopIndex = 0; loopIndex < c_maxRoutedLoops; loopIndex++) {
+    preset.setLoopState(loopIndex, loopIndex % 2);
+    preset.setLoopOrder(loopIndex, loopIndex);
+    preset.setLoopSend(loopIndex, original.getLoopSend(loopIndex));
+    preset.setLoopReturn(loopIndex, original.getLoopReturn(loopIndex));
+  }
+  for (uint8_t messageIndex = 0; messageIndex < 4; messageIndex++) {
+    preset.setMidiMessageStatusByte(messageIndex, 0xB0);
+    preset.setMidiMessageDataByte1(messageIndex, messageIndex);
+    preset.setMidiMessageDataByte2(messageIndex, 64);
+  }
+
+  eeprom.resetStats();
+  start = micros();
+  savePreset(0, 0, preset);
+  flush();
+  logBenchmark("Save preset", start);
+
+  eeprom.resetStats();
+  start = micros();
+  savePreset(0, 0, preset);
+  flush();
+  logBenchmark("Save unchanged preset", start);
+
+  preset.toggleLoopState(0);
+  eeprom.resetStats();
+  start = micros();
+  savePreset(0, 0, preset);
+  flush();
+  logBenchmark("Save edited preset", start);
+
+  // A record of a new length moves to a new extent
+  preset.setMidiMessagesCount(5);
+  preset.setMidiMessageStatusByte(4, 0xC0);
+  preset.setMidiMessageDataByte1(4, 1);
+  eeprom.resetStats();
+  start = micros();
+  savePreset(0, 0, preset);
+  flush();
+  logBenchmark("Save resized preset", start);
+
+  savePreset(0, 0, original);
+  flush();
+}
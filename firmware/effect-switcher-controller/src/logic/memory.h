@@ -4,39 +4,125 @@
 #include "peripherals/eeprom.h"
 #include "logic/preset.h"
 #include "logic/footswitch.h"
+#include "utils/utils.h"
 
-constexpr uint16_t c_deviceStateAddress = 0x0;
-constexpr uint16_t c_banksStartAddress = 0x20;
-constexpr uint16_t c_footSwitchConfigStartAddress = 0x900;
+/*
+ * Memory Map for the Device State Journal in EEPROM
+ * Total Size: 32 bytes, 8 slots of 4 bytes
+ * Each device state write goes to the slot following the newest one, so the writes are spread
+ * over the whole ring. The newest slot is the last one of the run of consecutive sequence numbers.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0                sequence           Incremented on each write, wraps at 255 42
+ * 1                bank               Last bank                               1
+ * 2                preset             Last preset                             0
+ * 3                crc                CRC-8 of bytes 0-2                      0xFA
+ */
+constexpr uint8_t c_deviceStateSlotSize = 4;
+constexpr uint8_t c_deviceStateSlotsCount = 8;
+constexpr uint8_t c_deviceStateJournalSize = c_deviceStateSlotSize * c_deviceStateSlotsCount;
+
+constexpr uint16_t c_deviceStateSaveDelay = 2000;  // Time without changes (ms) before the device state is written
 
 /*
  * Memory Map for Preset Storage in EEPROM
- * Total Size per Preset: 128 bytes
- * This is the absolute max values, if there are only 8 loops for example the MIDI message storage
- * will start right after the loops storage
+ * Maximum Size per Preset: 75 bytes
+ * Records are variable-length, the loop orders and MIDI messages only take the room needed by the
+ * counts and the CRC follows the last MIDI message. Each record is stored in the preset heap where
+ * it takes its exact length, the preset index gives its location. The bank and preset numbers are
+ * not stored. The loops send and return are stored once for all the presets in the routing table.
  *
  * Byte Range       Field Name         Description                             Example Value
  * -----------------------------------------------------------------------------------------
- * 0                bank               Stores the preset bank number           1
- * 1                preset             Stores the preset number within bank    5
- * 2                loopsCount         Number of audio loops in this preset    16
- * 3                midiMessagesCount  Number of MIDI messages in this preset  20
+ * 0                version            Record format version                   1
+ * 1                loopsCount         Number of audio loops in this preset    15
+ * 2                midiMessagesCount  Number of MIDI messages in this preset  20
+ * 3-4              loopStates         One bit per loop, loop 0 is bit 0       0x00A5
  *
- * 4-67             loops              Audio loop configuration                (4 bytes per loop)
- *                   |                   - loopState                           (1 byte each)
- *                   |                   - loopOrder                           (1 byte each)
- *                   |                   - loopSend                            (1 byte each)
- *                   |                   - loopReturn                          (1 byte each)
- *                  Range: 4 * maxLoops = 4 * 16 = 64 bytes max
+ * 5-12             loopOrders         Loop orders, 4 bits each                (1 byte per 2 loops)
+ *                   |                   - loop 2n order                       (high nibble)
+ *                   |                   - loop 2n+1 order                     (low nibble)
+ *                  Range: maxLoops / 2 = 16 / 2 = 8 bytes max
  *
- * 68-127           midiMessages       MIDI message configuration              (4 bytes per message)
- *                   |                   - statusByte                          (1 byte each)
+ * 13-72            midiMessages       MIDI messages with running status       (2 or 3 bytes per message)
+ *                   |                   - statusByte                          (omitted if same as previous message)
  *                   |                   - dataByte1                           (1 byte each)
- *                   |                   - dataByte2                           (1 byte each)
- *                  Range: 4 * maxMIDI = 3 * 20 = 60 bytes max
+ *                   |                   - dataByte2                           (omitted for Program Change and Channel Pressure)
+ *                  Range: 3 * maxMIDI = 3 * 20 = 60 bytes max
+ *
+ * 73-74            crc                CRC-16 of the record up to the CRC      0x29B1
  */
-constexpr uint16_t c_presetSize = 128;
+constexpr uint8_t c_presetRecordVersion = 1;
+constexpr uint8_t c_presetOrdersOffset = 5;
+constexpr uint16_t c_presetSize = c_presetOrdersOffset + c_maxLoops / 2 + 3 * c_maxMidiMessages + 2;
 constexpr uint8_t c_presetsPerBank = 4;
+constexpr uint8_t c_presetAverageSize = 32;  // Heap room provisioned per preset, 15 loops and 4 MIDI messages take 27 bytes
+
+/*
+ * Memory Map for the Preset Index in EEPROM
+ * Total Size per Entry: 3 bytes, one entry per preset ordered by bank then preset, followed by
+ * one entry per bank for its footswitch overrides
+ * An entry gives the extent of a record in the preset heap, so a preset is found with a single
+ * lookup whatever the number of presets. An entry out of the heap, such as an erased one, is a
+ * preset that was never saved or a bank without overrides. A record that changes length is written
+ * to a new extent at the top of the heap and its entry is switched in the same shadow commit, the
+ * old extent is freed and reclaimed by compaction.
+ * An entry with a length of 0 is quarantined: its record failed its check and had no shadow copy.
+ * It reads as never saved, the address is kept to locate the bad record in a store dump, and the
+ * next save of the preset moves it to a new extent.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0-1              address            Address of the record                   0x30BD
+ * 2                length             Length of the record                    14
+ */
+constexpr uint8_t c_presetIndexEntrySize = 3;
+constexpr uint8_t c_quarantinedLength = 0;  // Length of a quarantined entry
+constexpr uint8_t c_scrubInterval = 10;     // Time (ms) between two index entries checked by the scrubber
+constexpr uint8_t c_compactionBatchSize = 8;   // Lowest records collected by each index scan of the compaction
+constexpr uint8_t c_compactionScanSlice = 64;  // Index entries read per compaction slice
+constexpr uint16_t c_compactionReserve = 8 * c_presetSize;  // Heap room left when the compaction starts
+
+/*
+ * Memory Map for the Routing Table in EEPROM
+ * Total Size: 34 bytes
+ * Switch matrix send and return of each loop, shared by all the presets. The jacks take the last
+ * matrix channel, so the last entry of each side is unwired (0xFF) and a record holds 15 loops.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0-15             loopSends          Send of each loop                       2
+ * 16-31            loopReturns        Return of each loop                     3
+ * 32-33            crc                CRC-16 of bytes 0-31                    0x29B1
+ */
+constexpr uint8_t c_routingTableSize = 2 * c_maxLoops + 2;
+
+/*
+ * Memory Map for the Shadow Record in EEPROM
+ * A record is first copied to the shadow data area and committed in the shadow header before
+ * its own record is overwritten. If the power drops during that write, the committed copy is
+ * written again on the next boot. The header is written released and committed by a single byte
+ * write, so a torn header write can't commit anything. The header is released once the record is
+ * stored, the copy stays available as a fallback until the next save.
+ * The header can also carry a link, a preset index entry written along with the record, so a
+ * record moved to a new extent and the entry pointing at it are updated together.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0                state              0xA5 when committed, released otherwise 0xA5
+ * 1-2              address            Address of the record                   0x30BD
+ * 3                length             Length of the record                    14
+ * 4-5              dataCrc            Fletcher-16 of the shadow data          0x29B1
+ * 6-7              linkAddress        Address of the link, 0xFFFF if none     0x0099
+ * 8-10             link               Preset index entry                      0x30BD0E
+ * 11               crc                CRC-8 of bytes 1-10                     0x6C
+ */
+constexpr uint8_t c_shadowHeaderSize = 12;
+constexpr uint16_t c_shadowNoLink = 0xFFFF;
+constexpr uint8_t c_shadowDataSize = c_presetSize;  // Largest record committed through the shadow area
+constexpr uint8_t c_shadowCommitted = 0xA5;
+constexpr uint8_t c_shadowReleased = 0x00;
 
 /*
  * Memory Map for FootSwitchConfig in EEPROM
@@ -64,32 +150,358 @@ constexpr uint8_t c_presetsPerBank = 4;
  */
 constexpr uint8_t c_footSwitchConfigSize = 11;
 constexpr uint8_t c_footSwitchConfigPerBank = 6;
+constexpr uint8_t c_bankFootSwitchConfigsSize = c_footSwitchConfigPerBank * c_footSwitchConfigSize;
+
+/*
+ * Memory Map for the FootSwitch Table in EEPROM
+ * Total Size: 68 bytes
+ * FootSwitchConfig of each footswitch, shared by all the banks. Most rigs use the same footswitch
+ * layout in every bank, so a bank only stores the footswitches it overrides. The table is held
+ * in RAM once read, a bank without overrides is loaded without reading its footswitches.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0-65             footSwitchConfigs  FootSwitchConfig of each footswitch     (11 bytes each)
+ * 66-67            crc                CRC-16 of bytes 0-65                    0x29B1
+ */
+constexpr uint8_t c_footSwitchTableSize = c_bankFootSwitchConfigsSize + 2;
+
+/*
+ * Memory Map for FootSwitch Overrides in EEPROM
+ * Maximum Size per Bank: 69 bytes
+ * The footswitches of a bank that differ from the footswitch table. The record is stored in the
+ * preset heap and located by the override entry of the bank in the preset index, a bank
+ * without overrides has no record.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0                overrides          One bit per footswitch overridden       0x05
+ * 1-66             footSwitchConfigs  FootSwitchConfig of each footswitch     (11 bytes each)
+ *                                     overridden, in footswitch order
+ * 67-68            crc                CRC-16 of the record up to the CRC      0x29B1
+ */
+constexpr uint8_t c_footSwitchOverridesSize = 1 + c_bankFootSwitchConfigsSize + 2;
+
+/*
+ * Memory Map for the Store Header in EEPROM
+ * Total Size: 8 bytes at the end of the EEPROM, the only area that keeps its address across schemas
+ * The header gives the schema of the whole store. At boot, a store of an older schema is migrated
+ * and an EEPROM without a header is formatted, unless it holds the schema 0 layout which is migrated.
+ * A migration step first copies the old areas to the migration scratch area at the end of the
+ * preset heap, then marks the copy complete. The new layout is rebuilt from the copy one record at
+ * a time. A power loss before the mark leaves the old layout untouched, after the mark the
+ * rebuild is started over from the copy on the next boot. The header is written once the rebuild
+ * is complete and the mark is cleared last.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0-1              magic              Identifies an initialized store         0x4553
+ * 2                schema             Schema version of the store             2
+ * 3                crc                CRC-8 of bytes 0-2                      0x50
+ * 4                migration          Schema copied to the scratch area       0
+ * 5                migrationCheck     Complement of the migration byte        0xFF
+ * 6                restore            Pages - 1 of a staged restore image     20
+ * 7                restoreCheck       Complement of the restore byte          0xEB
+ */
+constexpr uint8_t c_storeHeaderSize = 8;
+constexpr uint16_t c_storeMagic = 0x4553;  // "ES"
+constexpr uint8_t c_storeSchemaVersion = 2;
+constexpr uint8_t c_storeMigrationOffset = 4;
+constexpr uint8_t c_storeRestoreOffset = 6;
+
+/*
+ * Memory Map of the Schema 0 Store
+ * Layout of the first firmware, without a store header. Each preset is a fixed 128-byte slot and
+ * the FootSwitchConfigs have the same 11-byte format as the current schema.
+ *
+ * Address          Area               Size
+ * -----------------------------------------------------------------------------------------
+ * 0x0000           deviceState        2 bytes, bank then preset
+ * 0x0020           presets            128 bytes per preset, 4 banks
+ * 0x0900           footSwitchConfigs  66 bytes per bank, 4 banks
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0                bank               Bank of the preset                      1
+ * 1                preset             Preset index in the bank                2
+ * 2                loopsCount         Number of audio loops in this preset    16
+ * 3                midiMessagesCount  Number of MIDI messages in this preset  20
+ * 4-...            loops              state, order, send, return              (4 bytes per loop)
+ * ...-127          midiMessages       statusByte, dataByte1, dataByte2, pad   (4 bytes per message)
+ */
+constexpr uint16_t c_schema0PresetsAddress = 0x20;
+constexpr uint8_t c_schema0PresetSize = 128;
+constexpr uint8_t c_schema0BanksCount = 4;
+constexpr uint16_t c_schema0FootSwitchConfigsAddress = 0x900;
+constexpr uint16_t c_schema0Size = c_schema0FootSwitchConfigsAddress +
+  c_schema0BanksCount * c_footSwitchConfigPerBank * c_footSwitchConfigSize;
+
+/*
+ * Memory Map of the Schema 1 Store
+ * Same areas as the current schema up to the preset index, each bank then stored its six
+ * FootSwitchConfigs in full. The preset index and the records are kept as they are by the
+ * migration, the records stay above the areas that grew.
+ *
+ * Address          Area               Size
+ * -----------------------------------------------------------------------------------------
+ * 0x0099           presetIndex        12 bytes per bank, 158 banks
+ * 0x0801           footSwitchConfigs  66 bytes per bank
+ * 0x30BD           presetHeap         20283 bytes up to 0x7FF7
+ */
+constexpr uint8_t c_schema1BanksCount = 158;
+constexpr uint16_t c_schema1FootSwitchConfigsAddress = 0x801;
+constexpr uint16_t c_schema1PresetHeapAddress = 0x30BD;
+
+/*
+ * Memory Map of the EEPROM
+ * Each area starts where the previous one ends and the preset heap takes the rest of the EEPROM
+ * up to the store header.
+ * The number of banks is the largest one for which the heap provisions `c_presetAverageSize`
+ * bytes per preset. Any bank is loaded with the same reads: its override entry, its overrides
+ * if it has any and one index entry and record read per preset.
+ *
+ * Address          Area               Size
+ * -----------------------------------------------------------------------------------------
+ * 0x0000           deviceState        32 bytes
+ * 0x0020           shadowHeader       12 bytes
+ * 0x002C           shadowData         75 bytes
+ * 0x0077           routingTable       34 bytes
+ * 0x0099           presetIndex        12 bytes per bank, 227 banks
+ * 0x0B3D           overrideIndex      3 bytes per bank
+ * 0x0DE6           footSwitchTable    68 bytes
+ * 0x0E2A           presetHeap         29134 bytes up to 0x7FF7
+ * 0x7FF8           storeHeader        8 bytes
+ */
+constexpr uint16_t c_storeHeaderAddress = EEPROM_SIZE - c_storeHeaderSize;
+constexpr uint16_t c_storeHeaderPage = c_storeHeaderAddress / EEPROM_PAGE_SIZE;
+constexpr uint16_t c_deviceStateAddress = 0x0;
+constexpr uint16_t c_shadowHeaderAddress = c_deviceStateAddress + c_deviceStateJournalSize;
+constexpr uint16_t c_shadowDataAddress = c_shadowHeaderAddress + c_shadowHeaderSize;
+constexpr uint16_t c_routingTableAddress = c_shadowDataAddress + c_shadowDataSize;
+constexpr uint16_t c_presetIndexAddress = c_routingTableAddress + c_routingTableSize;
+
+constexpr uint16_t c_bankIndexSize = c_presetsPerBank * c_presetIndexEntrySize;
+constexpr uint16_t c_banksCount = (c_storeHeaderAddress - c_presetIndexAddress - c_footSwitchTableSize) /
+  (c_bankIndexSize + c_presetIndexEntrySize + c_presetsPerBank * c_presetAverageSize);
+constexpr uint16_t c_presetsCount = c_banksCount * c_presetsPerBank;
+constexpr uint16_t c_indexEntriesCount = c_presetsCount + c_banksCount;  // Preset entries, then override entries
+
+constexpr uint16_t c_overrideIndexAddress = c_presetIndexAddress + c_presetsCount * c_presetIndexEntrySize;
+constexpr uint16_t c_footSwitchTableAddress = c_overrideIndexAddress + c_banksCount * c_presetIndexEntrySize;
+constexpr uint16_t c_presetHeapAddress = c_footSwitchTableAddress + c_footSwitchTableSize;
+constexpr uint16_t c_presetHeapEnd = c_storeHeaderAddress;
+
+// The migration copies sit at the end of the heap, above the records rebuilt from them.
+// Schema 1 only needs the footswitch table and override entries built from it.
+constexpr uint16_t c_migrationScratchAddress = c_presetHeapEnd - c_schema0Size;
+constexpr uint16_t c_schema1ScratchSize = c_footSwitchTableSize + c_schema1BanksCount * c_presetIndexEntrySize;
+constexpr uint16_t c_schema1ScratchAddress = c_presetHeapEnd - c_schema1ScratchSize;
+
+static_assert(c_routingTableSize <= c_shadowDataSize, "The routing table doesn't fit in the shadow area");
+static_assert(c_shadowDataSize <= 0xFF, "The shadow header stores the record length on a single byte");
+static_assert(c_banksCount > 0, "The EEPROM can't hold a single bank");
+static_assert(c_banksCount < 0xFF, "Banks are numbered on a single byte, 0xFF is reserved");
+static_assert(c_presetHeapEnd - c_presetHeapAddress >= uint32_t(c_presetsCount) * c_presetAverageSize,
+  "The preset heap is smaller than provisioned");
+static_assert(c_migrationScratchAddress >= c_presetHeapAddress + c_schema0BanksCount * c_presetsPerBank * c_presetSize,
+  "The presets migrated from schema 0 overlap their copy");
+static_assert(c_schema0BanksCount <= c_banksCount, "The banks of schema 0 don't fit in the current schema");
+static_assert(c_schema1BanksCount <= c_banksCount, "The banks of schema 1 don't fit in the current schema");
+static_assert(c_presetHeapAddress <= c_schema1PresetHeapAddress, "The records of schema 1 are out of the preset heap");
+static_assert(c_footSwitchConfigPerBank <= 8, "Footswitch overrides are flagged on a single byte");
+static_assert(c_footSwitchTableSize <= c_shadowDataSize, "The footswitch table doesn't fit in the shadow area");
+static_assert(c_footSwitchOverridesSize <= c_presetSize, "Footswitch overrides don't fit in an index entry extent");
+
+/// @brief A record the compaction moves down the preset heap, as found by its index scan
+struct CompactionMove {
+  uint16_t entryNumber;  // Index entry pointing at the record
+  uint16_t address;      // Address of the record when it was scanned
+  uint8_t length;        // Length of the record
+};
 
 class MemoryManager {
   private:
     Eeprom eeprom;
 
-    /// @brief Calculate the memory address of a preset
+    uint32_t m_bytesWritten = 0;  // Bytes sent to the EEPROM by record saves
+    uint32_t m_bytesSkipped = 0;  // Bytes of record saves already up to date in the EEPROM
+
+    // Device state, 0xFF until loaded or recorded
+    uint8_t m_deviceStateBank = 0xFF;          // Last recorded bank
+    uint8_t m_deviceStatePreset = 0xFF;        // Last recorded preset
+    uint8_t m_storedDeviceStateBank = 0xFF;    // Bank stored in EEPROM
+    uint8_t m_storedDeviceStatePreset = 0xFF;  // Preset stored in EEPROM
+    uint32_t m_deviceStateChangeTime = 0;   // Time of the last device state change
+    uint8_t m_deviceStateSlot = 0xFF;       // Newest journal slot, 0xFF until the journal is scanned
+    uint8_t m_deviceStateSequence = 0;      // Sequence number of the newest journal slot
+
+    uint16_t m_presetHeapTop = 0;  // End of the highest record in the preset heap, 0 until the index is scanned
+
+    // Compaction, advanced by `poll` one slice at a time: a slice of an index scan collecting the
+    // lowest records above the compacted ones, or a single record move
+    bool m_compactionPending = false;   // An allocation left less than `c_compactionReserve` bytes or failed
+    bool m_compacting = false;          // A compaction is in progress
+    bool m_presetHeapGrown = false;     // An extent was allocated since the index scan started
+    uint16_t m_compactionTop = 0;       // End of the records already compacted
+    uint16_t m_compactionScanEntry = 0; // Next index entry to scan, `c_indexEntriesCount` once the scan is done
+    uint16_t m_compactionMoved = 0;     // Records moved by the compaction
+    CompactionMove m_compactionBatch[c_compactionBatchSize];  // Lowest records of the scan, by address
+    uint8_t m_compactionBatchCount = 0; // Records in the batch
+    uint8_t m_compactionBatchNext = 0;  // Next record of the batch to move
+
+    // Scrubber, checks one index entry and its record per slice while the EEPROM is idle
+    uint16_t m_scrubEntry = 0;          // Next index entry to check
+    uint32_t m_lastScrubTime = 0;       // Time of the last slice
+    uint16_t m_repairedRecords = 0;     // Records rewritten from their shadow copy
+    uint16_t m_quarantinedRecords = 0;  // Quarantined index entries, counted by the index scan
+
+    bool m_storeLocked = false;  // A store image is being dumped or restored, saves are refused
+    uint16_t m_restorePagesCount = 0;  // Pages of the image staged below the header page, 0 for a restore in place
+
+    // Routing table, read from EEPROM before the first preset is loaded or saved
+    uint8_t m_loopSends[c_maxLoops];
+    uint8_t m_loopReturns[c_maxLoops];
+    bool m_routingTableLoaded = false;
+
+    // FootSwitch table, serialized FootSwitchConfigs read from EEPROM before the first bank is loaded
+    uint8_t m_footSwitchTable[c_bankFootSwitchConfigsSize];
+    bool m_footSwitchTableLoaded = false;
+
+    /// @brief Calculate the memory address of a preset index entry
     /// @param t_bank Preset bank
     /// @param t_presetIndex Preset index in the bank
-    /// @return uint16_t Address of the preset
-    uint16_t calculatePresetAddress(uint8_t t_bank, uint8_t t_presetIndex) const;
+    /// @return uint16_t Address of the index entry
+    uint16_t calculatePresetIndexAddress(uint8_t t_bank, uint8_t t_presetIndex) const;
 
-    /// @brief Calculate the memory address of a footswitch config
-    /// @param t_bank Preset bank
-    /// @param t_footSwitchIndex Footswitch index
-    /// @return uint16_t Address of the footswitch config
-    uint16_t calculateFootSwitchConfigAddress(uint8_t t_bank, uint8_t t_footSwitchIndex) const;
+    /// @brief Check that an index entry points to an extent of the preset heap
+    /// @param t_entry Index entry
+    /// @return true if the preset has a record
+    bool isPresetIndexEntryValid(const uint8_t* t_entry) const;
 
-    /// @brief Serialize a Preset object into a byte array
-    /// @param t_preset Preset to serialize
-    /// @param t_buffer Data buffer
-    void serializePreset(const Preset& t_preset, uint8_t* t_buffer) const;
+    /// @brief Check if an index entry is neither valid, erased nor quarantined
+    /// @param t_entry Index entry
+    /// @return true if the entry was corrupted
+    bool isPresetIndexEntryCorrupted(const uint8_t* t_entry) const;
+
+    /// @brief Read the record an index entry points to, a corrupted record is replaced by
+    /// its shadow copy or by an empty preset, so is a preset that was never saved
+    /// @param t_entry Index entry
+    /// @param t_buffer Data buffer of `c_presetSize` bytes
+    void readPresetRecord(const uint8_t* t_entry, uint8_t* t_buffer);
+
+    /// @brief Find the top of the preset heap by scanning the index with a single READ instruction.
+    /// The quarantined entries are counted and the scrubber is moved to the first corrupted entry.
+    /// @param t_entriesCount Number of index entries in use
+    void scanPresetHeapTop(uint16_t t_entriesCount = c_indexEntriesCount);
+
+    /// @brief Reserve an extent at the top of the preset heap. A compaction is requested once the
+    /// heap runs low, it runs from `poll` so a save never waits for it.
+    /// @param t_length Length of the record
+    /// @param t_address Address of the extent
+    /// @return true if the heap has room for the record
+    bool allocatePresetExtent(uint8_t t_length, uint16_t& t_address);
+
+    /// @brief Start a compaction from the bottom of the preset heap
+    void beginCompaction();
 
-    /// @brief Deserialize a byte array into a buffer object
+    /// @brief Run a slice of the compaction: scan the next index entries, or move the next record
+    /// of the batch, or finish the compaction once no record is left above the compacted ones
+    void stepCompaction();
+
+    /// @brief Read the next index entries and keep the lowest records above the compacted ones in the batch
+    void scanCompactionBatch();
+
+    /// @brief Move a record of the batch down to the compacted ones, with its index entry in the same
+    /// shadow commit. A record its entry no longer points at was moved or freed since the scan, it is skipped.
+    /// @param t_move Record found by the scan
+    void moveCompactionRecord(const CompactionMove& t_move);
+
+    /// @brief Store a record through its index entry: a record of the same length is updated in
+    /// place, otherwise it is moved to a new extent along with its entry
+    /// @param t_indexAddress Address of the index entry
+    /// @param t_record Serialized record
+    /// @param t_length Length of the record
+    /// @return true if the record was stored, false if the preset heap is full
+    bool storeIndexedRecord(uint16_t t_indexAddress, const uint8_t* t_record, uint8_t t_length);
+
+    /// @brief Read the shadow copy of a record if the last shadow commit was for its extent
+    /// @param t_address Address of the record
+    /// @param t_length Length of the record
+    /// @param t_buffer Buffer to read the copy into
+    /// @return true if an intact copy of the record was read
+    bool readShadowCopy(uint16_t t_address, uint8_t t_length, uint8_t* t_buffer);
+
+    /// @brief Check a record read through an index entry, a preset or footswitch overrides
+    /// depending on the entry
+    /// @param t_entryNumber Number of the entry in the index
+    /// @param t_buffer Data buffer of `c_presetSize` bytes, zeroed past the record
+    /// @param t_length Length of the record
+    /// @return true if the record is intact
+    bool isIndexedRecordValid(uint16_t t_entryNumber, const uint8_t* t_buffer, uint8_t t_length) const;
+
+    /// @brief Check the next index entry and its record: a corrupted record is rewritten from its
+    /// shadow copy, or else its entry is quarantined, as is an entry that is neither erased nor valid
+    void scrubNextEntry();
+
+    /// @brief Queue the write marking an index entry quarantined
+    /// @param t_indexAddress Address of the index entry
+    void quarantineIndexEntry(uint16_t t_indexAddress);
+
+    /// @brief Read the footswitch table, a corrupted table is replaced by footswitches without mode
+    void loadFootSwitchTable();
+
+    /// @brief Queue an atomic write of the footswitch table held in RAM
+    void writeFootSwitchTable();
+
+    /// @brief Read the footswitch overrides of a bank, corrupted overrides are replaced by their
+    /// shadow copy or dropped
+    /// @param t_bank Target bank
+    /// @param t_buffer Data buffer of `c_footSwitchOverridesSize` bytes
+    /// @return uint8_t One bit per footswitch overridden, 0 if the bank has no overrides
+    uint8_t readFootSwitchOverrides(uint8_t t_bank, uint8_t* t_buffer);
+
+    /// @brief Check the flags, the length and the CRC of footswitch overrides
     /// @param t_buffer Data buffer
-    /// @param t_preset Preset to deserialize the data into
-    void deserializePreset(const uint8_t* t_buffer, Preset& t_preset) const;
+    /// @param t_length Length of the record
+    /// @return true if the overrides can be read
+    bool isFootSwitchOverridesValid(const uint8_t* t_buffer, uint8_t t_length) const;
+
+    /// @brief Walk a serialized preset and check its version, counts and CRC
+    /// @param t_buffer Data buffer of `c_presetSize` bytes
+    /// @return uint8_t Length of the record, 0 if it can't be deserialized
+    uint8_t getPresetRecordLength(const uint8_t* t_buffer) const;
+
+    /// @brief Check the version, the counts and the CRC of a serialized preset
+    /// @param t_buffer Data buffer of `c_presetSize` bytes
+    /// @return true if the record can be deserialized
+    bool isPresetRecordValid(const uint8_t* t_buffer) const;
+
+    /// @brief Read the routing table and check it, a corrupted table is replaced by the default routing
+    void loadRoutingTable();
+
+    /// @brief Set the default routing in RAM, loop N uses send N and return N
+    void setDefaultRoutingTable();
+
+    /// @brief Queue an atomic write of the routing table held in RAM
+    void writeRoutingTable();
+
+    /// @brief Replace a corrupted preset record by its shadow copy if there is one,
+    /// or by an empty preset otherwise
+    /// @param t_address Address of the record
+    /// @param t_length Length of the record
+    /// @param t_buffer Data buffer holding the corrupted record
+    void restorePresetRecord(uint16_t t_address, uint8_t t_length, uint8_t* t_buffer);
+
+    /// @brief Read the shadow header and check its CRC
+    /// @param t_header Buffer of `c_shadowHeaderSize` bytes
+    /// @return true if the header describes a shadow copy
+    bool readShadowHeader(uint8_t* t_header);
+
+    /// @brief Read the shadow copy described by a header and check its CRC
+    /// @param t_header Shadow header
+    /// @param t_buffer Buffer to read the copy into
+    /// @return true if the copy is intact
+    bool readShadowData(const uint8_t* t_header, uint8_t* t_buffer);
 
     /// @brief Serialize a FootSwitchConfig object into a byte array
     /// @param t_config FootSwitchConfig to serialize
@@ -101,6 +513,106 @@ class MemoryManager {
     /// @param t_config FootSwitchConfig object to deserialize data into
     void deserializeFootSwitchConfig(const uint8_t* t_buffer, FootSwitchConfig& t_config) const;
 
+    /// @brief Queue the write of a record, only the bytes that differ from the EEPROM content
+    /// are written, with one WRITE instruction per page that holds changed bytes
+    /// @param t_address Address of the record
+    /// @param t_buffer Serialized record
+    /// @param t_stored Record currently stored in EEPROM
+    /// @param t_length Length of the record
+    void writeChangedBytes(uint16_t t_address, const uint8_t* t_buffer, const uint8_t* t_stored, uint16_t t_length);
+
+    /// @brief Queue the write of a whole EEPROM page, only its changed bytes are written
+    /// @param t_page EEPROM page number
+    /// @param t_buffer Data buffer of `EEPROM_PAGE_SIZE` bytes
+    void writeChangedPage(uint16_t t_page, const uint8_t* t_buffer);
+
+    /// @brief Copy a staged restore image to its pages, the header page last. The restore mark
+    /// of the store header is set first, a power loss resumes the copy at boot.
+    /// @param t_pagesCount Pages of the image
+    void copyStagedRestore(uint16_t t_pagesCount);
+
+    /// @brief Queue an atomic write of a record: the record is copied and committed to the
+    /// shadow area, then its changed bytes and the link are written and the shadow header is released
+    /// @param t_address Address of the record
+    /// @param t_buffer Serialized record
+    /// @param t_length Length of the record, at most `c_shadowDataSize`
+    /// @param t_linkAddress Address of the preset index entry to write with the record, `c_shadowNoLink` if none
+    /// @param t_link Preset index entry
+    void commitRecord(uint16_t t_address, const uint8_t* t_buffer, uint16_t t_length,
+      uint16_t t_linkAddress = c_shadowNoLink, const uint8_t* t_link = nullptr);
+
+    /// @brief Log the time and EEPROM bus activity of a benchmarked operation
+    /// @param t_operation Name of the operation
+    /// @param t_startTime Time (us) the operation started, the bus counters were reset then
+    void logBenchmark(const char* t_operation, uint32_t t_startTime) const;
+
+    /// @brief Queue the erase of an area, only the pages holding programmed bytes are written
+    /// @param t_address Address of the area
+    /// @param t_length Length of the area
+    void eraseArea(uint16_t t_address, uint16_t t_length);
+
+    /// @brief Erase the index, the routing table, the shadow area and the device state journal,
+    /// reset the footswitch table and forget everything cached from them
+    void eraseStore();
+
+    /// @brief Write the header of the current schema, then clear the migration mark
+    void writeStoreHeader();
+
+    /// @brief Check if an EEPROM without a header holds the schema 0 layout
+    /// @return true if one of its preset slots holds the preset expected at its position
+    bool isSchema0Store();
+
+    /// @brief Check that a schema 0 preset slot holds the preset expected at its position
+    /// @param t_buffer Preset slot of `c_schema0PresetSize` bytes
+    /// @param t_bank Bank of the slot
+    /// @param t_presetIndex Preset index of the slot
+    /// @return true if the slot can be migrated
+    bool isSchema0PresetValid(const uint8_t* t_buffer, uint8_t t_bank, uint8_t t_presetIndex) const;
+
+    /// @brief Upgrade the store through each migration step up to the current schema
+    /// @param t_schema Schema of the store
+    /// @param t_copied true if the copy of the first step is already marked complete
+    void migrateStore(uint8_t t_schema, bool t_copied);
+
+    /// @brief Copy the start of the EEPROM to the migration scratch area and mark the copy complete
+    /// @param t_schema Schema being copied
+    /// @param t_length Length of the areas to copy
+    void copyToMigrationScratch(uint8_t t_schema, uint16_t t_length);
+
+    /// @brief Rebuild the store from the schema 0 copy, one preset slot at a time
+    void migrateFromSchema0();
+
+    /// @brief Mark the copy of a migration step complete, once the queued copy is stored
+    /// @param t_schema Schema being copied
+    void markMigrationCopy(uint8_t t_schema);
+
+    /// @brief Build the footswitch table and the overrides of each schema 1 bank: the footswitches
+    /// of bank 0 become the table and the overrides are written above the records. The table and
+    /// the override entries are copied to the migration scratch area and the copy is marked complete.
+    /// @return true if the copy is marked complete, false if the records left no room for it and
+    /// the footswitches were reset instead
+    bool copySchema1FootSwitches();
+
+    /// @brief Rebuild the areas below the preset heap from the schema 1 copy, the preset index and
+    /// records are kept as they are and the shadow header is released
+    void migrateFromSchema1();
+
+    /// @brief Check if the recorded device state differs from the one stored in EEPROM
+    /// @return true if the device state needs to be written
+    bool isDeviceStateDirty() const;
+
+    /// @brief Queue the write of the recorded device state to the next journal slot
+    void storeDeviceState();
+
+    /// @brief Check the CRC of a device state journal slot
+    /// @param t_slot Pointer to the slot data
+    /// @return true if the slot holds a valid device state
+    bool isDeviceStateSlotValid(const uint8_t* t_slot) const;
+
+    /// @brief Read the device state journal with a single READ instruction and find the newest slot
+    /// @param t_bank Bank stored in the newest slot
+    /// @param t_preset Preset stored in the newest slot
+    void scanDeviceStateJournal(uint8_t& t_bank, uint8_t& t_preset);
 
   public:
     /// @brief Constructor for an SPI EEPROM
@@ -110,7 +622,39 @@ class MemoryManager {
         eeprom.setup();
       };
 
-    /// @brief Saves the device's current state (last bank and preset) to EEPROM
+    /// @brief Check the store header and bring the store to the current schema: a store of an
+    /// older schema or an interrupted migration is migrated, an EEPROM without a header is
+    /// formatted. A schema 1 store is recovered in its own layout before it is migrated.
+    /// Must be called at boot before `recover`.
+    void openStore();
+
+    /// @brief Complete a record write interrupted by a power loss, must be called
+    /// at boot before loading any preset
+    void recover();
+
+    /// @brief Advance the queued EEPROM writes without blocking, write the device state once it
+    /// stopped changing for `c_deviceStateSaveDelay` and run a slice of the compaction while the
+    /// EEPROM is idle, called from the main loop
+    void poll();
+
+    /// @brief Check the index at boot with a single READ instruction, so the corrupted entries are
+    /// the first ones checked by `scrub`. Must be called after `recover`.
+    void validateStore();
+
+    /// @brief Check the next record of the store if `c_scrubInterval` elapsed since the last one
+    /// and the EEPROM is idle, so a slice never waits for a write and reads at most one record.
+    /// Called from the main loop when nothing else reads the EEPROM.
+    void scrub();
+
+    /// @brief Write the pending device state and wait until all the queued EEPROM writes are stored
+    void flush();
+
+    /// @brief Check if all the queued EEPROM writes are stored
+    /// @return true if nothing is left to write
+    bool isIdle();
+
+    /// @brief Record the device's current state (last bank and preset), it is written to
+    /// EEPROM by `poll` once it stopped changing, so rapid changes result in a single write
     /// @param t_bank Current bank
     /// @param t_preset Current preset
     void saveDeviceState(uint8_t t_bank, uint8_t t_preset);
@@ -120,32 +664,191 @@ class MemoryManager {
     /// @param t_preset Saved preset
     void loadDeviceState(uint8_t& t_bank, uint8_t& t_preset);
 
-    /// @brief Saves a specific preset to EEPROM
+    /// @brief Saves a specific preset to EEPROM, the write is queued and completes in `poll`.
+    /// The record is committed to the shadow area first so a power loss can't leave it half-written.
+    /// A record of the same length is updated in place, otherwise it is moved to a new extent.
     /// @param t_bank Current bank
     /// @param t_presetIndex Preset index in the bank
     /// @param t_preset Reference to the preset to save
-    void savePreset(uint8_t t_bank, uint8_t t_presetIndex, const Preset& t_preset);
+    /// @return true if the preset was saved, false if the preset heap is full or a store transfer is in progress
+    bool savePreset(uint8_t t_bank, uint8_t t_presetIndex, const Preset& t_preset);
+
+    /// @brief Save a serialized preset record to EEPROM, like `savePreset` without touching
+    /// the routing table
+    /// @param t_bank Current bank
+    /// @param t_presetIndex Preset index in the bank
+    /// @param t_record Valid record of `c_presetSize` bytes
+    /// @return true if the record was saved, false if the preset heap is full or a store transfer is in progress
+    bool savePresetRecord(uint8_t t_bank, uint8_t t_presetIndex, const uint8_t* t_record);
+
+    /// @brief Load a preset record from EEPROM without deserializing it, a corrupted record is
+    /// replaced by its shadow copy or by an empty preset. The record is read through a PresetRecordView.
+    /// @param t_bank Target bank
+    /// @param t_presetIndex Preset index in the bank
+    /// @param t_record Data buffer of `c_presetSize` bytes
+    void loadPresetRecord(uint8_t t_bank, uint8_t t_presetIndex, uint8_t* t_record);
+
+    /// @brief Serialize a Preset object into a compact record, the MIDI messages without a status byte are left out
+    /// @param t_preset Preset to serialize
+    /// @param t_buffer Data buffer of `c_presetSize` bytes
+    /// @return uint8_t Length of the record
+    uint8_t serializePreset(const Preset& t_preset, uint8_t* t_buffer) const;
 
-    /// @brief Load a preset from EEPROM
+    /// @brief Deserialize a valid record into a Preset object, the loops send and
+    /// return come from the routing table
+    /// @param t_buffer Data buffer
+    /// @param t_bank Bank of the preset
+    /// @param t_presetIndex Preset index in the bank
+    /// @param t_preset Preset to deserialize the data into
+    void deserializePreset(const uint8_t* t_buffer, uint8_t t_bank, uint8_t t_presetIndex, Preset& t_preset);
+
+    /// @brief Queue an atomic write of the routing table if a preset uses a different
+    /// send or return for one of its loops, nothing is written during a store transfer
+    /// @param t_preset Preset being saved
+    /// @return true if the routing table changed
+    bool updateRoutingTable(const Preset& t_preset);
+
+    /// @brief Get the matrix output of each loop send, from the routing table
+    /// @return const uint8_t* One send per loop
+    const uint8_t* getLoopSends();
+
+    /// @brief Get the matrix input of each loop return, from the routing table
+    /// @return const uint8_t* One return per loop
+    const uint8_t* getLoopReturns();
+
+    /// @brief Load a preset from EEPROM, a corrupted record is replaced by its shadow copy
+    /// or by an empty preset
     /// @param t_bank Target bank
     /// @param t_presetIndex Preset index in the bank
     /// @param t_preset Reference to the preset to load into
     void loadPreset(uint8_t t_bank, uint8_t t_presetIndex, Preset& t_preset);
 
-    /// @brief Save a FootSwitchConfig to EEPROM
+    /// @brief Save a FootSwitchConfig of a bank to EEPROM, the write is queued and completes in `poll`.
+    /// A config that differs from the footswitch table is stored as an override of the bank,
+    /// a config equal to it removes the override.
     /// @param t_bank Current bank
     /// @param t_footSwitchIndex FootSwitchConfig index in the bank
     /// @param t_config Reference to the FootSwitchConfig to save
-    void saveFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitchIndex, const FootSwitchConfig& t_config);
+    /// @return true if the config was saved, false if the preset heap is full or a store transfer is in progress
+    bool saveFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitchIndex, const FootSwitchConfig& t_config);
+
+    /// @brief Save a FootSwitchConfig to the footswitch table, used by every bank that doesn't
+    /// override the footswitch. The write is queued and completes in `poll`.
+    /// @param t_footSwitchIndex FootSwitchConfig index
+    /// @param t_config Reference to the FootSwitchConfig to save
+    void saveGlobalFootSwitchConfig(uint8_t t_footSwitchIndex, const FootSwitchConfig& t_config);
 
-    /// @brief Load a FootSwitchConfig from EEPROM
+    /// @brief Load a FootSwitchConfig of a bank from EEPROM
     /// @param t_bank Target bank
     /// @param t_footSwitchIndex FootSwitchConfig index in the bank
     /// @param t_config Reference to the FootSwitchObject to load data into
     void loadFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitchIndex, FootSwitchConfig& t_config);
 
+    /// @brief Load all the FootSwitchConfigs of a bank: the footswitch table held in RAM, then the
+    /// overrides of the bank, only read if its override entry points to some
+    /// @param t_bank Target bank
+    /// @param t_configs Array of `c_footSwitchConfigPerBank` FootSwitchConfigs to load into
+    void loadFootSwitchConfigs(uint8_t t_bank, FootSwitchConfig* t_configs);
+
+    /// @brief Load all the presets and FootSwitchConfigs of a bank
+    /// @param t_bank Target bank
+    /// @param t_presets Array of `c_presetsPerBank` presets to load into
+    /// @param t_configs Array of `c_footSwitchConfigPerBank` FootSwitchConfigs to load into
+    void loadPresetBank(uint8_t t_bank, Preset* t_presets, FootSwitchConfig* t_configs);
+
+    /// @brief Get the number of EEPROM pages of the store image: the pages up to the top
+    /// of the preset heap, then the store header page
+    /// @return uint16_t Pages count
+    uint16_t getStoreImagePagesCount();
+
+    /// @brief Get the EEPROM page holding a page of the store image
+    /// @param t_index Index of the page in the image
+    /// @return uint16_t EEPROM page number
+    uint16_t getStoreImagePage(uint16_t t_index);
+
+    /// @brief Read a whole EEPROM page
+    /// @param t_page EEPROM page number
+    /// @param t_buffer Data buffer of `EEPROM_PAGE_SIZE` bytes
+    void readStorePage(uint16_t t_page, uint8_t* t_buffer);
+
+    /// @brief Queue the write of a whole EEPROM page of a restored image, only its changed bytes
+    /// are written. The page goes to its staging page when the image is staged.
+    /// @param t_page EEPROM page number
+    /// @param t_buffer Data buffer of `EEPROM_PAGE_SIZE` bytes
+    /// @return true if the page is part of the image being restored
+    bool writeStorePage(uint16_t t_page, const uint8_t* t_buffer);
+
+    /// @brief Store the pending writes and refuse any save until `endStoreDump`, so the
+    /// image pages are read from a consistent store
+    void beginStoreDump();
+
+    /// @brief Accept saves again once the image is read
+    void endStoreDump();
+
+    /// @brief Refuse any save until `endStoreRestore` or `abortStoreRestore`. The image is staged
+    /// in the pages below the header page when they are above both the current image and the pages
+    /// the image is copied to, so the current image is kept until the whole image is received.
+    /// A larger image is written in place and the store header is invalidated, an interrupted
+    /// restore then leaves a store that is formatted rather than a mix of two images.
+    /// @param t_pagesCount Pages of the image, the last one is the header page
+    /// @return true if the image is staged
+    bool beginStoreRestore(uint16_t t_pagesCount);
+
+    /// @brief Copy a staged image over the current one, forget everything cached from the previous
+    /// image and open the restored store, which is formatted if its header page was never written
+    void endStoreRestore();
+
+    /// @brief Give up a restore: a staged image is dropped and the current store is kept, a
+    /// restore in place is ended like `endStoreRestore`
+    /// @return true if the current store was kept
+    bool abortStoreRestore();
+
+    /// @brief Move all the preset records and footswitch overrides to the bottom of the preset heap
+    /// to reclaim the extents freed by records that changed length. Each move is a shadow commit of the record
+    /// with its index entry, so a power loss can't lose a record. Runs the whole compaction at once,
+    /// `poll` runs it in slices when the heap runs low.
+    void compactPresetStore();
+
+    /// @brief Check if a compaction is in progress
+    /// @return true if the compaction isn't done
+    bool isCompacting() const;
+
+    /// @brief Get the room left at the top of the preset heap
+    /// @return uint16_t Free bytes
+    uint16_t getPresetHeapFree();
+
+    /// @brief Get the number of bytes written to the EEPROM by record saves
+    /// @return uint32_t Bytes written
+    uint32_t getBytesWritten() const;
+
+    /// @brief Get the number of bytes of record saves that were already up to date in the EEPROM
+    /// @return uint32_t Bytes skipped
+    uint32_t getBytesSkipped() const;
+
+    /// @brief Reset the written and skipped bytes counters
+    void resetWriteStats();
+
+    /// @brief Get the EEPROM bus activity since the last `resetEepromStats`
+    /// @return const EepromStats& Bus activity
+    const EepromStats& getEepromStats() const;
+
+    /// @brief Reset the EEPROM bus activity counters
+    void resetEepromStats();
+
+    /// @brief Get the number of records the scrubber rewrote from their shadow copy
+    /// @return uint16_t Repaired records
+    uint16_t getRepairedRecords() const;
+
+    /// @brief Get the number of quarantined index entries
+    /// @return uint16_t Quarantined records
+    uint16_t getQuarantinedRecords() const;
+
 
     /// Test functions
     void initializeTestData();
     void readTestData();
+
+    /// @brief Log the time and EEPROM bus activity of preset loads, bank loads and preset saves,
+    /// preset 0 of bank 0 is overwritten during the run and restored at the end
+    void benchmarkStore();
 };
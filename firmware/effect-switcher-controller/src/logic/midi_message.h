@@ -95,6 +95,15 @@ class MidiMessage {
     }
 
 
+    /// @brief Get the number of data bytes of a channel message from its status byte,
+    /// Program Change and Channel Pressure have a single data byte
+    /// @param t_statusByte Status byte
+    /// @return uint8_t 1 or 2
+    static uint8_t getDataBytesCount(uint8_t t_statusByte) {
+      uint8_t type = t_statusByte & 0xF0;
+      return (type == 0xC0 || type == 0xD0) ? 1 : 2;
+    }
+
     /// @brief Check if the message has 2 data bytes
     /// @return true if the message has 2 data bytes
     bool hasDataByte2() const {
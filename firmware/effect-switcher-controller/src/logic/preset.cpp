@@ -6,8 +6,6 @@ uint8_t Preset::getBank() const {
 
 void Preset::setBank(uint8_t t_bank) {
   m_bank = t_bank;
-
-  LOG_DEBUG("Bank set to %d", t_bank);
 }
 
 uint8_t Preset::getPreset() const {
@@ -16,8 +14,6 @@ uint8_t Preset::getPreset() const {
 
 void Preset::setPreset(uint8_t t_preset) {
   m_preset = t_preset;
-
-  LOG_DEBUG("Preset set to %d", t_preset);
 }
 
 uint8_t Preset::getLoopsCount() const {
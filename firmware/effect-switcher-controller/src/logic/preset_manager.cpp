@@ -1,24 +1,303 @@
 #include "logic/preset_manager.h"
 
-void PresetManager::loadPresetBank(uint8_t t_bank) {
-  // Load presets
+CachedBank* PresetManager::findCachedBank(uint8_t t_bank) {
+  for (uint8_t i = 0; i < c_bankCacheSize; i++) {
+    if (m_bankCache[i].bank == t_bank) {
+      return &m_bankCache[i];
+    }
+  }
+
+  return nullptr;
+}
+
+CachedBank* PresetManager::acquireCachedBank() {
+  static_assert(c_bankCacheSize <= 8, "The skipped slots are a byte mask");
+  uint8_t skippedSlots = 0;  // Slots holding presets their write back couldn't store
+
+  while (true) {
+    CachedBank* victim = nullptr;
+    uint8_t victimSlot = 0;
+
+    for (uint8_t i = 0; i < c_bankCacheSize; i++) {
+      CachedBank* cachedBank = &m_bankCache[i];
+
+      if (cachedBank == p_loadingBank || bitRead(skippedSlots, i)) {
+        continue;
+      }
+
+      if (cachedBank->bank == c_noBank) {
+        return cachedBank;
+      }
+
+      if (cachedBank != p_currentBank && (victim == nullptr || cachedBank->lastUse < victim->lastUse)) {
+        victim = cachedBank;
+        victimSlot = i;
+      }
+    }
+
+    if (victim == nullptr) {
+      LOG_ERROR("No bank cache slot to evict");
+      return nullptr;
+    }
+
+    writeBackCachedBank(*victim);
+
+    // Evicting it would lose the edits, the next least recently used bank is tried
+    if (victim->dirtyPresets == 0) {
+      victim->bank = c_noBank;
+      return victim;
+    }
+
+    LOG_ERROR("Bank %d has presets not stored, kept in the cache", victim->bank);
+    bitSet(skippedSlots, victimSlot);
+  }
+}
+
+void PresetManager::writeBackCachedBank(CachedBank& t_cachedBank) {
   for (uint8_t i = 0; i < c_maxPresetsPerBank; i++) {
-    m_memoryManager.loadPreset(t_bank, i, m_presetBanks[i]);
+    // A preset that doesn't fit in storage stays dirty
+    if (bitRead(t_cachedBank.dirtyPresets, i) && m_memoryManager.savePresetRecord(t_cachedBank.bank, i, t_cachedBank.records[i])) {
+      bitClear(t_cachedBank.dirtyPresets, i);
+    }
   }
-  // Load footswitches
+}
+
+void PresetManager::activatePresetBank(CachedBank* t_cachedBank) {
+  t_cachedBank->lastUse = ++m_cacheTick;
+
+  p_currentBank = t_cachedBank;
+  m_currentPresetBank = t_cachedBank->bank;
+  m_currentPresetIndex = 0;
+  loadCurrentPreset();
+  m_bankChanged = true;
+  m_prefetchPending = true;
+
+  LOG_DEBUG("Current bank: %d, Current preset: %d", m_currentPresetBank, m_currentPresetIndex);
+  LOG_DEBUG("Bank prefetch hits: %d/%d", m_prefetchHits, m_prefetchCount);
+
+  m_memoryManager.saveDeviceState(m_currentPresetBank, m_currentPresetIndex);
+}
+
+void PresetManager::beginBankLoad(uint8_t t_bank) {
+  m_cacheMisses++;
+
+  // A load still pending is replaced in the same slot
+  if (p_loadingBank == nullptr) {
+    p_loadingBank = acquireCachedBank();
+  }
+
+  if (p_loadingBank == nullptr) {
+    LOG_ERROR("Bank %d not loaded, the bank cache is full", t_bank);
+    return;
+  }
+
+  m_loadingBankNumber = t_bank;
+
+  LOG_DEBUG("Loading bank: %d", t_bank);
+}
+
+void PresetManager::loadCachedBank(CachedBank* t_cachedBank, uint8_t t_bank) {
+  t_cachedBank->bank = t_bank;
+  t_cachedBank->dirtyPresets = 0;
+  t_cachedBank->loadedPresets = 0;
+  t_cachedBank->prefetched = false;
+
+  // The footswitches and the preset a bank switch activates, a record read each
+  m_memoryManager.loadFootSwitchConfigs(t_bank, t_cachedBank->footSwitches);
+  getCachedRecord(t_cachedBank, 0);
+
+  // The presets selected by a footswitch as well: reading one on the press would first wait
+  // for the queued writes
   for (uint8_t i = 0; i < c_maxFootSwitchesConfigPerBank; i++) {
-    m_memoryManager.loadFootSwitchConfig(t_bank, i, m_footSwitches[i]);
+    const FootSwitchConfig& footSwitch = t_cachedBank->footSwitches[i];
+
+    if (footSwitch.getMode() == FootSwitchMode::kPresetSelect && footSwitch.getTargetPreset() < c_maxPresetsPerBank) {
+      getCachedRecord(t_cachedBank, footSwitch.getTargetPreset());
+    }
   }
 }
 
+void PresetManager::loadPendingBank() {
+  CachedBank* loadedBank = p_loadingBank;
+  p_loadingBank = nullptr;
+
+  loadCachedBank(loadedBank, m_loadingBankNumber);
+  activatePresetBank(loadedBank);
+}
+
+uint8_t* PresetManager::getCachedRecord(CachedBank* t_cachedBank, uint8_t t_presetIndex) {
+  if (!bitRead(t_cachedBank->loadedPresets, t_presetIndex)) {
+    m_memoryManager.loadPresetRecord(t_cachedBank->bank, t_presetIndex, t_cachedBank->records[t_presetIndex]);
+    bitSet(t_cachedBank->loadedPresets, t_presetIndex);
+    compilePresetPlan(t_cachedBank, t_presetIndex);
+  }
+
+  return t_cachedBank->records[t_presetIndex];
+}
+
+void PresetManager::compilePresetPlan(CachedBank* t_cachedBank, uint8_t t_presetIndex) {
+  PresetRecordView record(t_cachedBank->records[t_presetIndex]);
+  PresetPlan& plan = t_cachedBank->plans[t_presetIndex];
+
+  Routing::compileRecord(record, m_memoryManager.getLoopSends(), m_memoryManager.getLoopReturns(), plan.routing);
+
+  plan.ledMask = 0;
+  for (uint8_t i = 0; i < c_maxFootSwitchesConfigPerBank; i++) {
+    const FootSwitchConfig& footSwitch = t_cachedBank->footSwitches[i];
+
+    if ((footSwitch.getMode() == FootSwitchMode::kPresetSelect && footSwitch.getTargetPreset() == t_presetIndex) ||
+      (footSwitch.getMode() == FootSwitchMode::kToggleLoop && footSwitch.getLoopIndex() < record.getLoopsCount() &&
+        record.getLoopState(footSwitch.getLoopIndex()))) {
+      bitSet(plan.ledMask, i);
+    }
+  }
+
+  plan.p_midiData = record.getMidiData();
+  plan.midiLength = record.getMidiDataLength();
+}
+
+void PresetManager::compileAllPresetPlans() {
+  for (uint8_t i = 0; i < c_bankCacheSize; i++) {
+    if (m_bankCache[i].bank == c_noBank) {
+      continue;
+    }
+
+    for (uint8_t j = 0; j < c_maxPresetsPerBank; j++) {
+      if (bitRead(m_bankCache[i].loadedPresets, j)) {
+        compilePresetPlan(&m_bankCache[i], j);
+      }
+    }
+  }
+}
+
+void PresetManager::loadCurrentPreset() {
+  m_memoryManager.deserializePreset(getCachedRecord(p_currentBank, m_currentPresetIndex),
+    m_currentPresetBank, m_currentPresetIndex, m_currentPreset);
+}
+
+bool PresetManager::fillCurrentBank() {
+  for (uint8_t i = 0; i < c_maxPresetsPerBank; i++) {
+    if (!bitRead(p_currentBank->loadedPresets, i)) {
+      getCachedRecord(p_currentBank, i);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void PresetManager::completeBankLoad() {
+  if (p_loadingBank != nullptr) {
+    loadPendingBank();
+  }
+}
+
+bool PresetManager::isBankLoading() const {
+  return p_loadingBank != nullptr;
+}
+
+void PresetManager::prefetchAdjacentBanks() {
+  uint8_t missingBank = c_noBank;
+
+  // Refresh the cached adjacent banks so the next load evicts a bank further away
+  for (uint8_t distance = 1; distance <= c_bankPrefetchDepth; distance++) {
+    uint8_t adjacentBanks[2] = {
+      uint8_t((m_currentPresetBank + distance) % c_maxPresetBanks),
+      uint8_t((m_currentPresetBank + c_maxPresetBanks - distance % c_maxPresetBanks) % c_maxPresetBanks)
+    };
+
+    for (uint8_t i = 0; i < 2; i++) {
+      CachedBank* cachedBank = findCachedBank(adjacentBanks[i]);
+
+      if (cachedBank != nullptr) {
+        cachedBank->lastUse = ++m_cacheTick;
+      }
+      else if (missingBank == c_noBank) {
+        missingBank = adjacentBanks[i];
+      }
+    }
+  }
+
+  if (missingBank == c_noBank) {
+    m_prefetchPending = false;
+    return;
+  }
+
+  CachedBank* cachedBank = acquireCachedBank();
+  if (cachedBank == nullptr) {
+    m_prefetchPending = false;
+    return;
+  }
+
+  loadCachedBank(cachedBank, missingBank);
+  cachedBank->prefetched = true;
+  cachedBank->lastUse = ++m_cacheTick;
+
+  m_prefetchCount++;
+}
+
+bool PresetManager::poll() {
+  // Reading waits for the queued writes, so only load once they are stored
+  if (m_memoryManager.isIdle()) {
+    if (p_loadingBank != nullptr) {
+      loadPendingBank();
+    }
+    else if (m_writeBackPending && millis() - m_lastSaveTime >= c_writeBackDelay) {
+      // The menus write back when they are left, this stores the presets saved without leaving them
+      writeBack();
+    }
+    else if (!fillCurrentBank()) {
+      if (m_prefetchPending) {
+        prefetchAdjacentBanks();
+      }
+      else {
+        // The banks are loaded, the idle time checks the store
+        m_memoryManager.scrub();
+      }
+    }
+  }
+
+  bool bankChanged = m_bankChanged;
+  m_bankChanged = false;
+
+  return bankChanged;
+}
+
 void PresetManager::initialize() {
   uint8_t lastBank = 0;
   uint8_t lastPreset = 0;
+  m_memoryManager.openStore();
+  m_memoryManager.recover();
+  m_memoryManager.validateStore();
   m_memoryManager.loadDeviceState(lastBank, lastPreset);
   LOG_DEBUG("Last bank: %d, Last preset: %d", lastBank, lastPreset);
 
+  // A state out of range would leave no bank loaded
+  if (lastBank >= c_maxPresetBanks || lastPreset >= c_maxPresetsPerBank) {
+    LOG_ERROR("Invalid device state, bank %d preset %d, starting from bank 0", lastBank, lastPreset);
+    lastBank = 0;
+    lastPreset = 0;
+  }
+
   setPresetBank(lastBank);
+  completeBankLoad();
   setCurrentPreset(lastPreset);
+  m_bankChanged = false;
+}
+
+void PresetManager::reload() {
+  // The cached banks belong to the previous store
+  for (uint8_t i = 0; i < c_bankCacheSize; i++) {
+    m_bankCache[i].bank = c_noBank;
+    m_bankCache[i].dirtyPresets = 0;
+    m_bankCache[i].loadedPresets = 0;
+    m_bankCache[i].prefetched = false;
+  }
+  p_loadingBank = nullptr;
+  m_prefetchPending = false;
+
+  initialize();
+  m_bankChanged = true;
 }
 
 uint8_t PresetManager::getCurrentBank() const {
@@ -27,39 +306,61 @@ uint8_t PresetManager::getCurrentBank() const {
 
 void PresetManager::setPresetBank(uint8_t t_bank) {
   if (t_bank < c_maxPresetBanks) {
-    loadPresetBank(t_bank);
-    m_currentPresetBank = t_bank;
-    m_currentPresetIndex = 0;
-    p_currentPreset = &m_presetBanks[m_currentPresetIndex];
+    CachedBank* cachedBank = findCachedBank(t_bank);
 
-    LOG_DEBUG("Current bank: %d, Current preset: %d", m_currentPresetBank, m_currentPresetIndex);
+    if (cachedBank != nullptr) {
+      m_cacheHits++;
 
-    m_memoryManager.saveDeviceState(m_currentPresetBank, m_currentPresetIndex);
+      if (cachedBank->prefetched) {
+        m_prefetchHits++;
+        cachedBank->prefetched = false;
+      }
+
+      // Drop any load in progress, its slot is still free
+      p_loadingBank = nullptr;
+      activatePresetBank(cachedBank);
+    }
+    else if (p_loadingBank == nullptr || m_loadingBankNumber != t_bank) {
+      beginBankLoad(t_bank);
+    }
   } else {
     LOG_DEBUG("Invalid bank: %d", t_bank);
   }
 }
 
 void PresetManager::setPresetBankUp() {
-  // If the current bank is the last one, wrap around to 0
-  if ((m_currentPresetBank + 1) >= c_maxPresetBanks) {
+  // Step from the bank being loaded so repeated presses aren't lost
+  uint8_t bank = (p_loadingBank != nullptr) ? m_loadingBankNumber : m_currentPresetBank;
+
+  // If the bank is the last one, wrap around to 0
+  if ((bank + 1) >= c_maxPresetBanks) {
     setPresetBank(0);
   } else {
-    setPresetBank(m_currentPresetBank + 1);
+    setPresetBank(bank + 1);
   }
 }
 
 void PresetManager::setPresetBankDown() {
-  // If the current bank is the first one, wrap around to the last bank
-  if (m_currentPresetBank == 0) {
+  uint8_t bank = (p_loadingBank != nullptr) ? m_loadingBankNumber : m_currentPresetBank;
+
+  // If the bank is the first one, wrap around to the last bank
+  if (bank == 0) {
     setPresetBank(c_maxPresetBanks - 1);
   } else {
-    setPresetBank(m_currentPresetBank - 1);
+    setPresetBank(bank - 1);
   }
 }
 
-Preset* PresetManager::getCurrentPreset() const {
-  return p_currentPreset;
+Preset* PresetManager::getCurrentPreset() {
+  return &m_currentPreset;
+}
+
+PresetRecordView PresetManager::getCurrentPresetRecord() const {
+  return PresetRecordView(p_currentBank->records[m_currentPresetIndex]);
+}
+
+const PresetPlan& PresetManager::getCurrentPlan() const {
+  return p_currentBank->plans[m_currentPresetIndex];
 }
 
 uint8_t PresetManager::getCurrentPresetIndex() const {
@@ -69,7 +370,7 @@ uint8_t PresetManager::getCurrentPresetIndex() const {
 void PresetManager::setCurrentPreset(uint8_t t_presetIndex) {
   if (t_presetIndex < c_maxPresetsPerBank) {
     m_currentPresetIndex = t_presetIndex;
-    p_currentPreset = &m_presetBanks[m_currentPresetIndex];
+    loadCurrentPreset();
 
     m_memoryManager.saveDeviceState(m_currentPresetBank, m_currentPresetIndex);
 
@@ -81,51 +382,101 @@ void PresetManager::setCurrentPreset(uint8_t t_presetIndex) {
 }
 
 void PresetManager::saveCurrentPreset() {
-  m_memoryManager.savePreset(m_currentPresetBank, m_currentPresetIndex, *p_currentPreset);
+  bool routingTableChanged = m_memoryManager.updateRoutingTable(m_currentPreset);
+  m_memoryManager.serializePreset(m_currentPreset, p_currentBank->records[m_currentPresetIndex]);
+  bitSet(p_currentBank->dirtyPresets, m_currentPresetIndex);
+  m_writeBackPending = true;
+  m_lastSaveTime = millis();
+
+  // The routing table is shared by every preset
+  if (routingTableChanged) {
+    compileAllPresetPlans();
+  }
+  else {
+    compilePresetPlan(p_currentBank, m_currentPresetIndex);
+  }
+
   LOG_DEBUG("Saved current preset: Bank %d, Preset %d", m_currentPresetBank, m_currentPresetIndex);
 }
 
+void PresetManager::writeBack() {
+  m_writeBackPending = false;
+  m_lastSaveTime = millis();
+
+  for (uint8_t i = 0; i < c_bankCacheSize; i++) {
+    if (m_bankCache[i].bank != c_noBank) {
+      writeBackCachedBank(m_bankCache[i]);
+
+      // A bank that couldn't be stored is tried again after the delay
+      if (m_bankCache[i].dirtyPresets != 0) {
+        m_writeBackPending = true;
+      }
+    }
+  }
+}
+
+void PresetManager::flush() {
+  writeBack();
+  m_memoryManager.flush();
+}
+
+uint16_t PresetManager::getCacheHits() const {
+  return m_cacheHits;
+}
+
+uint16_t PresetManager::getCacheMisses() const {
+  return m_cacheMisses;
+}
+
+uint16_t PresetManager::getPrefetchCount() const {
+  return m_prefetchCount;
+}
+
+uint16_t PresetManager::getPrefetchHits() const {
+  return m_prefetchHits;
+}
+
 void PresetManager::toggleLoopState(uint8_t t_loop) {
-  p_currentPreset->toggleLoopState(t_loop);
+  m_currentPreset.toggleLoopState(t_loop);
 }
 
 void PresetManager::swapLoops(uint8_t t_loop1, uint8_t t_loop2) {
-  p_currentPreset->swapPresetLoopsOrder(t_loop1, t_loop2);
+  m_currentPreset.swapPresetLoopsOrder(t_loop1, t_loop2);
 }
 
 uint8_t PresetManager::getLoopByOrder(uint8_t t_order) {
-  return p_currentPreset->getLoopIndexByOrder(t_order);
+  return m_currentPreset.getLoopIndexByOrder(t_order);
 }
 
 void PresetManager::addMidiMessage(uint8_t t_type, uint8_t t_channel, uint8_t t_byte1, uint8_t t_byte2, bool t_hasDataByte2) {
-  p_currentPreset->AddMidiMessage(t_type, t_channel, t_byte1, t_byte2, t_hasDataByte2);
+  m_currentPreset.AddMidiMessage(t_type, t_channel, t_byte1, t_byte2, t_hasDataByte2);
 }
 
 void PresetManager::setMidiMessageValues(uint8_t t_message, uint8_t t_type, uint8_t t_channel, uint8_t t_byte1, uint8_t t_byte2, bool t_hasDataByte2) {
-  p_currentPreset->setMidiMessageType(t_message, t_type);
-  p_currentPreset->setMidiMessageChannel(t_message, t_channel);
-  p_currentPreset->setMidiMessageDataByte1(t_message, t_byte1);
+  m_currentPreset.setMidiMessageType(t_message, t_type);
+  m_currentPreset.setMidiMessageChannel(t_message, t_channel);
+  m_currentPreset.setMidiMessageDataByte1(t_message, t_byte1);
 
   if (t_hasDataByte2) {
-    p_currentPreset->setMidiMessageDataByte2(t_message, t_byte2);
+    m_currentPreset.setMidiMessageDataByte2(t_message, t_byte2);
   }
   else {
-    p_currentPreset->setMidiMessageDataByte2(t_message, 255);
+    m_currentPreset.setMidiMessageDataByte2(t_message, 255);
   }
 }
 
 void PresetManager::removeMidiMessage(uint8_t t_message) {
-  p_currentPreset->removeMidiMessage(t_message);
+  m_currentPreset.removeMidiMessage(t_message);
 }
 
 FootSwitchMode PresetManager::getFootSwitchMode(uint8_t t_footSwitch) const {
-  return m_footSwitches[t_footSwitch].getMode();
+  return p_currentBank->footSwitches[t_footSwitch].getMode();
 }
 
 uint8_t PresetManager::getFootSwitchTargetBank(uint8_t t_footSwitch) const {
-  return m_footSwitches[t_footSwitch].getTargetBank();
+  return p_currentBank->footSwitches[t_footSwitch].getTargetBank();
 }
 
 uint8_t PresetManager::getFootSwitchTargetPreset(uint8_t t_footSwitch) const {
-  return m_footSwitches[t_footSwitch].getTargetPreset();
+  return p_currentBank->footSwitches[t_footSwitch].getTargetPreset();
 }
@@ -3,11 +3,47 @@
 #include <Arduino.h>
 #include "logic/preset.h"
 #include "logic/memory.h"
+#include "logic/preset_record_view.h"
+#include "logic/routing.h"
 #include "logic/footswitch.h"
 
-constexpr uint8_t c_maxPresetBanks = 4;
-constexpr uint8_t c_maxPresetsPerBank = 4;
-constexpr uint8_t c_maxFootSwitchesConfigPerBank = 6;
+constexpr uint8_t c_maxPresetBanks = c_banksCount;  // As many banks as the EEPROM holds
+constexpr uint8_t c_maxPresetsPerBank = c_presetsPerBank;
+constexpr uint8_t c_maxFootSwitchesConfigPerBank = c_footSwitchConfigPerBank;
+
+constexpr uint8_t c_bankPrefetchDepth = 1;  // Banks prefetched on each side of the current bank
+constexpr uint8_t c_bankCacheSize = 2 + 2 * c_bankPrefetchDepth;  // Current, loading and prefetched banks, ~530 bytes of SRAM each
+constexpr uint8_t c_noBank = 0xFF;           // Bank number of a free cache slot
+constexpr uint16_t c_writeBackDelay = 2000;  // Time without a preset save (ms) before `poll` writes the saved presets back
+
+// A bank load needs a slot besides the current bank, even without prefetching
+static_assert(c_bankCacheSize >= 2, "The bank cache can't hold the current and the loading bank");
+
+// Longest MIDI stream of a preset, three bytes per message without running status. It doesn't fit
+// the 63 free bytes of the UART buffer once a log line is queued, so it is written across polls.
+constexpr uint8_t c_maxPlanMidiLength = 3 * c_maxMidiMessages;
+
+/// @brief What activating a preset does to the hardware, compiled from its record when it is read
+/// or saved so a preset switch only copies it
+struct PresetPlan {
+  RoutingBitmap routing;       // Switch matrix crosspoints
+  uint16_t ledMask = 0;        // Footswitch LEDs lit: the switches selecting the preset or toggling one of its active loops
+  const uint8_t* p_midiData = nullptr;  // MIDI messages in the record, as they are sent on the wire
+  uint8_t midiLength = 0;      // Length of the MIDI messages in bytes, at most `c_maxPlanMidiLength`
+};
+
+/// @brief A bank kept in RAM with its preset records, their plans and footswitches. The records keep
+/// their storage layout and are read through a PresetRecordView, only the current preset is deserialized.
+struct CachedBank {
+  uint8_t bank = c_noBank;      // Cached bank number
+  uint8_t dirtyPresets = 0;     // One bit per preset saved in RAM but not in storage yet
+  uint8_t loadedPresets = 0;    // One bit per preset read from storage, the others are read on first access
+  uint32_t lastUse = 0;         // Cache tick of the last access, the oldest bank is evicted first
+  bool prefetched = false;      // Loaded ahead of time and not switched to yet
+  uint8_t records[c_maxPresetsPerBank][c_presetSize];
+  PresetPlan plans[c_maxPresetsPerBank];  // Plan of each preset read from storage
+  FootSwitchConfig footSwitches[c_maxFootSwitchesConfigPerBank];
+};
 
 /// @brief Interface between the HAL and the presets to
 /// securely handle banks and presets switching operations
@@ -19,12 +55,83 @@ class PresetManager {
     uint8_t m_currentPresetBank;
     uint8_t m_currentPresetIndex;
 
-    Preset m_presetBanks[c_maxPresetsPerBank];
-    Preset* p_currentPreset;
+    CachedBank m_bankCache[c_bankCacheSize];
+    CachedBank* p_currentBank;
+    Preset m_currentPreset;  // Current preset deserialized for editing, stored back to its record by `saveCurrentPreset`
+
+    uint32_t m_cacheTick = 0;    // Incremented on each bank access
+    uint16_t m_cacheHits = 0;    // Bank switches served from RAM
+    uint16_t m_cacheMisses = 0;  // Bank switches loaded from storage
+
+    bool m_prefetchPending = false;  // Some banks around the current one aren't cached yet
+    uint16_t m_prefetchCount = 0;    // Banks loaded ahead of time
+    uint16_t m_prefetchHits = 0;     // Bank switches to a bank loaded ahead of time
+
+    CachedBank* p_loadingBank = nullptr;  // Cache slot of the bank to load, the current bank stays live meanwhile
+    uint8_t m_loadingBankNumber = 0;      // Bank to load into `p_loadingBank`
+    bool m_bankChanged = false;           // The current bank changed since the last `poll`
+
+    bool m_writeBackPending = false;  // Some saved presets are held in RAM only
+    uint32_t m_lastSaveTime = 0;      // Time (ms) of the last preset save or write back
+
+    /// @brief Make a fully loaded cached bank the current one, on its first preset
+    /// @param t_cachedBank Cache slot holding the bank
+    void activatePresetBank(CachedBank* t_cachedBank);
+
+    /// @brief Reserve a free cache slot for a bank, it is loaded by the next `poll` once storage is idle
+    /// @param t_bank Bank number
+    void beginBankLoad(uint8_t t_bank);
+
+    /// @brief Read the FootSwitchConfigs, the first preset and the presets selected by a footswitch
+    /// of a bank into a cache slot, the other presets are read on first access or in idle time
+    /// @param t_cachedBank Cache slot
+    /// @param t_bank Bank number
+    void loadCachedBank(CachedBank* t_cachedBank, uint8_t t_bank);
+
+    /// @brief Load the pending bank and make it the current one
+    void loadPendingBank();
+
+    /// @brief Get a preset record of a cached bank, it is read from storage on first access
+    /// @param t_cachedBank Cached bank
+    /// @param t_presetIndex Preset index in the bank
+    /// @return uint8_t* Record in the cache slot
+    uint8_t* getCachedRecord(CachedBank* t_cachedBank, uint8_t t_presetIndex);
+
+    /// @brief Compile the plan of a preset from its record, the routing table and the footswitches
+    /// of its bank
+    /// @param t_cachedBank Cached bank
+    /// @param t_presetIndex Preset index in the bank, its record is read
+    void compilePresetPlan(CachedBank* t_cachedBank, uint8_t t_presetIndex);
+
+    /// @brief Compile the plans of every preset read in the cache, after the routing table changed
+    void compileAllPresetPlans();
+
+    /// @brief Deserialize the record of the current preset into `m_currentPreset`, the edits not
+    /// saved yet are dropped
+    void loadCurrentPreset();
 
-    FootSwitchConfig m_footSwitches[c_maxFootSwitchesConfigPerBank];
+    /// @brief Read the next preset of the current bank not read yet
+    /// @return true if a preset was read
+    bool fillCurrentBank();
 
-    void loadPresetBank(uint8_t t_bank);
+    /// @brief Find a bank in the cache
+    /// @param t_bank Bank number
+    /// @return CachedBank* Cache slot holding the bank, nullptr if the bank isn't cached
+    CachedBank* findCachedBank(uint8_t t_bank);
+
+    /// @brief Get a cache slot for a new bank, a free slot or the least recently used one,
+    /// which is written back first. The current and loading banks are never evicted, nor a bank
+    /// whose write back failed.
+    /// @return CachedBank* Free cache slot, nullptr if no slot can be evicted
+    CachedBank* acquireCachedBank();
+
+    /// @brief Save the dirty presets of a cached bank to storage
+    /// @param t_cachedBank Cached bank
+    void writeBackCachedBank(CachedBank& t_cachedBank);
+
+    /// @brief Keep the banks within `c_bankPrefetchDepth` of the current one cached,
+    /// loads at most one bank per call
+    void prefetchAdjacentBanks();
 
   public:
     /// @brief Default constructor
@@ -33,21 +140,36 @@ class PresetManager {
       m_memoryManager(t_memoryManager),
       m_currentPresetBank(0),
       m_currentPresetIndex(0),
-      p_currentPreset(nullptr) {
-        for (uint8_t i = 0; i < c_maxPresetsPerBank; i++) {
-          m_presetBanks[i] = Preset();
-        }
-      }
+      p_currentBank(nullptr) { }
 
     /// @brief Load the last bank and preset from storage and
     /// initialize the object's members
     void initialize();
 
+    /// @brief Drop every cached bank, including the presets not saved yet, and load the last
+    /// bank and preset from storage again, after the whole store was replaced
+    void reload();
+
+    /// @brief Load the pending bank, or else write back the saved presets once no preset was saved
+    /// for `c_writeBackDelay`, or else read the presets of the current bank not read yet, or else
+    /// load the banks adjacent to the current one in the background, or else scrub the store, one
+    /// step per call. Storage is only used while it is idle. Called from the main loop.
+    /// @return true if the current bank changed since the last call
+    bool poll();
+
+    /// @brief Load the pending bank without waiting for `poll`, it becomes the current bank
+    void completeBankLoad();
+
+    /// @brief Check if a bank is being loaded
+    /// @return true if a bank switch is pending
+    bool isBankLoading() const;
+
     /// @brief Get the current bank
     /// @return uint8_t Current bank
     uint8_t getCurrentBank() const;
 
-    /// @brief Set the current bank and load it from storage
+    /// @brief Set the current bank. A cached bank is switched to at once, otherwise it is
+    /// loaded by the next `poll` while the current bank stays active.
     /// @param t_bank Bank number to load
     void setPresetBank(uint8_t t_bank);
 
@@ -57,21 +179,53 @@ class PresetManager {
     /// @brief Go down a bank
     void setPresetBankDown();
 
-    /// @brief Get a pointer to the current Preset object
+    /// @brief Get a pointer to the current Preset object, its edits are kept by `saveCurrentPreset`
     /// @return Pointer*
-    Preset* getCurrentPreset() const;
+    Preset* getCurrentPreset();
+
+    /// @brief Get the saved record of the current preset, to apply it without deserializing it
+    /// @return PresetRecordView View on the record in the bank cache
+    PresetRecordView getCurrentPresetRecord() const;
+
+    /// @brief Get the plan of the current preset, compiled when its record is read or saved
+    /// @return const PresetPlan& Plan, its crosspoints, LED mask and MIDI bytes are ready to send
+    const PresetPlan& getCurrentPlan() const;
 
     /// @brief Get the current preset index
     /// @return uint8_t Preset index
     uint8_t getCurrentPresetIndex() const;
 
-    /// @brief Set the current preset
+    /// @brief Set the current preset, it is read from storage if it wasn't yet
     /// @param t_preset Preset index
     void setCurrentPreset(uint8_t t_presetIndex);
 
-    /// @brief Save the current preset to storage
+    /// @brief Save the current preset, its record is kept in RAM and written to storage by
+    /// `writeBack`, `flush`, `poll` once the saves stop or when its bank is evicted from the cache
     void saveCurrentPreset();
 
+    /// @brief Queue the storage writes of every saved preset still held in RAM only
+    void writeBack();
+
+    /// @brief Write back every saved preset and wait until they are stored, to be called
+    /// before any operation that must not lose data on a power loss
+    void flush();
+
+    /// @brief Get the number of bank switches served from RAM
+    /// @return uint16_t Cache hits
+    uint16_t getCacheHits() const;
+
+    /// @brief Get the number of bank switches loaded from storage
+    /// @return uint16_t Cache misses
+    uint16_t getCacheMisses() const;
+
+    /// @brief Get the number of banks loaded ahead of time
+    /// @return uint16_t Prefetched banks
+    uint16_t getPrefetchCount() const;
+
+    /// @brief Get the number of bank switches to a bank loaded ahead of time
+    /// @return uint16_t Prefetch hits
+    uint16_t getPrefetchHits() const;
+
     void toggleLoopState(uint8_t t_loop);
 
     void swapLoops(uint8_t t_loop1, uint8_t t_loop2);
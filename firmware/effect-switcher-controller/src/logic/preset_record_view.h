@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Arduino.h>
+#include "logic/memory.h"
+#include "logic/midi_message.h"
+
+/// @brief Position in the MIDI messages of a preset record, the messages are read in order
+struct MidiMessageCursor {
+  uint8_t offset;         // Offset of the next message in the record
+  uint8_t runningStatus;  // Status byte of the previous message
+};
+
+/// @brief Read-only access to a valid preset record in its storage layout, see the Preset Storage
+/// memory map. The fields are read straight from the record, so a preset is applied and its
+/// MIDI messages are sent without building a Preset object.
+class PresetRecordView {
+  private:
+    const uint8_t* p_record;  // Record, owned by the caller
+
+  public:
+    /// @brief Constructor
+    /// @param t_record Valid preset record
+    explicit PresetRecordView(const uint8_t* t_record) : p_record(t_record) { }
+
+    /// @brief Get the number of loops in the preset
+    /// @return uint8_t Loops count
+    uint8_t getLoopsCount() const {
+      return p_record[1];
+    }
+
+    /// @brief Get the number of MIDI messages in the preset
+    /// @return uint8_t MIDI messages count
+    uint8_t getMidiMessagesCount() const {
+      return p_record[2];
+    }
+
+    /// @brief Get the state of all the loops
+    /// @return uint16_t One bit per loop, loop 0 is bit 0
+    uint16_t getLoopStates() const {
+      return (p_record[3] << 8) | p_record[4];
+    }
+
+    /// @brief Get the state of a loop
+    /// @param t_loop Index of the loop
+    /// @return true if the loop is active
+    bool getLoopState(uint8_t t_loop) const {
+      return bitRead(getLoopStates(), t_loop);
+    }
+
+    /// @brief Get the order of a loop
+    /// @param t_loop Index of the loop
+    /// @return uint8_t Loop order
+    uint8_t getLoopOrder(uint8_t t_loop) const {
+      uint8_t orders = p_record[c_presetOrdersOffset + t_loop / 2];
+      return (t_loop % 2 == 0) ? orders >> 4 : orders & 0x0F;
+    }
+
+    /// @brief Get a cursor on the first MIDI message
+    /// @return MidiMessageCursor Cursor
+    MidiMessageCursor beginMidiMessages() const {
+      return { uint8_t(c_presetOrdersOffset + (getLoopsCount() + 1) / 2), 0 };
+    }
+
+    /// @brief Read the MIDI message at a cursor and move the cursor to the next one
+    /// @param t_cursor Cursor
+    /// @param t_statusByte Status byte
+    /// @param t_dataByte1 First data byte
+    /// @param t_dataByte2 Second data byte, 255 for messages with a single data byte
+    void readMidiMessage(MidiMessageCursor& t_cursor, uint8_t& t_statusByte, uint8_t& t_dataByte1, uint8_t& t_dataByte2) const {
+      // A data byte where a status byte is expected reuses the previous status
+      if (p_record[t_cursor.offset] & 0x80) {
+        t_cursor.runningStatus = p_record[t_cursor.offset++];
+      }
+
+      t_statusByte = t_cursor.runningStatus;
+      t_dataByte1 = p_record[t_cursor.offset++];
+      t_dataByte2 = (MidiMessage::getDataBytesCount(t_statusByte) == 2) ? p_record[t_cursor.offset++] : 255;
+    }
+
+    /// @brief Get the MIDI messages, stored as they are sent on the wire with running status
+    /// @return const uint8_t* First byte of the messages
+    const uint8_t* getMidiData() const {
+      return &p_record[beginMidiMessages().offset];
+    }
+
+    /// @brief Get the length of the MIDI messages
+    /// @return uint8_t Length in bytes
+    uint8_t getMidiDataLength() const {
+      MidiMessageCursor cursor = beginMidiMessages();
+      uint8_t start = cursor.offset;
+      uint8_t statusByte, dataByte1, dataByte2;
+
+      for (uint8_t i = 0; i < getMidiMessagesCount(); i++) {
+        readMidiMessage(cursor, statusByte, dataByte1, dataByte2);
+      }
+
+      return cursor.offset - start;
+    }
+
+    /// @brief Send the MIDI messages, the record bytes are written as they are
+    void sendMidiMessages() const {
+      Serial.write(getMidiData(), getMidiDataLength());
+    }
+};
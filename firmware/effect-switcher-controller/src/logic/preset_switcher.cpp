@@ -0,0 +1,203 @@
+#include "logic/preset_switcher.h"
+
+void PresetSwitcher::setOutputRow(uint16_t t_row) {
+  m_routing.rows[c_matrixOutputJack] = t_row;
+  m_switchMatrix.setSwitchArray(m_routing.rows);
+  m_switchMatrix.sendSwitchArray();
+}
+
+void PresetSwitcher::connectOutput(uint32_t t_now) {
+  setOutputRow(m_outputRow);
+  m_muted = false;
+  m_gapMeasured = true;
+  m_gapTime = t_now - m_muteStartTime;
+}
+
+void PresetSwitcher::transmitMidi() {
+  // Bytes still pending when a transfer starts would cut its frames
+  if (!m_midiEnabled) {
+    m_midiLength = m_midiOffset;
+  }
+
+  int room = Serial.availableForWrite();
+  uint8_t left = m_midiLength - m_midiOffset;
+
+  if (room > left) {
+    room = left;
+  }
+
+  if (room > 0) {
+    Serial.write(&m_midiData[m_midiOffset], room);
+    m_midiOffset += room;
+
+    if (m_midiOffset == m_midiLength) {
+      m_midiQueuedTime = micros();
+      m_latencyTracer.mark(TraceStage::kMidiSent);
+    }
+  }
+}
+
+void PresetSwitcher::enterStage(uint32_t t_now, SwitchStage t_stage) {
+  m_stage = t_stage;
+  m_stageStartTime = t_now;
+
+  switch (t_stage) {
+    case SwitchStage::kMute:
+      setOutputRow(0);
+      m_muted = true;
+      m_muteStartTime = t_now;
+      break;
+
+    case SwitchStage::kRoute:
+      // The output row is kept disconnected until the pedals are done switching
+      m_routing = m_presetManager.getCurrentPlan().routing;
+      m_outputRow = m_routing.rows[c_matrixOutputJack];
+      if (m_muted) {
+        m_routing.rows[c_matrixOutputJack] = 0;
+      }
+      m_switchMatrix.setSwitchArray(m_routing.rows);
+      break;
+
+    case SwitchStage::kLatch:
+      m_switchMatrix.sendSwitchArray();
+      m_presetLed.setLedStateByMask(m_presetManager.getCurrentPlan().ledMask);
+      m_latencyTracer.mark(TraceStage::kLatched);
+      break;
+
+    case SwitchStage::kMidi: {
+      // The bytes are queued to the UART as it takes them, they are sent by its interrupt. The bytes
+      // of a preset switched away from are dropped.
+      const PresetPlan& plan = m_presetManager.getCurrentPlan();
+      m_midiSent = m_midiEnabled && plan.midiLength > 0;
+      m_midiLength = m_midiSent ? plan.midiLength : 0;
+      m_midiOffset = 0;
+      m_midiQueuedTime = t_now;
+
+      if (m_midiSent) {
+        memcpy(m_midiData, plan.p_midiData, m_midiLength);
+        transmitMidi();
+      }
+      else {
+        m_latencyTracer.mark(TraceStage::kMidiSent);
+      }
+      break;
+    }
+
+    case SwitchStage::kUnmute:
+      if (m_muted) {
+        connectOutput(t_now);
+      }
+      else if (!m_gapMeasured) {
+        // Without muting, the output only drops while the new rows are latched
+        m_gapTime = m_stageTimes[static_cast<uint8_t>(SwitchStage::kLatch)];
+      }
+      m_latencyTracer.mark(TraceStage::kUnmuted);
+      break;
+
+    default:
+      break;
+  }
+}
+
+bool PresetSwitcher::isStageComplete(uint32_t t_now) const {
+  switch (m_stage) {
+    case SwitchStage::kMute:
+      return !m_muted || t_now - m_stageStartTime >= m_budgets.muteTime;
+
+    case SwitchStage::kMidi:
+      // Pedals changing program are only heard if the output is connected
+      return m_midiOffset == m_midiLength &&
+        (!m_muted || !m_midiSent || t_now - m_midiQueuedTime >= m_budgets.midiSettleTime);
+
+    default:
+      return true;
+  }
+}
+
+void PresetSwitcher::switchPreset() {
+  m_switchRequested = true;
+}
+
+void PresetSwitcher::poll() {
+  if (m_switchRequested) {
+    m_switchRequested = false;
+    uint32_t now = micros();
+
+    if (m_stage == SwitchStage::kIdle) {
+      m_switchStartTime = now;
+      m_gapMeasured = false;
+      memset(m_stageTimes, 0, sizeof(m_stageTimes));
+      enterStage(now, (m_budgets.muteTime > 0) ? SwitchStage::kMute : SwitchStage::kRoute);
+    }
+    else if (m_stage != SwitchStage::kMute) {
+      // The output stays as it is and the new preset is routed, a mute still fading routes
+      // the newest preset once it is done
+      enterStage(now, SwitchStage::kRoute);
+    }
+  }
+
+  if (m_midiOffset < m_midiLength) {
+    transmitMidi();
+  }
+
+  // The stages that don't wait run back to back
+  while (m_stage != SwitchStage::kIdle) {
+    uint32_t now = micros();
+
+    // Whatever the stage, the output isn't muted longer than the gap budget, the stages left
+    // run with the output connected
+    if (m_muted && now - m_muteStartTime >= m_budgets.maxGapTime) {
+      connectOutput(now);
+      LOG_INFO("Preset switch over its gap budget, output connected in stage %d", static_cast<uint8_t>(m_stage));
+    }
+
+    if (!isStageComplete(now)) {
+      return;
+    }
+
+    uint8_t stage = static_cast<uint8_t>(m_stage);
+    m_stageTimes[stage] = now - m_stageStartTime;
+
+    if (m_stage == SwitchStage::kUnmute) {
+      m_stage = SwitchStage::kIdle;
+      m_switchTime = now - m_switchStartTime;
+      if (m_gapTime > m_maxGapTime) {
+        m_maxGapTime = m_gapTime;
+      }
+
+      LOG_DEBUG("Preset switch: %lu us, gap %lu us (mute %lu, route %lu, latch %lu, MIDI %lu, unmute %lu)",
+        m_switchTime, m_gapTime, m_stageTimes[0], m_stageTimes[1], m_stageTimes[2], m_stageTimes[3], m_stageTimes[4]);
+    }
+    else {
+      enterStage(now, static_cast<SwitchStage>(stage + 1));
+    }
+  }
+}
+
+bool PresetSwitcher::isSwitching() const {
+  return m_switchRequested || m_stage != SwitchStage::kIdle;
+}
+
+void PresetSwitcher::setBudgets(const SwitchBudgets& t_budgets) {
+  m_budgets = t_budgets;
+}
+
+void PresetSwitcher::setMidiEnabled(bool t_enabled) {
+  m_midiEnabled = t_enabled;
+}
+
+uint32_t PresetSwitcher::getStageTime(SwitchStage t_stage) const {
+  return m_stageTimes[static_cast<uint8_t>(t_stage)];
+}
+
+uint32_t PresetSwitcher::getSwitchTime() const {
+  return m_switchTime;
+}
+
+uint32_t PresetSwitcher::getGapTime() const {
+  return m_gapTime;
+}
+
+uint32_t PresetSwitcher::getMaxGapTime() const {
+  return m_maxGapTime;
+}
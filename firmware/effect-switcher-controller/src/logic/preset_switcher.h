@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Arduino.h>
+#include "logic/preset_manager.h"
+#include "logic/routing.h"
+#include "peripherals/leddriver.h"
+#include "peripherals/switchmatrix.h"
+#include "utils/latency_tracer.h"
+
+/// @brief Stages of a preset switch, in the order they run
+enum class SwitchStage : uint8_t {
+  kMute,    // Output jack disconnected, waits for the output to fade
+  kRoute,   // Crosspoints of the new preset plan copied to the matrix, output still disconnected
+  kLatch,   // Matrix rows and footswitch LEDs sent
+  kMidi,    // Preset MIDI messages written to the UART as it takes them, waits for the pedals to apply them
+  kUnmute,  // Output jack connected to the new chain
+  kIdle
+};
+
+constexpr uint8_t c_switchStagesCount = static_cast<uint8_t>(SwitchStage::kIdle);
+
+/// @brief Waits of a preset switch, the other stages run as fast as the buses allow
+struct SwitchBudgets {
+  uint16_t muteTime = 1000;         // Time (us) for the output to fade before rerouting, 0 switches without muting
+  uint16_t midiSettleTime = 15000;  // Time (us) for the pedals to apply the MIDI messages before unmuting
+  uint16_t maxGapTime = 30000;      // Longest time (us) the output stays muted whatever the stage, switches requested meanwhile included
+};
+
+/// @brief Applies the plan of the current preset to the switch matrix, the footswitch LEDs and the MIDI
+/// output as a fixed sequence of stages: mute, route, latch, MIDI, unmute. The output jack is muted by
+/// the matrix itself, so loops switching and pedals changing program are never heard. The waits are scheduled on `micros`
+/// timestamps by `poll`, the main loop keeps running and the audible gap is bounded by the budgets.
+class PresetSwitcher {
+  private:
+    PresetManager& m_presetManager;
+    SwitchMatrix& m_switchMatrix;
+    LedDriver16& m_presetLed;
+    LatencyTracer& m_latencyTracer;
+
+    SwitchBudgets m_budgets;
+    SwitchStage m_stage = SwitchStage::kIdle;
+    bool m_switchRequested = false;
+
+    RoutingBitmap m_routing;     // Crosspoints sent to the matrix
+    uint16_t m_outputRow = 0;    // Output jack row of the new routing, connected on unmute
+    bool m_muted = false;        // The output jack row is disconnected
+    bool m_midiSent = false;     // The new preset sent MIDI messages the pedals have to apply
+    bool m_midiEnabled = true;   // Preset MIDI messages are sent, the serial port may carry store frames instead
+
+    // MIDI messages of the new preset, copied from its plan since its bank may leave the cache
+    // before the UART took them all
+    uint8_t m_midiData[c_maxPlanMidiLength];
+    uint8_t m_midiLength = 0;
+    uint8_t m_midiOffset = 0;       // Next byte to write to the UART
+    uint32_t m_midiQueuedTime = 0;  // Time (us) the last byte was written to the UART
+    bool m_gapMeasured = false;  // The output was connected again during the current switch
+
+    uint32_t m_switchStartTime = 0;  // Time (us) the switch started
+    uint32_t m_stageStartTime = 0;   // Time (us) the current stage started
+    uint32_t m_muteStartTime = 0;    // Time (us) the output was disconnected
+
+    uint32_t m_stageTimes[c_switchStagesCount];  // Time (us) of each stage of the last switch
+    uint32_t m_switchTime = 0;  // Time (us) of the last switch
+    uint32_t m_gapTime = 0;     // Time (us) the output was disconnected during the last switch
+    uint32_t m_maxGapTime = 0;  // Longest gap since boot
+
+    /// @brief Start a stage and run its action
+    /// @param t_now Current time (us)
+    /// @param t_stage Stage to start
+    void enterStage(uint32_t t_now, SwitchStage t_stage);
+
+    /// @brief Check if the current stage is done waiting
+    /// @param t_now Current time (us)
+    /// @return true if the next stage can start
+    bool isStageComplete(uint32_t t_now) const;
+
+    /// @brief Connect the output jack row of the routing and measure the gap
+    /// @param t_now Current time (us)
+    void connectOutput(uint32_t t_now);
+
+    /// @brief Write as many pending MIDI bytes as the UART buffer takes without blocking
+    void transmitMidi();
+
+    /// @brief Set and send the output jack row
+    /// @param t_row Output jack row, 0 to disconnect it
+    void setOutputRow(uint16_t t_row);
+
+  public:
+    /// @brief Constructor
+    /// @param t_presetManager Reference to the PresetManager object, the plan of its current preset is applied
+    /// @param t_switchMatrix Reference to the SwitchMatrix object
+    /// @param t_presetLed Reference to the LedDriver16 object of the footswitch LEDs
+    /// @param t_latencyTracer Reference to the LatencyTracer object, stamped by the latch, MIDI and unmute stages
+    PresetSwitcher(PresetManager& t_presetManager, SwitchMatrix& t_switchMatrix, LedDriver16& t_presetLed, LatencyTracer& t_latencyTracer) :
+      m_presetManager(t_presetManager),
+      m_switchMatrix(t_switchMatrix),
+      m_presetLed(t_presetLed),
+      m_latencyTracer(t_latencyTracer) {
+        memset(m_routing.rows, 0, sizeof(m_routing.rows));
+        memset(m_stageTimes, 0, sizeof(m_stageTimes));
+      }
+
+    /// @brief Apply the current preset, the switch runs in the next calls to `poll`. A switch requested
+    /// while one is running starts over from its route stage, the output stays as it is.
+    void switchPreset();
+
+    /// @brief Run the stages of the pending switch until one has to wait, called from the main loop
+    void poll();
+
+    /// @brief Check if a switch is running
+    /// @return true if the switch isn't complete
+    bool isSwitching() const;
+
+    /// @brief Set the waits of the next switches
+    /// @param t_budgets Waits
+    void setBudgets(const SwitchBudgets& t_budgets);
+
+    /// @brief Send or drop the MIDI messages of the next switches
+    /// @param t_enabled false while the serial port carries a store transfer
+    void setMidiEnabled(bool t_enabled);
+
+    /// @brief Get the time of a stage of the last switch
+    /// @param t_stage Stage
+    /// @return uint32_t Time (us)
+    uint32_t getStageTime(SwitchStage t_stage) const;
+
+    /// @brief Get the time of the last switch, from the request to the unmute
+    /// @return uint32_t Time (us)
+    uint32_t getSwitchTime() const;
+
+    /// @brief Get the time the output was disconnected during the last switch
+    /// @return uint32_t Time (us)
+    uint32_t getGapTime() const;
+
+    /// @brief Get the longest time the output was disconnected since boot
+    /// @return uint32_t Time (us)
+    uint32_t getMaxGapTime() const;
+};
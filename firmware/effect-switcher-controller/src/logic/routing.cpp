@@ -0,0 +1,62 @@
+#include "logic/routing.h"
+
+namespace Routing {
+  bool checkTable(const uint8_t* t_loopSends, const uint8_t* t_loopReturns) {
+    bool routable = true;
+
+    for (uint8_t i = 0; i < c_maxRoutedLoops; i++) {
+      uint8_t send = t_loopSends[i];
+      uint8_t loopReturn = t_loopReturns[i];
+
+      if (send >= c_matrixSize || send == c_matrixOutputJack || loopReturn >= c_matrixSize || loopReturn == c_matrixInputJack) {
+        LOG_ERROR("Loop %d can't be routed on send %d return %d, it will be bypassed", i, send, loopReturn);
+        routable = false;
+        continue;
+      }
+
+      for (uint8_t j = 0; j < i; j++) {
+        if (t_loopSends[j] == send || t_loopReturns[j] == loopReturn) {
+          LOG_ERROR("Loop %d shares its send or return with loop %d, it is bypassed when both are active", i, j);
+          routable = false;
+          break;
+        }
+      }
+    }
+
+    return routable;
+  }
+
+  void compileRecord(const PresetRecordView& t_record, const uint8_t* t_loopSends, const uint8_t* t_loopReturns, RoutingBitmap& t_bitmap) {
+    memset(t_bitmap.rows, 0, sizeof(t_bitmap.rows));
+
+    uint16_t usedSends = 0;    // Matrix outputs already driven by the chain
+    uint16_t usedReturns = 0;  // Matrix inputs already feeding the chain
+    uint8_t source = c_matrixInputJack;
+    uint8_t loopsCount = t_record.getLoopsCount() < c_maxRoutedLoops ? t_record.getLoopsCount() : c_maxRoutedLoops;
+    uint16_t loopStates = t_record.getLoopStates();
+
+    // Loops sharing an order are chained in loop index order
+    for (uint8_t order = 0; order < c_maxLoops; order++) {
+      for (uint8_t i = 0; i < loopsCount; i++) {
+        if (!bitRead(loopStates, i) || t_record.getLoopOrder(i) != order) {
+          continue;
+        }
+
+        uint8_t send = t_loopSends[i];
+        uint8_t loopReturn = t_loopReturns[i];
+
+        if (send >= c_matrixSize || send == c_matrixOutputJack || bitRead(usedSends, send) ||
+          loopReturn >= c_matrixSize || loopReturn == c_matrixInputJack || bitRead(usedReturns, loopReturn)) {
+          continue;
+        }
+
+        bitSet(t_bitmap.rows[send], source);
+        bitSet(usedSends, send);
+        bitSet(usedReturns, loopReturn);
+        source = loopReturn;
+      }
+    }
+
+    bitSet(t_bitmap.rows[c_matrixOutputJack], source);
+  }
+} // namespace Routing
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include "logic/preset.h"
+#include "logic/preset_record_view.h"
+
+/*
+ * Switch Matrix Channels
+ * The switch matrix connects its 16 inputs (X) to its 16 outputs (Y). Loop sends and returns are
+ * matrix channels, the last channel of each side is wired to the jacks of the switcher.
+ * A preset is routed as a series chain: the input jack feeds the send of the first active loop in
+ * order, each return feeds the send of the next active loop and the last return feeds the output
+ * jack. Bypassed loops are left out of the chain, the input jack feeds the output jack when no
+ * loop is active.
+ *
+ * Channel          Input (X)               Output (Y)
+ * -----------------------------------------------------------------------------------------
+ * 0-14             Loop returns            Loop sends
+ * 15               Input jack              Output jack
+ */
+constexpr uint8_t c_matrixSize = 16;
+constexpr uint8_t c_matrixInputJack = 15;   // Matrix input wired to the input jack
+constexpr uint8_t c_matrixOutputJack = 15;  // Matrix output wired to the output jack
+constexpr uint8_t c_maxRoutedLoops = c_matrixSize - 1;  // Loops with a matrix channel, the jacks take the last one
+constexpr uint8_t c_unwiredChannel = 0xFF;  // Send or return of a loop without a matrix channel
+
+static_assert(c_matrixSize <= 16, "A routing row holds one bit per matrix input");
+static_assert(c_maxRoutedLoops <= c_maxLoops, "A preset holds every loop of the matrix");
+
+/// @brief Crosspoints of the switch matrix for a preset, in the layout sent to the matrix
+struct RoutingBitmap {
+  uint16_t rows[c_matrixSize];  // One row per matrix output, bit X connects matrix input X
+};
+
+namespace Routing {
+  /// @brief Check the sends and returns of a routing table, each loop that can't be routed is logged.
+  /// A loop whose send or return is out of the matrix, on a jack channel or shared with another loop
+  /// is bypassed when it is compiled.
+  /// @param t_loopSends Matrix output of each loop send
+  /// @param t_loopReturns Matrix input of each loop return
+  /// @return true if every loop can be routed
+  bool checkTable(const uint8_t* t_loopSends, const uint8_t* t_loopReturns);
+
+  /// @brief Compile the loop states and orders of a preset record, with the sends and returns of the
+  /// routing table, into the crosspoints of its series chain. A loop whose send or return is out of
+  /// the matrix, on a jack channel or already used by the chain is bypassed, `checkTable` reports
+  /// these loops once for the whole table.
+  /// @param t_record Preset record to route
+  /// @param t_loopSends Matrix output of each loop send
+  /// @param t_loopReturns Matrix input of each loop return
+  /// @param t_bitmap Bitmap to compile the crosspoints into
+  void compileRecord(const PresetRecordView& t_record, const uint8_t* t_loopSends, const uint8_t* t_loopReturns, RoutingBitmap& t_bitmap);
+} // namespace Routing
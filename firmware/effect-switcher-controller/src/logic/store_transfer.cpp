@@ -0,0 +1,331 @@
+#include "store_transfer.h"
+
+void StoreTransfer::receive() {
+  while (Serial.available() > 0) {
+    uint8_t data = Serial.read();
+
+    if (data == 0xF0) {
+      m_rxInFrame = true;
+      m_rxLength = 0;
+    }
+    else if (data >= 0xF8 || !m_rxInFrame) {
+      // Real-time messages may be sent inside a frame, other bytes out of a frame aren't for us
+    }
+    else if (data == 0xF7) {
+      m_rxInFrame = false;
+
+      if (m_rxLength < 7 || m_rxFrame[0] != c_transferManufacturerId) {
+        continue;
+      }
+
+      uint8_t fieldsEnd = m_rxLength - 3;
+      uint16_t crc = (uint16_t(m_rxFrame[fieldsEnd]) << 14) | (m_rxFrame[fieldsEnd + 1] << 7) | m_rxFrame[fieldsEnd + 2];
+
+      if (crc == Utils::crc16(m_rxFrame, fieldsEnd)) {
+        uint16_t sequence = (m_rxFrame[2] << 7) | m_rxFrame[3];
+        handleFrame(static_cast<TransferCommand>(m_rxFrame[1]), sequence, &m_rxFrame[4], fieldsEnd - 4);
+      }
+      else if (m_state == TransferState::kRestoring && !m_rejected) {
+        sendReply(TransferCommand::kNak, m_nextSequence);
+        m_rejected = true;
+      }
+    }
+    else if ((data & 0x80) || m_rxLength == c_transferFrameSize) {
+      // Any other status byte ends the frame
+      m_rxInFrame = false;
+    }
+    else {
+      m_rxFrame[m_rxLength++] = data;
+    }
+  }
+}
+
+void StoreTransfer::handleFrame(TransferCommand t_command, uint16_t t_sequence, const uint8_t* t_fields, uint8_t t_fieldsLength) {
+  switch (t_command) {
+    case TransferCommand::kDumpRequest:
+      if (m_state != TransferState::kRestoring) {
+        beginDump();
+      }
+      break;
+
+    case TransferCommand::kTraceRequest:
+      m_traceRequested = true;
+      break;
+
+    case TransferCommand::kAck:
+      if (m_state == TransferState::kDumping && t_sequence >= m_ackedSequence && t_sequence < m_nextSequence) {
+        m_ackedSequence = t_sequence + 1;
+        m_lastActivityTime = millis();
+        m_retries = 0;
+
+        if (m_ackedSequence == m_pagesCount + 2) {
+          m_memoryManager.endStoreDump();
+          setState(TransferState::kIdle);
+          LOG_INFO("Store dumped");
+        }
+      }
+      break;
+
+    case TransferCommand::kNak:
+      // Go back to the frame expected by the host
+      if (m_state == TransferState::kDumping && t_sequence >= m_ackedSequence && t_sequence <= m_nextSequence) {
+        m_ackedSequence = t_sequence;
+        m_nextSequence = t_sequence;
+        m_lastActivityTime = millis();
+      }
+      break;
+
+    case TransferCommand::kBegin: {
+      if (m_state == TransferState::kDumping) {
+        break;
+      }
+
+      uint16_t pagesCount = t_fieldsLength == 3 ? (t_fields[1] << 7) | t_fields[2] : 0;
+      if (t_sequence != 0 || t_fieldsLength != 3 || t_fields[0] != c_storeSchemaVersion ||
+        pagesCount > EEPROM_SIZE / EEPROM_PAGE_SIZE) {
+          LOG_ERROR("Store restore rejected, schema %d", t_fields[0]);
+          sendReply(TransferCommand::kNak, 0);
+          break;
+      }
+
+      // A restore started again by the host goes on over the pages already written, a staged
+      // image of another size is staged again
+      if (m_state == TransferState::kIdle || (m_restoreStaged && pagesCount != m_pagesCount)) {
+        m_restoreStaged = m_memoryManager.beginStoreRestore(pagesCount);
+      }
+
+      setState(TransferState::kRestoring);
+      m_pagesCount = pagesCount;
+      m_nextSequence = 1;
+      m_rejected = false;
+      m_lastActivityTime = millis();
+      sendReply(TransferCommand::kAck, 0);
+      break;
+    }
+
+    case TransferCommand::kPage:
+    case TransferCommand::kEnd:
+      if (m_state != TransferState::kRestoring) {
+        // The acknowledgment of the last frame may have been lost
+        if (m_state == TransferState::kIdle && t_command == TransferCommand::kEnd) {
+          sendReply(TransferCommand::kAck, t_sequence);
+        }
+        break;
+      }
+
+      m_lastActivityTime = millis();
+
+      if (t_sequence < m_nextSequence) {
+        // Sent again, its acknowledgment was lost
+        sendReply(TransferCommand::kAck, m_nextSequence - 1);
+      }
+      else if (t_sequence == m_nextSequence && restoreFrame(t_command, t_sequence, t_fields, t_fieldsLength)) {
+        sendReply(TransferCommand::kAck, t_sequence);
+        m_nextSequence++;
+        m_rejected = false;
+
+        // The staged image replaces the current store once its end is acknowledged
+        if (t_command == TransferCommand::kEnd) {
+          endRestore();
+        }
+      }
+      else if (!m_rejected) {
+        // The frames following a gap are dropped until the expected one is sent again
+        sendReply(TransferCommand::kNak, m_nextSequence);
+        m_rejected = true;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+bool StoreTransfer::restoreFrame(TransferCommand t_command, uint16_t t_sequence, const uint8_t* t_fields, uint8_t t_fieldsLength) {
+  if (t_command == TransferCommand::kEnd) {
+    return t_sequence == m_pagesCount + 1;
+  }
+
+  uint16_t page = (t_fields[0] << 7) | t_fields[1];
+  if (t_fieldsLength != 2 + c_transferPackedPageSize || t_sequence > m_pagesCount ||
+    page >= EEPROM_SIZE / EEPROM_PAGE_SIZE) {
+      return false;
+  }
+
+  // Unpack the groups of 7 bytes, each one follows the byte holding their high bits
+  uint8_t data[EEPROM_PAGE_SIZE];
+  const uint8_t* packed = &t_fields[2];
+  for (uint8_t i = 0; i < EEPROM_PAGE_SIZE; i += 7) {
+    uint8_t highBits = *packed++;
+
+    for (uint8_t j = 0; j < 7 && i + j < EEPROM_PAGE_SIZE; j++) {
+      data[i + j] = *packed++ | (bitRead(highBits, j) << 7);
+    }
+  }
+
+  return m_memoryManager.writeStorePage(page, data);
+}
+
+void StoreTransfer::sendDumpFrame() {
+  if (m_txOffset < m_txLength || m_nextSequence == m_pagesCount + 2 ||
+    m_nextSequence >= m_ackedSequence + c_transferWindow) {
+      return;
+  }
+
+  uint16_t sequence = m_nextSequence++;
+
+  if (sequence == 0) {
+    beginFrame(TransferCommand::kBegin, sequence);
+    m_txFrame[m_txLength++] = c_storeSchemaVersion;
+    appendNumber(m_pagesCount);
+  }
+  else if (sequence <= m_pagesCount) {
+    uint16_t page = m_memoryManager.getStoreImagePage(sequence - 1);
+    uint8_t data[EEPROM_PAGE_SIZE];
+    m_memoryManager.readStorePage(page, data);
+
+    beginFrame(TransferCommand::kPage, sequence);
+    appendNumber(page);
+
+    // Pack groups of 7 bytes, each one after a byte holding their high bits
+    for (uint8_t i = 0; i < EEPROM_PAGE_SIZE; i += 7) {
+      uint8_t& highBits = m_txFrame[m_txLength++];
+      highBits = 0;
+
+      for (uint8_t j = 0; j < 7 && i + j < EEPROM_PAGE_SIZE; j++) {
+        if (data[i + j] & 0x80) {
+          bitSet(highBits, j);
+        }
+        m_txFrame[m_txLength++] = data[i + j] & 0x7F;
+      }
+    }
+  }
+  else {
+    beginFrame(TransferCommand::kEnd, sequence);
+  }
+
+  endFrame();
+}
+
+void StoreTransfer::beginFrame(TransferCommand t_command, uint16_t t_sequence) {
+  // Replies may be needed while a frame is still being sent
+  if (m_txOffset < m_txLength) {
+    Serial.write(&m_txFrame[m_txOffset], m_txLength - m_txOffset);
+  }
+
+  m_txFrame[0] = 0xF0;
+  m_txFrame[1] = c_transferManufacturerId;
+  m_txFrame[2] = uint8_t(t_command);
+  m_txLength = 3;
+  m_txOffset = 0;
+  appendNumber(t_sequence);
+}
+
+void StoreTransfer::appendNumber(uint16_t t_value) {
+  m_txFrame[m_txLength++] = (t_value >> 7) & 0x7F;
+  m_txFrame[m_txLength++] = t_value & 0x7F;
+}
+
+void StoreTransfer::endFrame() {
+  uint16_t crc = Utils::crc16(&m_txFrame[1], m_txLength - 1);
+  m_txFrame[m_txLength++] = crc >> 14;
+  m_txFrame[m_txLength++] = (crc >> 7) & 0x7F;
+  m_txFrame[m_txLength++] = crc & 0x7F;
+  m_txFrame[m_txLength++] = 0xF7;
+
+  transmit();
+}
+
+void StoreTransfer::transmit() {
+  int room = Serial.availableForWrite();
+  uint8_t left = m_txLength - m_txOffset;
+
+  if (room > left) {
+    room = left;
+  }
+
+  if (room > 0) {
+    Serial.write(&m_txFrame[m_txOffset], room);
+    m_txOffset += room;
+  }
+}
+
+void StoreTransfer::sendReply(TransferCommand t_command, uint16_t t_sequence) {
+  beginFrame(t_command, t_sequence);
+  endFrame();
+}
+
+void StoreTransfer::beginDump() {
+  // Pending edits are part of the image
+  m_presetManager.flush();
+  m_memoryManager.beginStoreDump();
+
+  m_pagesCount = m_memoryManager.getStoreImagePagesCount();
+  m_nextSequence = 0;
+  m_ackedSequence = 0;
+  m_retries = 0;
+  m_lastActivityTime = millis();
+
+  LOG_INFO("Dumping the store, %u pages", m_pagesCount);
+  setState(TransferState::kDumping);
+}
+
+void StoreTransfer::endRestore() {
+  m_memoryManager.endStoreRestore();
+  m_presetManager.reload();
+  setState(TransferState::kIdle);
+  LOG_INFO("Store restored");
+}
+
+void StoreTransfer::abortRestore() {
+  if (!m_memoryManager.abortStoreRestore()) {
+    m_presetManager.reload();
+  }
+
+  setState(TransferState::kIdle);
+  LOG_ERROR("Store restore abandoned");
+}
+
+void StoreTransfer::setState(TransferState t_state) {
+  m_state = t_state;
+  setLogMuted(t_state != TransferState::kIdle);
+}
+
+void StoreTransfer::poll() {
+  receive();
+
+  uint32_t now = millis();
+
+  if (m_state == TransferState::kDumping) {
+    // Frames without acknowledgment are sent again
+    if (m_ackedSequence < m_nextSequence && now - m_lastActivityTime >= c_transferTimeout) {
+      m_nextSequence = m_ackedSequence;
+      m_lastActivityTime = now;
+
+      if (++m_retries > c_transferRetries) {
+        m_memoryManager.endStoreDump();
+        setState(TransferState::kIdle);
+        LOG_ERROR("Store dump abandoned");
+      }
+    }
+
+    if (m_state == TransferState::kDumping) {
+      sendDumpFrame();
+    }
+  }
+  else if (m_state == TransferState::kRestoring && now - m_lastActivityTime >= uint32_t(c_transferTimeout) * c_transferRetries) {
+    abortRestore();
+  }
+
+  transmit();
+
+  // The report text isn't framed, it must not cut a frame being sent
+  if (m_traceRequested && m_state == TransferState::kIdle && m_txOffset == m_txLength) {
+    m_traceRequested = false;
+    m_latencyTracer.report();
+  }
+}
+
+TransferState StoreTransfer::getState() const {
+  return m_state;
+}
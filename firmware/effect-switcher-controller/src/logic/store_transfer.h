@@ -0,0 +1,169 @@
+#pragma once
+
+#include <Arduino.h>
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+#include "utils/latency_tracer.h"
+
+/*
+ * Store Transfer Frame over the serial port
+ * The store image is streamed as SysEx frames, so the MIDI devices sharing the port ignore them.
+ * Every byte between the start and the end of a frame is 7-bit: page data is packed 7 bytes to 8,
+ * a byte holding their high bits followed by their low 7 bits. 14-bit numbers are sent high 7 bits
+ * first and the frame ends with a CRC-16 of its encoded bytes, on 2 + 7 + 7 bits.
+ *
+ * Byte Range       Field Name         Description                             Example Value
+ * -----------------------------------------------------------------------------------------
+ * 0                start              SysEx start                             0xF0
+ * 1                manufacturer       Non-commercial manufacturer ID          0x7D
+ * 2                command            TransferCommand                         0x03
+ * 3-4              sequence           Frame number in the transfer            12
+ *
+ * 5-...            fields             Depending on the command
+ *                   |                   - kBegin: schema, pagesCount (2)     (3 bytes)
+ *                   |                   - kPage: page (2), data (74)         (76 bytes)
+ *                   |                   - kEnd, kAck, kNak, kTraceRequest: none
+ *
+ * ...              crc                CRC-16 of bytes 1 to the last field     (3 bytes)
+ * last             end                SysEx end                               0xF7
+ *
+ * A transfer is a kBegin frame numbered 0, a kPage frame per page of the store image, then a kEnd
+ * frame. The host requests a dump with kDumpRequest, and a restore starts when the host sends
+ * kBegin. The receiver acknowledges each frame with a kAck carrying its number, a kAck also
+ * acknowledges the frames before it. A frame out of sequence or with a bad CRC is answered with
+ * a kNak carrying the number expected next, and the sender goes back to it, as it does when no
+ * kAck came for `c_transferTimeout`.
+ * The device keeps `c_transferWindow` dump frames in flight so the line stays busy while the host
+ * answers. Its receive buffer is smaller than a frame, so the host sends the next restore frame
+ * once the previous one is acknowledged, each page write is then done while the next one arrives.
+ * A restored image is staged beside the current one when it fits, the current store is kept until
+ * the kEnd frame is acknowledged and is then overwritten by the staged pages.
+ * No log text and no preset MIDI message is sent while a transfer is running.
+ * The host requests the footswitch latency report with kTraceRequest, it is printed as text once
+ * no transfer is running.
+ */
+constexpr uint8_t c_transferManufacturerId = 0x7D;
+constexpr uint8_t c_transferPackedPageSize = (EEPROM_PAGE_SIZE * 8 + 6) / 7;
+constexpr uint8_t c_transferFrameSize = 5 + 2 + c_transferPackedPageSize + 3 + 1;  // Largest frame, kPage
+constexpr uint8_t c_transferWindow = 4;      // Dump frames sent ahead of the acknowledgments
+constexpr uint16_t c_transferTimeout = 500;  // Time without acknowledgment (ms) before frames are sent again
+constexpr uint8_t c_transferRetries = 8;     // Timeouts in a row before a transfer is abandoned
+
+/// @brief Store transfer frame commands
+enum class TransferCommand : uint8_t {
+  kDumpRequest = 0x01,
+  kBegin = 0x02,
+  kPage = 0x03,
+  kEnd = 0x04,
+  kAck = 0x05,
+  kNak = 0x06,
+  kTraceRequest = 0x07
+};
+
+/// @brief Store transfer states
+enum class TransferState : uint8_t {
+  kIdle,
+  kDumping,
+  kRestoring
+};
+
+/// @brief Dump and restore of the whole store over the serial port, page by page,
+/// without blocking the main loop
+class StoreTransfer {
+  private:
+    MemoryManager& m_memoryManager;
+    PresetManager& m_presetManager;
+    LatencyTracer& m_latencyTracer;
+
+    TransferState m_state = TransferState::kIdle;
+    uint16_t m_pagesCount = 0;     // Pages of the image being transferred
+    uint16_t m_nextSequence = 0;   // Next frame to send when dumping, to receive when restoring
+    uint16_t m_ackedSequence = 0;  // First dump frame not acknowledged yet
+    uint32_t m_lastActivityTime = 0;  // Time of the last frame received
+    uint8_t m_retries = 0;            // Timeouts in a row
+    bool m_rejected = false;          // A kNak was sent for the restore frame expected next
+    bool m_restoreStaged = false;     // The restored image is staged, the current store is kept until its end
+    bool m_traceRequested = false;    // The latency report is printed once the transfer is done
+
+    // Frame being received, without its start and end
+    uint8_t m_rxFrame[c_transferFrameSize];
+    uint8_t m_rxLength = 0;
+    bool m_rxInFrame = false;
+
+    // Frame being sent
+    uint8_t m_txFrame[c_transferFrameSize];
+    uint8_t m_txLength = 0;
+    uint8_t m_txOffset = 0;
+
+    /// @brief Read the received bytes and handle each complete frame
+    void receive();
+
+    /// @brief Handle a complete frame with a valid CRC
+    /// @param t_command Frame command
+    /// @param t_sequence Frame number
+    /// @param t_fields Frame fields
+    /// @param t_fieldsLength Length of the fields
+    void handleFrame(TransferCommand t_command, uint16_t t_sequence, const uint8_t* t_fields, uint8_t t_fieldsLength);
+
+    /// @brief Handle a frame of the image being restored
+    /// @param t_command Frame command
+    /// @param t_sequence Frame number
+    /// @param t_fields Frame fields
+    /// @param t_fieldsLength Length of the fields
+    /// @return true if the frame was accepted
+    bool restoreFrame(TransferCommand t_command, uint16_t t_sequence, const uint8_t* t_fields, uint8_t t_fieldsLength);
+
+    /// @brief Send the next dump frame if the window and the serial port allow it
+    void sendDumpFrame();
+
+    /// @brief Start a frame, the previous one is sent first
+    /// @param t_command Frame command
+    /// @param t_sequence Frame number
+    void beginFrame(TransferCommand t_command, uint16_t t_sequence);
+
+    /// @brief Append a 14-bit number to the frame being built
+    /// @param t_value Number
+    void appendNumber(uint16_t t_value);
+
+    /// @brief Append the CRC and the end of the frame being built and start sending it
+    void endFrame();
+
+    /// @brief Send as much of the current frame as the serial port takes without blocking
+    void transmit();
+
+    /// @brief Send an acknowledgment or a rejection
+    /// @param t_command kAck or kNak
+    /// @param t_sequence Frame number
+    void sendReply(TransferCommand t_command, uint16_t t_sequence);
+
+    /// @brief Start dumping the store image
+    void beginDump();
+
+    /// @brief Finish the restore, the store is reopened and the presets are reloaded
+    void endRestore();
+
+    /// @brief Give up the restore, the presets are reloaded unless the current store was kept
+    void abortRestore();
+
+    /// @brief Change the transfer state, the log is muted while a transfer is running
+    /// @param t_state New state
+    void setState(TransferState t_state);
+
+  public:
+    /// @brief Constructor
+    /// @param t_memoryManager Reference to the MemoryManager object
+    /// @param t_presetManager Reference to the PresetManager object, reloaded after a restore
+    /// @param t_latencyTracer Reference to the LatencyTracer object, reported on request
+    StoreTransfer(MemoryManager& t_memoryManager, PresetManager& t_presetManager, LatencyTracer& t_latencyTracer) :
+      m_memoryManager(t_memoryManager),
+      m_presetManager(t_presetManager),
+      m_latencyTracer(t_latencyTracer) { }
+
+    /// @brief Handle the received frames, send the pending ones and check the timeouts,
+    /// called from the main loop
+    void poll();
+
+    /// @brief Get the transfer state
+    /// @return TransferState Current state
+    TransferState getState() const;
+};
@@ -1,59 +1,58 @@
-#include <SPI.h>
-
 #include "eeprom.h"
 
 void Eeprom::setup() {
-  pinMode(m_csPin, OUTPUT);
-  digitalWrite(m_csPin, HIGH);
-  SPI.begin();
+  m_bus.begin();
 
   uint8_t statusRegister = readStatusRegister();
 
-    // SRWD is set
-  if ((statusRegister & B10000000) == 1 ||
-    // BP1 is set
-    (statusRegister & B00001000) == 1 ||
-    // BP0 is set
-    (statusRegister & B00000100) == 1) {
-      writeStatusRegister(); // Reset the status register
-    }
+  // SRWD, BP1 or BP0 is set, protected blocks would silently ignore writes
+  if (statusRegister & (EEPROM_STATUS_SRWD | EEPROM_STATUS_BP)) {
+    writeStatusRegister(); // Reset the status register
+  }
+}
+
+const EepromStats& Eeprom::getStats() const {
+  return m_stats;
+}
+
+void Eeprom::resetStats() {
+  m_stats = EepromStats();
 }
 
 void Eeprom::select() {
-  SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
-  digitalWrite(m_csPin, LOW);
+  m_bus.select();
+  m_stats.transactions++;
 }
 
 void Eeprom::deselect() {
-  digitalWrite(m_csPin, HIGH);
-  SPI.endTransaction();
+  m_bus.deselect();
 }
 
 void Eeprom::enableWrite() {
   select();
-  SPI.transfer(EEPROM_WREN);
+  transfer(EEPROM_WREN);
   deselect();
 }
 
 void Eeprom::sendAddress(uint16_t t_address) {
-  SPI.transfer(highByte(t_address));
-  SPI.transfer(lowByte(t_address));
+  transfer(highByte(t_address));
+  transfer(lowByte(t_address));
 }
 
 void Eeprom::writeStatusRegister() {
-  while (isWip()) {}
+  flush();
 
   enableWrite();
   select();
-  SPI.transfer(EEPROM_WRSR);
-  SPI.transfer(0);  // Reset status register to default
+  transfer(EEPROM_WRSR);
+  transfer(0);  // Reset status register to default
   deselect();
 }
 
 uint8_t Eeprom::readStatusRegister() {
   select();
-  SPI.transfer(EEPROM_RDSR);
-  uint8_t data = SPI.transfer(0x00);
+  transfer(EEPROM_RDSR);
+  uint8_t data = transfer(0x00);
   deselect();
 
   return data;
@@ -62,50 +61,49 @@ uint8_t Eeprom::readStatusRegister() {
 bool Eeprom::isWip() {
   uint8_t status = readStatusRegister();
 
-  return (status & 0x01);
+  return (status & EEPROM_STATUS_WIP);
 }
 
-uint8_t Eeprom::readInt8(uint16_t t_address) {
+void Eeprom::waitForWriteCycle() {
+  uint32_t start = micros();
   while (isWip()) {}
+  m_stats.wipWaitTime += micros() - start;
+}
+
+uint8_t Eeprom::readInt8(uint16_t t_address) {
+  flush();
 
   select();
-  SPI.transfer(EEPROM_READ);
+  transfer(EEPROM_READ);
   sendAddress(t_address);
-  uint8_t data = SPI.transfer(0x00);
+  uint8_t data = transfer(0x00);
   deselect();
 
   return data;
 }
 
 void Eeprom::readInt8(uint16_t t_address, uint8_t* t_data) {
-  while (isWip()) {}
+  flush();
 
   select();
-  SPI.transfer(EEPROM_READ);
+  transfer(EEPROM_READ);
   sendAddress(t_address);
-  *t_data = SPI.transfer(0x00);
+  *t_data = transfer(0x00);
   deselect();
 }
 
 void Eeprom::writeInt8(uint16_t t_address, uint8_t t_data) {
-  while (isWip()) {}
-
-  enableWrite();
-  select();
-  SPI.transfer(EEPROM_WRITE);
-  sendAddress(t_address);
-  SPI.transfer(t_data);
-  deselect();
+  writeArray(t_address, &t_data, 1);
 }
 
 uint16_t Eeprom::readInt16(uint16_t t_address) {
-  while (isWip()) {}
+  flush();
 
   select();
-  SPI.transfer(EEPROM_READ);
+  transfer(EEPROM_READ);
   sendAddress(t_address);
-  uint8_t highbyte = SPI.transfer(0x00);
-  uint8_t lowbyte = SPI.transfer(0x00);
+  uint8_t highbyte = transfer(0x00);
+  uint8_t lowbyte = transfer(0x00);
   deselect();
 
   uint16_t result = (highbyte << 8) | lowbyte;
@@ -113,25 +111,102 @@ uint16_t Eeprom::readInt16(uint16_t t_address) {
 }
 
 void Eeprom::writeInt16(uint16_t t_address, uint16_t t_data) {
-  while (isWip()) {}
+  uint8_t data[2] = { highByte(t_data), lowByte(t_data) };
+
+  writeArray(t_address, data, 2);
+}
+
+void Eeprom::beginRead(uint16_t t_address) {
+  flush();
 
-  enableWrite();
   select();
-  SPI.transfer(EEPROM_WRITE);
+  transfer(EEPROM_READ);
   sendAddress(t_address);
-  SPI.transfer(t_data >> 8);
-  SPI.transfer(t_data & 0xFF);
+}
+
+void Eeprom::readNext(uint8_t* t_data, uint16_t t_length) {
+  // The address counter is incremented by the EEPROM after each byte
+  for (uint16_t i = 0; i < t_length; i++) {
+    t_data[i] = transfer(0x00);
+  }
+}
+
+void Eeprom::endRead() {
   deselect();
 }
 
-void Eeprom::readArray(uint16_t t_address, uint8_t* t_data, uint8_t t_length) {
+void Eeprom::readArray(uint16_t t_address, uint8_t* t_data, uint16_t t_length) {
+  beginRead(t_address);
+  readNext(t_data, t_length);
+  endRead();
+}
+
+void Eeprom::writePage(uint16_t t_address, const uint8_t* t_data, uint8_t t_length) {
+  waitForWriteCycle();
+  m_stats.writeCycles++;
+
+  enableWrite();
+  select();
+  transfer(EEPROM_WRITE);
+  sendAddress(t_address);
   for (uint8_t i = 0; i < t_length; i++) {
-    t_data[i] = readInt8(t_address + i);
+    transfer(t_data[i]);
   }
+  deselect();
 }
 
-void Eeprom::writeArray(uint16_t t_address, uint8_t* t_data, uint8_t t_length) {
-  for (uint8_t i = 0; i < t_length; i++) {
-    writeInt8(t_address + i, t_data[i]);
+void Eeprom::issueQueuedWrite() {
+  EepromWriteJob& job = m_writeQueue[m_writeQueueHead];
+  writePage(job.address, job.data, job.length);
+
+  m_writeQueueHead = (m_writeQueueHead + 1) % EEPROM_WRITE_QUEUE_SIZE;
+  m_writeQueueCount--;
+}
+
+void Eeprom::queueWrite(uint16_t t_address, const uint8_t* t_data, uint16_t t_length) {
+  while (t_length > 0) {
+    // Bytes left before the end of the current page
+    uint16_t chunk = EEPROM_PAGE_SIZE - (t_address % EEPROM_PAGE_SIZE);
+    if (chunk > t_length) {
+      chunk = t_length;
+    }
+
+    // Make room by sending the oldest write
+    if (m_writeQueueCount == EEPROM_WRITE_QUEUE_SIZE) {
+      issueQueuedWrite();
+    }
+
+    EepromWriteJob& job = m_writeQueue[(m_writeQueueHead + m_writeQueueCount) % EEPROM_WRITE_QUEUE_SIZE];
+    job.address = t_address;
+    job.length = chunk;
+    memcpy(job.data, t_data, chunk);
+    m_writeQueueCount++;
+
+    t_address += chunk;
+    t_data += chunk;
+    t_length -= chunk;
+  }
+}
+
+void Eeprom::poll() {
+  if (m_writeQueueCount > 0 && !isWip()) {
+    issueQueuedWrite();
+  }
+}
+
+void Eeprom::flush() {
+  while (m_writeQueueCount > 0) {
+    issueQueuedWrite();
   }
+
+  waitForWriteCycle();
+}
+
+bool Eeprom::isIdle() {
+  return m_writeQueueCount == 0 && !isWip();
+}
+
+void Eeprom::writeArray(uint16_t t_address, const uint8_t* t_data, uint16_t t_length) {
+  queueWrite(t_address, t_data, t_length);
+  flush();
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Arduino.h>
+#include "peripherals/spi_bus.h"
 
 /// EEPROM SPI Instructions
 constexpr uint8_t EEPROM_READ = B00000011;
@@ -10,22 +11,63 @@ constexpr uint8_t EEPROM_WRDI = B00000100;
 constexpr uint8_t EEPROM_RDSR = B00000101;
 constexpr uint8_t EEPROM_WRSR = B00000001;
 
+/// EEPROM geometry
+constexpr uint8_t EEPROM_PAGE_SIZE = 64;  // A WRITE instruction wraps around inside a 64-byte page
+constexpr uint16_t EEPROM_SIZE = 32768;   // 256 Kbit
+
+/// Number of page writes that can wait in the write queue, enough for a journaled preset save
+constexpr uint8_t EEPROM_WRITE_QUEUE_SIZE = 10;
+
+/// Status register bits
+constexpr uint8_t EEPROM_STATUS_WIP = B00000001;   // Write cycle in progress
+constexpr uint8_t EEPROM_STATUS_BP = B00001100;    // Block protect bits BP1 and BP0
+constexpr uint8_t EEPROM_STATUS_SRWD = B10000000;  // Status register write disable
+
+/// @brief SPI bus activity of the EEPROM, to measure the storage operations on the target
+struct EepromStats {
+  uint32_t transactions = 0;  // Chip selects, each one an instruction
+  uint32_t bytes = 0;         // Bytes clocked on the bus, instructions and addresses included
+  uint16_t writeCycles = 0;   // WRITE instructions, each one starts an internal write cycle
+  uint32_t wipWaitTime = 0;   // Time (us) spent waiting for write cycles to complete
+};
+
+/// @brief A page write waiting in the queue to be sent to the EEPROM
+struct EepromWriteJob {
+  uint16_t address;
+  uint8_t length;
+  uint8_t data[EEPROM_PAGE_SIZE];
+};
+
 /**
  * @brief Interface for a serial EEPROM (M95256), supports read/write of various data types.
  */
 class Eeprom {
   private:
-    uint8_t m_csPin;  // CS pin #
+    SpiBus m_bus;  // SPI link to the chip
+
+    EepromWriteJob m_writeQueue[EEPROM_WRITE_QUEUE_SIZE];
+    uint8_t m_writeQueueHead = 0;   // Index of the oldest queued write
+    uint8_t m_writeQueueCount = 0;  // Number of queued writes
+
+    EepromStats m_stats;
 
-    /// @brief Setup the SPI bus and select the chip
+    /// @brief Select the chip and count the transaction
     void select();
 
-    /// @brief Deselect the chip and close the SPI bus
+    /// @brief Deselect the chip
     void deselect();
 
     /// @brief Select the chip, send the WREN instruction, and deselect
     void enableWrite();
 
+    /// @brief Send a byte on the SPI bus and count it
+    /// @param t_data Byte to send
+    /// @return uint8_t Byte received
+    uint8_t transfer(uint8_t t_data) {
+      m_stats.bytes++;
+      return m_bus.transfer(t_data);
+    }
+
     /// @brief Selects the memory address to write or read
     /// @param t_address Address to select
     void sendAddress(uint16_t t_address);
@@ -34,11 +76,24 @@ class Eeprom {
     /// @return true if a read/write is still in progress, false otherwise
     bool isWip();
 
+    /// @brief Wait until the current write cycle completes
+    void waitForWriteCycle();
+
+    /// @brief Write up to a page of data with a single WRITE instruction
+    /// @param t_address Memory address to write to, the data must not cross a page boundary
+    /// @param t_data Pointer to the data to write
+    /// @param t_length Length of the data, at most `EEPROM_PAGE_SIZE`
+    void writePage(uint16_t t_address, const uint8_t* t_data, uint8_t t_length);
+
+    /// @brief Send the oldest queued write to the EEPROM and remove it from the queue,
+    /// waits for the previous write cycle to complete
+    void issueQueuedWrite();
+
   public:
     /// @brief Construct a new Eeprom object
     /// @param t_cspin CS pin #
     Eeprom(uint8_t t_cspin) :
-      m_csPin(t_cspin) { };
+      m_bus(t_cspin) { };
 
     /// @brief Return the status register
     /// @return uint8_t Status register value
@@ -47,9 +102,35 @@ class Eeprom {
     /// @brief Reset the status register to its initial value `b00000010`
     void writeStatusRegister();
 
-    /// @brief Setup the micro controller pins and start the SPI bus
+    /// @brief Setup the micro controller pins and start the SPI bus, the write protection
+    /// is cleared if it was set
     void setup();
 
+    /// @brief Get the bus activity since the last `resetStats`
+    /// @return const EepromStats& Bus activity
+    const EepromStats& getStats() const;
+
+    /// @brief Reset the bus activity counters
+    void resetStats();
+
+    /// @brief Queue a write and return without waiting, the data is copied and split on
+    /// page boundaries. Blocks only while the queue is full.
+    /// @param t_address Memory address to write to
+    /// @param t_data Pointer to the data to write
+    /// @param t_length Length of the data
+    void queueWrite(uint16_t t_address, const uint8_t* t_data, uint16_t t_length);
+
+    /// @brief Advance the write queue without blocking, sends at most one page
+    /// if the EEPROM is done with the previous write cycle. Called from the main loop.
+    void poll();
+
+    /// @brief Send all queued writes and wait until the last write cycle completes
+    void flush();
+
+    /// @brief Check if the write queue is empty and no write cycle is in progress
+    /// @return true if all the queued writes are stored
+    bool isIdle();
+
     /// @brief Read an 8-bit value from the selected memory address
     /// @param t_address Memory address to read from
     /// @return uint8_t 8-bit value read from the EEPROM
@@ -75,16 +156,32 @@ class Eeprom {
     /// @param t_data 16-bit value to write
     void writeInt16(uint16_t t_address, uint16_t t_data);
 
+    /// @brief Start a sequential read, the address is sent once and the following
+    /// bytes are clocked out with `readNext` until `endRead` is called
+    /// @param t_address Memory address to start reading from
+    void beginRead(uint16_t t_address);
+
+    /// @brief Clock out the next bytes of a sequential read
+    /// @param t_data Pointer to store the data
+    /// @param t_length Number of bytes to read
+    void readNext(uint8_t* t_data, uint16_t t_length);
+
+    /// @brief Terminate a sequential read and release the chip
+    void endRead();
+
     /// @brief Read an array of 8-bit integers starting at the selected memory address
+    /// with a single READ instruction
     /// @param t_address Memory address to read from
     /// @param t_data Pointer to store the array of data
     /// @param t_length Length of the data array
-    void readArray(uint16_t t_address, uint8_t* t_data, uint8_t t_length);
+    void readArray(uint16_t t_address, uint8_t* t_data, uint16_t t_length);
 
-    /// @brief Write an array of 8-bit integers starting at the selected memory address
+    /// @brief Write an array of 8-bit integers starting at the selected memory address,
+    /// the data is split on page boundaries and each page is sent as one WRITE instruction.
+    /// Waits until the data is stored.
     /// @param t_address Memory address to write to
     /// @param t_data Pointer to the array of data to write
     /// @param t_length Length of the data array
-    void writeArray(uint16_t t_address, uint8_t* t_data, uint8_t t_length);
+    void writeArray(uint16_t t_address, const uint8_t* t_data, uint16_t t_length);
 };
 
@@ -0,0 +1,23 @@
+#include <SPI.h>
+
+#include "spi_bus.h"
+
+void SpiBus::begin() {
+  pinMode(m_csPin, OUTPUT);
+  digitalWrite(m_csPin, HIGH);
+  SPI.begin();
+}
+
+void SpiBus::select() {
+  SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(m_csPin, LOW);
+}
+
+void SpiBus::deselect() {
+  digitalWrite(m_csPin, HIGH);
+  SPI.endTransaction();
+}
+
+uint8_t SpiBus::transfer(uint8_t t_data) {
+  return SPI.transfer(t_data);
+}
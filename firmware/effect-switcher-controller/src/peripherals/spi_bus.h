@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Arduino.h>
+
+/// @brief SPI link to one chip select line. The target build drives the hardware SPI bus, the
+/// native build links a simulated device behind the same interface.
+class SpiBus {
+  private:
+    uint8_t m_csPin;  // CS pin #
+
+  public:
+    /// @brief Construct a new SpiBus object
+    /// @param t_csPin CS pin #
+    SpiBus(uint8_t t_csPin) :
+      m_csPin(t_csPin) { };
+
+    /// @brief Setup the CS pin, released, and start the SPI bus
+    void begin();
+
+    /// @brief Setup the SPI bus and select the chip
+    void select();
+
+    /// @brief Deselect the chip and close the SPI bus
+    void deselect();
+
+    /// @brief Send a byte and receive one
+    /// @param t_data Byte to send
+    /// @return uint8_t Byte received
+    uint8_t transfer(uint8_t t_data);
+};
@@ -15,6 +15,12 @@ void MomentarySwitch::poll() {
   if (m_switchState != m_lastSwitchState) {
     // Reset the debounce timer
     m_lastDebounceTime = m_now;
+
+    // Latency is measured from the first edge, not from the last bounce
+    if (!m_edgePending) {
+      m_edgeTime = micros();
+      m_edgePending = true;
+    }
   }
 
   if ((m_now - m_lastDebounceTime) > m_debouncePeriod) {
@@ -51,6 +57,9 @@ void MomentarySwitch::poll() {
         LOG_DEBUG("Switch pin %d : long press", m_pin);
       }
     }
+
+    // The reading is stable, the next edge starts a new change
+    m_edgePending = false;
   }
 
   // Save the reading for next time
@@ -77,6 +86,10 @@ bool MomentarySwitch::isLongPress() const {
   return m_tempSwitchLongPress;
 }
 
+uint32_t MomentarySwitch::getEdgeTime() const {
+  return m_edgeTime;
+}
+
 void MomentarySwitch::reset() {
   m_tempSwitchSwitched = false;
   m_tempSwitchLongPress = false;
@@ -16,6 +16,8 @@ class MomentarySwitch {
     uint32_t m_now = 0;
     uint32_t m_lastDebounceTime = 0;
     uint32_t m_lastPushedTime = 0;
+    uint32_t m_edgeTime = 0;       // Time (us) of the first edge of the last change, before debouncing
+    bool m_edgePending = false;    // A change is being debounced
     uint16_t m_longPressPeriod;
     uint8_t m_debouncePeriod;
 
@@ -58,6 +60,10 @@ class MomentarySwitch {
     /// @brief Check if the switch has been held down for a long press
     bool isLongPress() const;
 
+    /// @brief Get the time of the first edge of the last change, bounces and debouncing excluded
+    /// @return uint32_t Time (us)
+    uint32_t getEdgeTime() const;
+
     /// @brief Reset the temporary state flags (switched, long press)
     void reset();
 };
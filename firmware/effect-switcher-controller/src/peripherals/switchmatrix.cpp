@@ -1,5 +1,3 @@
-#define DEBUG 1
-
 #include "switchmatrix.h"
 
 void SwitchMatrix::select()
@@ -23,16 +21,33 @@ void SwitchMatrix::switchMatrixSetup()
     SPI.begin();
 }
 
+void SwitchMatrix::resetSwitchMatrix()
+{
+    for (uint8_t y = 0; y < 16; y++)
+    {
+        if (m_switchArray[y] != 0)
+        {
+            m_switchArray[y] = 0;
+            bitSet(m_changedRows, y);
+        }
+    }
+}
+
 void SwitchMatrix::setSwitchArray(uint8_t y, uint8_t x, uint8_t value)
 {
-    #ifdef DEBUG
+    // Define SWITCHMATRIX_DEBUG in the build flags to trace the crosspoints
+    #ifdef SWITCHMATRIX_DEBUG
         Serial.print("Connecting Y : ");
         Serial.print(y);
         Serial.print(" to X : ");
         Serial.println(x);
     #endif
 
-    bitWrite(m_switchArray[y], x, value);
+    if (bitRead(m_switchArray[y], x) != (value != 0))
+    {
+        bitWrite(m_switchArray[y], x, value);
+        bitSet(m_changedRows, y);
+    }
 }
 
 uint8_t SwitchMatrix::getSwitchArray(uint8_t y, uint8_t x)
@@ -40,8 +55,30 @@ uint8_t SwitchMatrix::getSwitchArray(uint8_t y, uint8_t x)
     return bitRead(m_switchArray[y], x);
 }
 
-void SwitchMatrix::sendSwitchArray()
+void SwitchMatrix::setSwitchArray(const uint16_t* rows)
+{
+    for (uint8_t y = 0; y < 16; y++)
+    {
+        if (m_switchArray[y] != rows[y])
+        {
+            m_switchArray[y] = rows[y];
+            bitSet(m_changedRows, y);
+        }
+    }
+}
+
+bool SwitchMatrix::isChanged() const
+{
+    return m_changedRows != 0;
+}
+
+bool SwitchMatrix::sendSwitchArray()
 {
+    if (m_changedRows == 0)
+    {
+        return false;
+    }
+
     select();
 
     for (int y = 15; y >= 0; y--) // Rows
@@ -50,4 +87,8 @@ void SwitchMatrix::sendSwitchArray()
     }
 
     deselect();
-}
\ No newline at end of file
+
+    m_changedRows = 0;
+
+    return true;
+}
@@ -12,12 +12,19 @@ class SwitchMatrix
 
         uint16_t m_switchArray[16] = { 0 }; // array[y]
 
+        // Rows changed since the last send, all of them until the first send sets the chip
+        uint16_t m_changedRows = 0xFFFF;
+
         void select();
         void deselect();
     public:
         SwitchMatrix(uint8_t pin) : m_csPin(pin) {}
 
         void switchMatrixSetup();
+
+        /**
+         * @brief Open all the crosspoints, sent by the next sendSwitchArray
+         */
         void resetSwitchMatrix();
 
         /**
@@ -29,7 +36,28 @@ class SwitchMatrix
          */
         void setSwitchArray(uint8_t y, uint8_t x, uint8_t value);
         uint8_t getSwitchArray(uint8_t y, uint8_t x);
-        void sendSwitchArray();
+
+        /**
+         * @brief Set all the crosspoints at once, only the rows that differ are marked changed
+         *
+         * @param rows 16 rows, bit X of row Y connects X to Y
+         */
+        void setSwitchArray(const uint16_t* rows);
+
+        /**
+         * @brief Check if some rows changed since the last send
+         *
+         * @return true if the chip doesn't hold the switch array
+         */
+        bool isChanged() const;
+
+        /**
+         * @brief Send the switch array if it changed since the last send. The rows are shifted
+         * through the chip and latched together, so a change of any row sends all of them.
+         *
+         * @return true if the switch array was sent
+         */
+        bool sendSwitchArray();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,87 @@
+#include "latency_tracer.h"
+
+static const char* const c_traceStageNames[c_traceStagesCount] = {"Detected", "Latched", "MIDI", "Unmuted", "Displayed"};
+
+void LatencyTracer::begin(uint32_t t_edgeTime) {
+  if (m_active) {
+    m_droppedCount++;
+  }
+
+  m_active = true;
+  m_edgeTime = t_edgeTime;
+  m_markedStages = 0;
+  mark(TraceStage::kDetected);
+}
+
+void LatencyTracer::mark(TraceStage t_stage) {
+  uint8_t stage = static_cast<uint8_t>(t_stage);
+
+  if (!m_active || bitRead(m_markedStages, stage)) {
+    return;
+  }
+
+  m_current.times[stage] = micros() - m_edgeTime;
+  bitSet(m_markedStages, stage);
+
+  if (m_markedStages == (1 << c_traceStagesCount) - 1) {
+    m_records[m_nextRecord] = m_current;
+    m_nextRecord = (m_nextRecord + 1) % c_traceRecordsCount;
+    if (m_recordsCount < c_traceRecordsCount) {
+      m_recordsCount++;
+    }
+    m_tracesCount++;
+    m_active = false;
+  }
+}
+
+void LatencyTracer::reportStage(TraceStage t_stage) const {
+  uint8_t stage = static_cast<uint8_t>(t_stage);
+  uint32_t times[c_traceRecordsCount];
+  uint32_t sum = 0;
+
+  // Insertion sort, the ring is small
+  for (uint8_t i = 0; i < m_recordsCount; i++) {
+    uint32_t time = m_records[i].times[stage];
+    uint8_t j = i;
+
+    for (; j > 0 && times[j - 1] > time; j--) {
+      times[j] = times[j - 1];
+    }
+
+    times[j] = time;
+    sum += time;
+  }
+
+  // Nearest rank, the p99 of fewer than 100 traces is their max
+  uint8_t p99 = (uint16_t(m_recordsCount) * 99 + 99) / 100 - 1;
+
+  char text[80];
+  snprintf(text, sizeof(text), "%-9s min %lu avg %lu max %lu p99 %lu us",
+    c_traceStageNames[stage], (unsigned long)times[0], (unsigned long)(sum / m_recordsCount),
+    (unsigned long)times[m_recordsCount - 1], (unsigned long)times[p99]);
+  Serial.println(text);
+}
+
+void LatencyTracer::report() const {
+  // Printed without the logging macros, they may be compiled out
+  char text[96];
+  snprintf(text, sizeof(text), "Latency from the footswitch edge, last %u of %lu traces, %lu dropped",
+    m_recordsCount, (unsigned long)m_tracesCount, (unsigned long)m_droppedCount);
+  Serial.println(text);
+
+  if (m_recordsCount == 0) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < c_traceStagesCount; i++) {
+    reportStage(static_cast<TraceStage>(i));
+  }
+}
+
+void LatencyTracer::reset() {
+  m_nextRecord = 0;
+  m_recordsCount = 0;
+  m_tracesCount = 0;
+  m_droppedCount = 0;
+  m_active = false;
+}
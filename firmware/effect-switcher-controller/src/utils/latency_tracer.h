@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+/// @brief Stages of a footswitch press, timestamped from the first edge of the switch
+enum class TraceStage : uint8_t {
+  kDetected,   // Debounced press handled by the main loop
+  kLatched,    // Matrix rows of the new preset sent
+  kMidiSent,   // Preset MIDI messages sent
+  kUnmuted,    // Output jack connected to the new chain, the preset is heard
+  kDisplayed,  // Home screen redrawn with the new preset
+  kCount
+};
+
+constexpr uint8_t c_traceStagesCount = static_cast<uint8_t>(TraceStage::kCount);
+constexpr uint8_t c_traceRecordsCount = 32;  // Last traces kept for the report
+
+/// @brief Times (us) of the stages of a trace, from the first edge of the switch
+struct TraceRecord {
+  uint32_t times[c_traceStagesCount];
+};
+
+/// @brief Footswitch to output latency tracing. A trace is started by a footswitch press, each stage
+/// stamps its `micros` time when it is reached and the trace is kept in a ring of the last
+/// `c_traceRecordsCount` once every stage is done. Marking a stage costs a `micros` call, the
+/// tracing stays on in release builds and the report is printed over the serial port on demand.
+class LatencyTracer {
+  private:
+    TraceRecord m_records[c_traceRecordsCount];
+    uint8_t m_nextRecord = 0;      // Ring slot of the next complete trace
+    uint8_t m_recordsCount = 0;    // Complete traces in the ring
+    uint32_t m_tracesCount = 0;    // Complete traces since boot
+    uint32_t m_droppedCount = 0;   // Traces replaced by a press before all their stages were done
+
+    bool m_active = false;         // A trace is started
+    uint32_t m_edgeTime = 0;       // Time (us) of the first edge of the switch
+    uint8_t m_markedStages = 0;    // One bit per stage reached by the current trace
+    TraceRecord m_current;         // Trace being stamped
+
+    /// @brief Print the statistics of a stage over the traces in the ring
+    /// @param t_stage Stage
+    void reportStage(TraceStage t_stage) const;
+
+  public:
+    /// @brief Start a trace, the detected stage is stamped. A trace not complete yet is dropped.
+    /// @param t_edgeTime Time (us) of the first edge of the switch
+    void begin(uint32_t t_edgeTime);
+
+    /// @brief Stamp a stage of the current trace, ignored when no trace is started or the stage
+    /// is already stamped
+    /// @param t_stage Stage reached
+    void mark(TraceStage t_stage);
+
+    /// @brief Print the count, min, avg, max and p99 latency of each stage over the serial port
+    void report() const;
+
+    /// @brief Forget the traces
+    void reset();
+};
@@ -1,7 +1,17 @@
 #include "logging.h"
 #include <stdarg.h>  // Required for handling variable arguments (va_list)
 
+static bool logMuted = false;  // Messages are dropped
+
+void setLogMuted(bool muted) {
+  logMuted = muted;
+}
+
 void logMessage(const char *level, const char *format, ...) {
+  if (logMuted) {
+    return;
+  }
+
   // Start UART transmission with the log level
   Serial.print("[");
   Serial.print(level);
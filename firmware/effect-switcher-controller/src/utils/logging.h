@@ -15,6 +15,9 @@
 // Generic log function (handles formatted strings)
 void logMessage(const char *level, const char *format, ...);
 
+// Drop the log messages while the UART carries binary frames that text would corrupt
+void setLogMuted(bool muted);
+
 // Logging Macros
 #if CURRENT_LOG_LEVEL >= LOG_LEVEL_DEBUG
   #define LOG_DEBUG(format, ...) logMessage("DEBUG", format, ##__VA_ARGS__)
@@ -19,4 +19,44 @@ namespace Utils {
 
     return buffer;
   }
+
+  uint8_t crc8(const uint8_t* data, uint16_t length) {
+    uint8_t crc = 0xFF;
+
+    for (uint16_t i = 0; i < length; i++) {
+      crc ^= data[i];
+
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+      }
+    }
+
+    return crc;
+  }
+
+  uint16_t crc16(const uint8_t* data, uint16_t length) {
+    uint16_t crc = 0xFFFF;
+
+    for (uint16_t i = 0; i < length; i++) {
+      crc ^= uint16_t(data[i]) << 8;
+
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+      }
+    }
+
+    return crc;
+  }
+
+  uint16_t fletcher16(const uint8_t* data, uint16_t length) {
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+
+    for (uint16_t i = 0; i < length; i++) {
+      sum1 = (sum1 + data[i]) % 255;
+      sum2 = (sum2 + sum1) % 255;
+    }
+
+    return (sum2 << 8) | sum1;
+  }
 }
\ No newline at end of file
@@ -2,4 +2,13 @@
 
 namespace Utils {
   const char* numberToString(uint8_t number);
+
+  // CRC-8, polynomial 0x07, initial value 0xFF
+  uint8_t crc8(const uint8_t* data, uint16_t length);
+
+  // CRC-16/CCITT, polynomial 0x1021, initial value 0xFFFF
+  uint16_t crc16(const uint8_t* data, uint16_t length);
+
+  // Fletcher-16, for data that already ends with its CRC-16 (a CRC-16 over it is always 0)
+  uint16_t fletcher16(const uint8_t* data, uint16_t length);
 } // namespace utils
@@ -0,0 +1,138 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+
+// Bank switches through the bank cache of the PresetManager
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_bank_switches(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+
+  // Back and forth between two banks, only the first visit of each reads storage
+  for (uint8_t i = 0; i < 10; i++) {
+    presetManager.setPresetBank(i % 2);
+    presetManager.completeBankLoad();
+    TEST_ASSERT_EQUAL_UINT8(i % 2, presetManager.getCurrentBank());
+  }
+
+  TEST_ASSERT_EQUAL_UINT16(2, presetManager.getCacheMisses());
+  TEST_ASSERT_EQUAL_UINT16(9, presetManager.getCacheHits());
+}
+
+void test_edits_kept_when_write_back_fails(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+
+  // An edit saved in RAM only
+  presetManager.getCurrentPreset()->setLoopsCount(4);
+  presetManager.toggleLoopState(2);
+  presetManager.saveCurrentPreset();
+
+  // Writes are refused during a store dump, the edited bank can't be written back
+  memoryManager.beginStoreDump();
+  for (uint8_t bank = 10; bank < 20; bank++) {
+    presetManager.setPresetBank(bank);
+    presetManager.completeBankLoad();
+  }
+  memoryManager.endStoreDump();
+
+  presetManager.flush();
+
+  Preset stored;
+  memoryManager.loadPreset(0, 0, stored);
+  TEST_ASSERT_EQUAL_UINT8(4, stored.getLoopsCount());
+  TEST_ASSERT_TRUE(stored.getLoopState(2));
+}
+
+void test_adjacent_banks_prefetched(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  TestSupport::pollFor(presetManager, memoryManager, 40);
+
+  // Both neighbours, wrapping around, are loaded in the background
+  presetManager.setPresetBankUp();
+  presetManager.setPresetBankDown();
+  presetManager.setPresetBankDown();
+  TEST_ASSERT_EQUAL_UINT8(c_maxPresetBanks - 1, presetManager.getCurrentBank());
+  TEST_ASSERT_EQUAL_UINT16(2, presetManager.getPrefetchHits());
+  TEST_ASSERT_EQUAL_UINT16(1, presetManager.getCacheMisses());
+}
+
+void test_saved_preset_written_back_from_poll(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  TestSupport::pollFor(presetManager, memoryManager, 40);
+
+  // An edit saved from the menus, the menus aren't left
+  presetManager.getCurrentPreset()->setLoopsCount(4);
+  presetManager.toggleLoopState(2);
+  presetManager.saveCurrentPreset();
+
+  // Held in RAM while the saves go on
+  Preset stored;
+  TestSupport::pollFor(presetManager, memoryManager, c_writeBackDelay / 2);
+  memoryManager.loadPreset(0, 0, stored);
+  TEST_ASSERT_EQUAL_UINT8(0, stored.getLoopsCount());
+
+  // Stored once they stop
+  TestSupport::pollFor(presetManager, memoryManager, c_writeBackDelay);
+  memoryManager.loadPreset(0, 0, stored);
+  TEST_ASSERT_EQUAL_UINT8(4, stored.getLoopsCount());
+  TEST_ASSERT_TRUE(stored.getLoopState(2));
+}
+
+void test_footswitch_preset_read_with_the_bank(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+
+  FootSwitchConfig footSwitch(FootSwitchMode::kPresetSelect);
+  footSwitch.setTargetPreset(3);
+  memoryManager.saveFootSwitchConfig(3, 2, footSwitch);
+  Preset preset(3, 3, 4, 0);
+  preset.setLoopState(1, true);
+  memoryManager.savePreset(3, 3, preset);
+  memoryManager.flush();
+
+  presetManager.setPresetBank(3);
+  presetManager.completeBankLoad();
+  TEST_ASSERT_EQUAL_UINT8(FootSwitchMode::kPresetSelect, presetManager.getFootSwitchMode(2));
+  TEST_ASSERT_EQUAL_UINT8(3, presetManager.getFootSwitchTargetPreset(2));
+
+  // Writes queued when the footswitch is pressed
+  Preset edited(0, 1, 6, 0);
+  memoryManager.savePreset(0, 1, edited);
+  TEST_ASSERT_FALSE(memoryManager.isIdle());
+
+  // The preset is switched to without waiting for them
+  uint32_t startTime = SimClock::now();
+  presetManager.setCurrentPreset(presetManager.getFootSwitchTargetPreset(2));
+  TEST_ASSERT_LESS_THAN_UINT32(M95256Model::c_writeTime, SimClock::now() - startTime);
+  TEST_ASSERT_FALSE(memoryManager.isIdle());
+
+  TEST_ASSERT_EQUAL_UINT8(4, presetManager.getCurrentPreset()->getLoopsCount());
+  TEST_ASSERT_TRUE(presetManager.getCurrentPreset()->getLoopState(1));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bank_switches);
+  RUN_TEST(test_edits_kept_when_write_back_fails);
+  RUN_TEST(test_adjacent_banks_prefetched);
+  RUN_TEST(test_saved_preset_written_back_from_poll);
+  RUN_TEST(test_footswitch_preset_read_with_the_bank);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+
+// Device state writes: the current bank and preset are stored once they stop changing
+
+static const uint8_t c_presetChanges = 50;
+static const uint32_t c_pressInterval = 150;  // Time (ms) between two footswitch presses
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_preset_changes_coalesced(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  TestSupport::pollFor(presetManager, memoryManager, c_deviceStateSaveDelay);
+  memoryManager.flush();
+
+  eepromModel.resetStats();
+  uint8_t bank = 0;
+  uint8_t presetIndex = 0;
+
+  for (uint8_t i = 0; i < c_presetChanges; i++) {
+    // A bank switch every 10 presses
+    if (i % 10 == 9) {
+      presetManager.setPresetBankUp();
+      bank = presetManager.getCurrentBank();
+    }
+
+    presetIndex = (presetIndex + 1) % c_maxPresetsPerBank;
+    uint32_t writeCycles = eepromModel.getStats().writeCycles;
+    presetManager.setCurrentPreset(presetIndex);
+
+    // The switch itself doesn't write
+    TEST_ASSERT_EQUAL_UINT32(writeCycles, eepromModel.getStats().writeCycles);
+    TestSupport::pollFor(presetManager, memoryManager, c_pressInterval);
+  }
+
+  // Nothing stored while the preset keeps changing
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().writeCycles);
+
+  // A single write once it stopped changing
+  TestSupport::pollFor(presetManager, memoryManager, c_deviceStateSaveDelay + c_pressInterval);
+  memoryManager.flush();
+  TEST_ASSERT_EQUAL_UINT32(1, eepromModel.getStats().writeCycles);
+
+  // The last bank and preset are restored on power up
+  eepromModel.powerCycle();
+  MemoryManager restartedMemoryManager(0);
+  PresetManager restartedPresetManager(restartedMemoryManager);
+  restartedPresetManager.initialize();
+  TEST_ASSERT_EQUAL_UINT8(bank, restartedPresetManager.getCurrentBank());
+  TEST_ASSERT_EQUAL_UINT8(presetIndex, restartedPresetManager.getCurrentPresetIndex());
+}
+
+void test_state_written_by_flush(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  memoryManager.flush();
+
+  eepromModel.resetStats();
+  presetManager.setCurrentPreset(2);
+  presetManager.setCurrentPreset(3);
+
+  // Stored before the delay when the device is about to be switched off
+  memoryManager.flush();
+  TEST_ASSERT_EQUAL_UINT32(1, eepromModel.getStats().writeCycles);
+
+  uint8_t bank = 0xFF;
+  uint8_t presetIndex = 0xFF;
+  MemoryManager restartedMemoryManager(0);
+  restartedMemoryManager.loadDeviceState(bank, presetIndex);
+  TEST_ASSERT_EQUAL_UINT8(0, bank);
+  TEST_ASSERT_EQUAL_UINT8(3, presetIndex);
+}
+
+void test_state_back_to_stored_not_written(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  memoryManager.flush();
+
+  // Away and back before the delay ended
+  eepromModel.resetStats();
+  presetManager.setCurrentPreset(1);
+  TestSupport::pollFor(presetManager, memoryManager, c_pressInterval);
+  presetManager.setCurrentPreset(0);
+  TestSupport::pollFor(presetManager, memoryManager, c_deviceStateSaveDelay + c_pressInterval);
+  memoryManager.flush();
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().writeCycles);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_preset_changes_coalesced);
+  RUN_TEST(test_state_written_by_flush);
+  RUN_TEST(test_state_back_to_stored_not_written);
+  return UNITY_END();
+}
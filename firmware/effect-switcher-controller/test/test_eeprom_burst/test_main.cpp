@@ -0,0 +1,152 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "peripherals/eeprom.h"
+#include "logic/memory.h"
+
+// Page-mode writes: the write cycles of a buffer and of a preset save on the simulated M95256
+
+static const uint16_t c_recordLength = 128;  // A preset record of the first store layout, written a byte at a time
+
+static void fillPattern(uint8_t* t_data, uint16_t t_length, uint8_t t_seed) {
+  for (uint16_t i = 0; i < t_length; i++) {
+    t_data[i] = uint8_t(t_seed + i * 7);
+  }
+}
+
+static void assertStored(uint16_t t_address, const uint8_t* t_data, uint16_t t_length) {
+  for (uint16_t i = 0; i < t_length; i++) {
+    TEST_ASSERT_EQUAL_HEX8(t_data[i], eepromModel.peek(t_address + i));
+  }
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_byte_writes(void) {
+  Eeprom eeprom(0);
+  eeprom.setup();
+  eepromModel.resetStats();
+
+  uint8_t data[c_recordLength];
+  fillPattern(data, c_recordLength, 1);
+
+  uint32_t startTime = SimClock::now();
+  for (uint16_t i = 0; i < c_recordLength; i++) {
+    eeprom.writeInt8(0x100 + i, data[i]);
+  }
+  eeprom.flush();
+
+  // The reference: one write cycle per byte
+  assertStored(0x100, data, c_recordLength);
+  TEST_ASSERT_EQUAL_UINT32(c_recordLength, eepromModel.getStats().writeCycles);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(c_recordLength * M95256Model::c_writeTime, SimClock::now() - startTime);
+}
+
+void test_aligned_burst_write(void) {
+  Eeprom eeprom(0);
+  eeprom.setup();
+  eepromModel.resetStats();
+
+  uint8_t data[c_recordLength];
+  fillPattern(data, c_recordLength, 2);
+
+  uint32_t startTime = SimClock::now();
+  eeprom.writeArray(0x100, data, c_recordLength);
+
+  // One WRITE per page
+  assertStored(0x100, data, c_recordLength);
+  TEST_ASSERT_EQUAL_UINT32(c_recordLength / EEPROM_PAGE_SIZE, eepromModel.getStats().writeCycles);
+  TEST_ASSERT_EQUAL_UINT32(c_recordLength, eepromModel.getStats().programmedBytes);
+  TEST_ASSERT_LESS_THAN_UINT32(3 * M95256Model::c_writeTime, SimClock::now() - startTime);
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().ignoredInstructions);
+}
+
+void test_unaligned_burst_write(void) {
+  Eeprom eeprom(0);
+  eeprom.setup();
+  eepromModel.resetStats();
+
+  uint8_t data[c_recordLength];
+  fillPattern(data, c_recordLength, 3);
+
+  // Split on the page boundaries, nothing wraps around inside a page
+  eeprom.writeArray(0x130, data, c_recordLength);
+  assertStored(0x130, data, c_recordLength);
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x12F));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x130 + c_recordLength));
+  TEST_ASSERT_EQUAL_UINT32(3, eepromModel.getStats().writeCycles);
+
+  // A short write inside a page is a single WRITE
+  eepromModel.resetStats();
+  eeprom.writeArray(0x205, data, 10);
+  assertStored(0x205, data, 10);
+  TEST_ASSERT_EQUAL_UINT32(1, eepromModel.getStats().writeCycles);
+}
+
+void test_preset_save_write_cycles(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  // The largest record, every message with its own status byte
+  Preset preset = TestSupport::makeLargestPreset(0, 0);
+
+  eepromModel.resetStats();
+  uint32_t startTime = SimClock::now();
+  memoryManager.savePreset(0, 0, preset);
+  memoryManager.flush();
+  uint32_t saveTime = SimClock::now() - startTime;
+  const M95256Stats& stats = eepromModel.getStats();
+
+  char text[100];
+  snprintf(text, sizeof(text), "Preset save: %u write cycles, %u bytes programmed, %u.%02u ms",
+    unsigned(stats.writeCycles), unsigned(stats.programmedBytes), unsigned(saveTime / 1000), unsigned(saveTime % 1000 / 10));
+  TEST_MESSAGE(text);
+
+  // A WRITE per page of the record and of its shadow copy, plus the shadow header, its commit and
+  // release bytes: far from a write cycle per byte
+  const uint8_t maxRecordPages = (c_presetSize + EEPROM_PAGE_SIZE - 2) / EEPROM_PAGE_SIZE + 1;
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * maxRecordPages + 3, stats.writeCycles);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2 * c_presetSize, stats.programmedBytes);
+  TEST_ASSERT_LESS_THAN_UINT32(c_presetSize * M95256Model::c_writeTime / 4, saveTime);
+
+  Preset loaded;
+  memoryManager.loadPreset(0, 0, loaded);
+  TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessagesCount(), loaded.getMidiMessagesCount());
+  TEST_ASSERT_EQUAL_UINT8(preset.getLoopState(3), loaded.getLoopState(3));
+}
+
+void test_footswitch_save_write_cycles(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+  memoryManager.flush();
+
+  FootSwitchConfig footSwitch(FootSwitchMode::kToggleLoop);
+  footSwitch.setLoopIndex(5);
+
+  eepromModel.resetStats();
+  TEST_ASSERT_TRUE(memoryManager.saveFootSwitchConfig(2, 1, footSwitch));
+  memoryManager.flush();
+  // The overrides of the bank through the shadow area, a few writes
+  TEST_ASSERT_GREATER_THAN_UINT32(0, eepromModel.getStats().writeCycles);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(8, eepromModel.getStats().writeCycles);
+
+  FootSwitchConfig loaded;
+  memoryManager.loadFootSwitchConfig(2, 1, loaded);
+  TEST_ASSERT_EQUAL_UINT8(FootSwitchMode::kToggleLoop, loaded.getMode());
+  TEST_ASSERT_EQUAL_UINT8(5, loaded.getLoopIndex());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_byte_writes);
+  RUN_TEST(test_aligned_burst_write);
+  RUN_TEST(test_unaligned_burst_write);
+  RUN_TEST(test_preset_save_write_cycles);
+  RUN_TEST(test_footswitch_save_write_cycles);
+  return UNITY_END();
+}
@@ -0,0 +1,165 @@
+#include <unity.h>
+#include <native_sim.h>
+
+#include "peripherals/eeprom.h"
+
+// The simulated M95256 behind the Eeprom driver, the tests of the store rely on it
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_write_wraps_in_page(void) {
+  SpiBus bus(0);
+  bus.begin();
+
+  // WREN, then a WRITE of 4 bytes from the last 2 bytes of page 1
+  bus.select();
+  bus.transfer(EEPROM_WREN);
+  bus.deselect();
+
+  bus.select();
+  bus.transfer(EEPROM_WRITE);
+  bus.transfer(0x00);
+  bus.transfer(0x7E);
+  for (uint8_t i = 1; i <= 4; i++) {
+    bus.transfer(i);
+  }
+  bus.deselect();
+
+  TEST_ASSERT_EQUAL_HEX8(1, eepromModel.peek(0x7E));
+  TEST_ASSERT_EQUAL_HEX8(2, eepromModel.peek(0x7F));
+  TEST_ASSERT_EQUAL_HEX8(3, eepromModel.peek(0x40));
+  TEST_ASSERT_EQUAL_HEX8(4, eepromModel.peek(0x41));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x80));
+}
+
+void test_write_needs_write_enable(void) {
+  SpiBus bus(0);
+
+  bus.select();
+  bus.transfer(EEPROM_WRITE);
+  bus.transfer(0x00);
+  bus.transfer(0x10);
+  bus.transfer(0x55);
+  bus.deselect();
+
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x10));
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().writeCycles);
+}
+
+void test_write_cycle_timing(void) {
+  Eeprom eeprom(0);
+  eeprom.setup();
+
+  uint8_t data[2] = { 0x12, 0x34 };
+  eeprom.queueWrite(0x100, data, 2);
+  eeprom.poll();
+
+  // Only RDSR is decoded during the write cycle
+  uint32_t start = SimClock::now();
+  TEST_ASSERT_EQUAL_HEX8(EEPROM_STATUS_WIP, eeprom.readStatusRegister() & EEPROM_STATUS_WIP);
+  TEST_ASSERT_FALSE(eeprom.isIdle());
+
+  TEST_ASSERT_EQUAL_HEX16(0x1234, eeprom.readInt16(0x100));
+  TEST_ASSERT_GREATER_OR_EQUAL(M95256Model::c_writeTime - 100, SimClock::now() - start);
+  TEST_ASSERT_TRUE(eeprom.isIdle());
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().ignoredInstructions);
+}
+
+void test_block_protection_cleared_by_setup(void) {
+  // BP1 and BP0 set: the whole array is protected
+  eepromModel.setStatusRegister(EEPROM_STATUS_BP);
+
+  SpiBus bus(0);
+  bus.select();
+  bus.transfer(EEPROM_WREN);
+  bus.deselect();
+  bus.select();
+  bus.transfer(EEPROM_WRITE);
+  bus.transfer(0x00);
+  bus.transfer(0x00);
+  bus.transfer(0x55);
+  bus.deselect();
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x0000));
+  TEST_ASSERT_EQUAL_UINT32(1, eepromModel.getStats().protectedWrites);
+
+  Eeprom eeprom(0);
+  eeprom.setup();
+  eeprom.writeInt8(0x0000, 0x55);
+  TEST_ASSERT_EQUAL_HEX8(0x55, eepromModel.peek(0x0000));
+}
+
+void test_upper_quarter_protection(void) {
+  // BP0 only: 0x6000 to 0x7FFF
+  eepromModel.setStatusRegister(0x04);
+
+  SpiBus bus(0);
+  for (uint16_t address : { uint16_t(0x5FFF), uint16_t(0x6000) }) {
+    bus.select();
+    bus.transfer(EEPROM_WREN);
+    bus.deselect();
+    bus.select();
+    bus.transfer(EEPROM_WRITE);
+    bus.transfer(highByte(address));
+    bus.transfer(lowByte(address));
+    bus.transfer(0x00);
+    bus.deselect();
+    SimClock::advance(M95256Model::c_writeTime);
+  }
+
+  TEST_ASSERT_EQUAL_HEX8(0x00, eepromModel.peek(0x5FFF));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x6000));
+}
+
+void test_status_register_locked(void) {
+  // SRWD with the W pin low, WRSR is ignored
+  eepromModel.setStatusRegister(EEPROM_STATUS_SRWD | EEPROM_STATUS_BP);
+  eepromModel.setWriteProtectPin(false);
+
+  Eeprom eeprom(0);
+  eeprom.setup();
+  TEST_ASSERT_EQUAL_HEX8(EEPROM_STATUS_SRWD | EEPROM_STATUS_BP, eeprom.readStatusRegister());
+
+  eepromModel.setWriteProtectPin(true);
+}
+
+void test_cell_endurance_and_power_cut(void) {
+  Eeprom eeprom(0);
+  eeprom.setup();
+
+  for (uint8_t i = 0; i < 3; i++) {
+    eeprom.writeInt16(0x200, i);
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, eepromModel.getCellWrites(0x200));
+  TEST_ASSERT_EQUAL_UINT32(3, eepromModel.getMaxCellWrites());
+
+  // The page is torn after its first byte
+  uint8_t data[4] = { 1, 2, 3, 4 };
+  eepromModel.cutPowerAfter(1);
+  bool cut = false;
+  try {
+    eeprom.writeArray(0x300, data, 4);
+  }
+  catch (PowerCut&) {
+    cut = true;
+  }
+
+  TEST_ASSERT_TRUE(cut);
+  TEST_ASSERT_EQUAL_HEX8(1, eepromModel.peek(0x300));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(0x301));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_write_wraps_in_page);
+  RUN_TEST(test_write_needs_write_enable);
+  RUN_TEST(test_write_cycle_timing);
+  RUN_TEST(test_block_protection_cleared_by_setup);
+  RUN_TEST(test_upper_quarter_protection);
+  RUN_TEST(test_status_register_locked);
+  RUN_TEST(test_cell_endurance_and_power_cut);
+  return UNITY_END();
+}
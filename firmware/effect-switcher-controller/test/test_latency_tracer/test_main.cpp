@@ -0,0 +1,90 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <string.h>
+
+#include "utils/latency_tracer.h"
+
+// Footswitch latency traces: a trace is kept once every stage is stamped, and the report printed on
+// the simulated serial port
+
+/// Run a trace whose stages are each reached `t_stageTime` after the previous one
+static void trace(LatencyTracer& t_latencyTracer, uint32_t t_stageTime) {
+  uint32_t edgeTime = SimClock::now();
+  SimClock::advance(t_stageTime);
+  t_latencyTracer.begin(edgeTime);
+
+  for (uint8_t i = 1; i < c_traceStagesCount; i++) {
+    SimClock::advance(t_stageTime);
+    t_latencyTracer.mark(static_cast<TraceStage>(i));
+  }
+}
+
+/// Print the report and take it from the serial port
+static void takeReport(const LatencyTracer& t_latencyTracer, char* t_text, size_t t_maxLength) {
+  uint8_t output[1024];
+  Serial.simTake(output, sizeof(output));
+
+  t_latencyTracer.report();
+  size_t length = Serial.simTake(reinterpret_cast<uint8_t*>(t_text), t_maxLength - 1);
+  t_text[length] = '\0';
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_complete_trace_reported(void) {
+  LatencyTracer latencyTracer;
+  trace(latencyTracer, 100);
+
+  char text[1024];
+  takeReport(latencyTracer, text, sizeof(text));
+  TEST_ASSERT_NOT_NULL(strstr(text, "last 1 of 1 traces, 0 dropped"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "Detected  min 100 avg 100 max 100 p99 100 us"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "Displayed min 500 avg 500 max 500 p99 500 us"));
+}
+
+void test_press_before_complete_dropped(void) {
+  LatencyTracer latencyTracer;
+  latencyTracer.begin(SimClock::now());
+  latencyTracer.mark(TraceStage::kLatched);
+
+  // A stage stamped twice keeps its first time
+  trace(latencyTracer, 100);
+  latencyTracer.mark(TraceStage::kLatched);
+
+  char text[1024];
+  takeReport(latencyTracer, text, sizeof(text));
+  TEST_ASSERT_NOT_NULL(strstr(text, "last 1 of 1 traces, 1 dropped"));
+  TEST_ASSERT_NOT_NULL(strstr(text, "Latched   min 200 avg 200 max 200 p99 200 us"));
+}
+
+void test_ring_keeps_last_traces(void) {
+  LatencyTracer latencyTracer;
+
+  // Traces of 1 to 40 ms to detection, the first 8 are pushed out of the ring
+  for (uint8_t i = 1; i <= 40; i++) {
+    trace(latencyTracer, i * 1000UL);
+  }
+
+  char text[1024];
+  takeReport(latencyTracer, text, sizeof(text));
+  TEST_ASSERT_NOT_NULL(strstr(text, "last 32 of 40 traces, 0 dropped"));
+
+  // Nearest rank, the p99 of 32 traces is their max
+  TEST_ASSERT_NOT_NULL(strstr(text, "Detected  min 9000 avg 24500 max 40000 p99 40000 us"));
+
+  latencyTracer.reset();
+  takeReport(latencyTracer, text, sizeof(text));
+  TEST_ASSERT_NOT_NULL(strstr(text, "last 0 of 0 traces, 0 dropped"));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_complete_trace_reported);
+  RUN_TEST(test_press_before_complete_dropped);
+  RUN_TEST(test_ring_keeps_last_traces);
+  return UNITY_END();
+}
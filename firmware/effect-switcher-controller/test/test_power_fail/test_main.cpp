@@ -0,0 +1,138 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+
+// Power cuts during a preset save: the power is cut after every programmed byte of the save,
+// the store must hold the previous or the new preset after the restart, never a torn record
+
+static uint8_t s_eeprom[EEPROM_SIZE];  // Store before the save
+
+static bool isPresetStored(MemoryManager& t_memoryManager, uint8_t t_presetIndex, const Preset& t_preset) {
+  Preset stored;
+  t_memoryManager.loadPreset(0, t_presetIndex, stored);
+
+  if (stored.getLoopsCount() != t_preset.getLoopsCount() ||
+    stored.getMidiMessagesCount() != t_preset.getMidiMessagesCount()) {
+      return false;
+  }
+
+  for (uint8_t i = 0; i < t_preset.getLoopsCount(); i++) {
+    if (stored.getLoopState(i) != t_preset.getLoopState(i) ||
+      stored.getLoopOrder(i) != t_preset.getLoopOrder(i) ||
+      stored.getLoopSend(i) != t_preset.getLoopSend(i) ||
+      stored.getLoopReturn(i) != t_preset.getLoopReturn(i)) {
+        return false;
+    }
+  }
+
+  for (uint8_t j = 0; j < t_preset.getMidiMessagesCount(); j++) {
+    if (stored.getMidiMessageStatusByte(j) != t_preset.getMidiMessageStatusByte(j) ||
+      stored.getMidiMessageDataByte1(j) != t_preset.getMidiMessageDataByte1(j) ||
+      stored.getMidiMessageDataByte2(j) != t_preset.getMidiMessageDataByte2(j)) {
+        return false;
+    }
+  }
+
+  return true;
+}
+
+/// Save `t_next` over `t_previous` with the power cut after every programmed byte
+static void cutPowerDuringSave(const Preset& t_previous, const Preset& t_next) {
+  Preset neighbour = TestSupport::makePreset(0, t_next.getPreset() + 1, c_maxRoutedLoops, 5, 7);
+
+  {
+    MemoryManager memoryManager(0);
+    memoryManager.openStore();
+    memoryManager.savePreset(0, t_next.getPreset() + 1, neighbour);
+    if (t_previous.getLoopsCount() > 0) {
+      memoryManager.savePreset(0, t_next.getPreset(), t_previous);
+    }
+    memoryManager.flush();
+  }
+
+  TestSupport::peekArray(0, s_eeprom, EEPROM_SIZE);
+
+  uint16_t previousCuts = 0;
+  uint16_t nextCuts = 0;
+  for (int32_t cutAfter = 0; ; cutAfter++) {
+    TestSupport::pokeArray(0, s_eeprom, EEPROM_SIZE);
+
+    bool cut = false;
+    MemoryManager memoryManager(0);
+    memoryManager.openStore();
+    eepromModel.cutPowerAfter(cutAfter);
+    try {
+      memoryManager.savePreset(0, t_next.getPreset(), t_next);
+      memoryManager.flush();
+    }
+    catch (PowerCut&) {
+      cut = true;
+    }
+    eepromModel.cutPowerAfter(-1);
+    eepromModel.powerCycle();
+
+    // Started again like PresetManager::initialize
+    MemoryManager rebooted(0);
+    rebooted.openStore();
+    rebooted.recover();
+    rebooted.validateStore();
+
+    if (isPresetStored(rebooted, t_next.getPreset(), t_next)) {
+      nextCuts += cut;
+    }
+    else {
+      // Once the new record is committed it is never lost again
+      TEST_ASSERT_EQUAL_UINT16(0, nextCuts);
+      TEST_ASSERT_TRUE(cut);
+      TEST_ASSERT_TRUE(isPresetStored(rebooted, t_next.getPreset(), t_previous));
+      previousCuts++;
+    }
+    TEST_ASSERT_TRUE(isPresetStored(rebooted, t_next.getPreset() + 1, neighbour));
+
+    if (!cut) {
+      break;
+    }
+  }
+
+  char text[80];
+  snprintf(text, sizeof(text), "%u cuts kept the previous preset, %u the new one", unsigned(previousCuts), unsigned(nextCuts));
+  TEST_MESSAGE(text);
+  TEST_ASSERT_GREATER_THAN_UINT16(0, previousCuts);
+  TEST_ASSERT_GREATER_THAN_UINT16(0, nextCuts);
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_cut_during_first_save(void) {
+  // The record is read back as the empty preset until it is committed
+  cutPowerDuringSave(Preset(0, 0, 0, 0), TestSupport::makePreset(0, 0, c_maxRoutedLoops, 6, 1));
+}
+
+void test_cut_during_same_length_save(void) {
+  Preset previous = TestSupport::makePreset(0, 1, c_maxRoutedLoops, 6, 1);
+  Preset next = previous;
+  next.toggleLoopState(2);
+  next.setMidiMessageDataByte1(5, 99);
+
+  // The record is written in place
+  cutPowerDuringSave(previous, next);
+}
+
+void test_cut_during_grown_save(void) {
+  // The record grows into bytes of its slot never written before
+  cutPowerDuringSave(TestSupport::makePreset(0, 2, c_maxRoutedLoops, 2, 3), TestSupport::makePreset(0, 2, c_maxRoutedLoops, c_maxMidiMessages, 4));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cut_during_first_save);
+  RUN_TEST(test_cut_during_same_length_save);
+  RUN_TEST(test_cut_during_grown_save);
+  return UNITY_END();
+}
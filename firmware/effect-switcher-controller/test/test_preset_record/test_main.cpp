@@ -0,0 +1,117 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_record_view.h"
+
+// Preset records: serialization round trip, record length and MIDI running status
+
+/// Length of a record: header, orders, MIDI bytes with running status and CRC
+static uint8_t expectedRecordLength(const Preset& t_preset) {
+  uint8_t length = c_presetOrdersOffset + (t_preset.getLoopsCount() + 1) / 2;
+  uint8_t runningStatus = 0;
+
+  for (uint8_t j = 0; j < t_preset.getMidiMessagesCount(); j++) {
+    uint8_t statusByte = t_preset.getMidiMessageStatusByte(j);
+    length += (statusByte != runningStatus) + MidiMessage::getDataBytesCount(statusByte);
+    runningStatus = statusByte;
+  }
+
+  return length + 2;
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_record_round_trip(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  for (uint16_t i = 0; i < 500; i++) {
+    Preset preset = TestSupport::makePreset(0, 0, i % (c_maxRoutedLoops + 1), i % (c_maxMidiMessages + 1), i);
+    uint8_t record[c_presetSize];
+    uint8_t length = memoryManager.serializePreset(preset, record);
+
+    TEST_ASSERT_EQUAL_UINT8(expectedRecordLength(preset), length);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(c_presetSize, length);
+
+    Preset loaded;
+    memoryManager.deserializePreset(record, 0, 0, loaded);
+    TEST_ASSERT_EQUAL_UINT8(preset.getLoopsCount(), loaded.getLoopsCount());
+    TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessagesCount(), loaded.getMidiMessagesCount());
+
+    for (uint8_t j = 0; j < preset.getLoopsCount(); j++) {
+      TEST_ASSERT_EQUAL_UINT8(preset.getLoopState(j), loaded.getLoopState(j));
+      TEST_ASSERT_EQUAL_UINT8(preset.getLoopOrder(j), loaded.getLoopOrder(j));
+    }
+
+    for (uint8_t j = 0; j < preset.getMidiMessagesCount(); j++) {
+      TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessageStatusByte(j), loaded.getMidiMessageStatusByte(j));
+      TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessageDataByte1(j), loaded.getMidiMessageDataByte1(j));
+      if (preset.getMidiMessageHasDataByte2(j)) {
+        TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessageDataByte2(j), loaded.getMidiMessageDataByte2(j));
+      }
+    }
+  }
+}
+
+void test_largest_record_fits(void) {
+  MemoryManager memoryManager(0);
+
+  // No running status: every message stores its status byte and 2 data bytes
+  Preset preset = TestSupport::makeLargestPreset(0, 0);
+
+  uint8_t record[c_presetSize];
+  TEST_ASSERT_EQUAL_UINT8(c_presetSize, memoryManager.serializePreset(preset, record));
+
+  PresetRecordView view(record);
+  TEST_ASSERT_EQUAL_UINT8(3 * c_maxMidiMessages, view.getMidiDataLength());
+}
+
+void test_message_without_status_byte_left_out(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  Preset preset(0, 0, 2, 3);
+  preset.setMidiMessageStatusByte(0, 0xC0);
+  preset.setMidiMessageDataByte1(0, 5);
+  preset.setMidiMessageStatusByte(1, 0x30);
+  preset.setMidiMessageDataByte1(1, 6);
+  preset.setMidiMessageDataByte2(1, 7);
+  preset.setMidiMessageStatusByte(2, 0xB1);
+  preset.setMidiMessageDataByte1(2, 8);
+  preset.setMidiMessageDataByte2(2, 9);
+
+  // The stored bytes are sent as they are, a data byte must not be taken for a message
+  uint8_t record[c_presetSize];
+  uint8_t length = memoryManager.serializePreset(preset, record);
+  PresetRecordView view(record);
+  const uint8_t expected[] = { 0xC0, 5, 0xB1, 8, 9 };
+  TEST_ASSERT_EQUAL_UINT8(2, view.getMidiMessagesCount());
+  TEST_ASSERT_EQUAL_UINT8(sizeof(expected), view.getMidiDataLength());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, view.getMidiData(), sizeof(expected));
+
+  // The record is valid with the count it stores
+  memoryManager.savePreset(0, 0, preset);
+  memoryManager.flush();
+  uint8_t stored[c_presetSize];
+  memoryManager.loadPresetRecord(0, 0, stored);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(record, stored, length);
+
+  Preset loaded;
+  memoryManager.loadPreset(0, 0, loaded);
+  TEST_ASSERT_EQUAL_UINT8(2, loaded.getMidiMessagesCount());
+  TEST_ASSERT_EQUAL_UINT8(0xB1, loaded.getMidiMessageStatusByte(1));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_record_round_trip);
+  RUN_TEST(test_largest_record_fits);
+  RUN_TEST(test_message_without_status_byte_left_out);
+  return UNITY_END();
+}
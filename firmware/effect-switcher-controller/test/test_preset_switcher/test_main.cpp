@@ -0,0 +1,209 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+#include "logic/preset_switcher.h"
+
+// Preset switches through PresetSwitcher, the MIDI bytes on the simulated serial port and the cost
+// of an activation
+
+static const uint8_t c_logLength = 50;  // Log text queued before the switch
+static const uint32_t c_iterations = 100000;
+
+/// Save a preset of the largest MIDI stream: every message has its own status byte
+static void saveMidiPreset(MemoryManager& t_memoryManager, uint8_t t_presetIndex) {
+  t_memoryManager.savePreset(0, t_presetIndex, TestSupport::makeLargestPreset(0, t_presetIndex));
+  t_memoryManager.flush();
+}
+
+/// Run the switch like the main loop
+/// @return Longest poll, in simulated µs
+static uint32_t pollUntilSwitched(PresetSwitcher& t_presetSwitcher) {
+  uint32_t longestPoll = 0;
+
+  for (uint16_t i = 0; i < 1000 && t_presetSwitcher.isSwitching(); i++) {
+    uint32_t startTime = SimClock::now();
+    t_presetSwitcher.poll();
+    uint32_t pollTime = SimClock::now() - startTime;
+    if (pollTime > longestPoll) {
+      longestPoll = pollTime;
+    }
+    SimClock::advance(200);
+  }
+
+  TEST_ASSERT_FALSE(t_presetSwitcher.isSwitching());
+  return longestPoll;
+}
+
+void setUp(void) {
+  resetSimulation();
+
+  // Only the MIDI bytes are on the serial port
+  setLogMuted(true);
+}
+
+void tearDown(void) {
+  setLogMuted(false);
+}
+
+void test_midi_written_across_polls(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  saveMidiPreset(memoryManager, 1);
+  presetManager.reload();
+  while (presetManager.poll()) { }
+
+  SwitchMatrix switchMatrix(2);
+  LedDriver16 presetLed(1);
+  LatencyTracer latencyTracer;
+  PresetSwitcher presetSwitcher(presetManager, switchMatrix, presetLed, latencyTracer);
+
+  presetManager.setCurrentPreset(1);
+  const PresetPlan& plan = presetManager.getCurrentPlan();
+  TEST_ASSERT_EQUAL_UINT8(c_maxPlanMidiLength, plan.midiLength);
+
+  // The UART buffer is mostly taken by a log line when the switch starts
+  uint8_t output[256];
+  Serial.simTake(output, sizeof(output));
+  for (uint8_t i = 0; i < c_logLength; i++) {
+    Serial.write('.');
+  }
+
+  presetSwitcher.switchPreset();
+  uint32_t longestPoll = pollUntilSwitched(presetSwitcher);
+
+  // Writing the whole stream at once would wait for the UART to send the log line
+  TEST_ASSERT_LESS_THAN_UINT32(1000, longestPoll);
+
+  TEST_ASSERT_EQUAL_UINT32(c_logLength + c_maxPlanMidiLength, Serial.simTake(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(plan.p_midiData, &output[c_logLength], c_maxPlanMidiLength);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SwitchBudgets().midiSettleTime, presetSwitcher.getStageTime(SwitchStage::kMidi));
+}
+
+void test_output_muted_until_midi_settled(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  saveMidiPreset(memoryManager, 1);
+  presetManager.reload();
+  while (presetManager.poll()) { }
+
+  SwitchMatrix switchMatrix(2);
+  LedDriver16 presetLed(1);
+  LatencyTracer latencyTracer;
+  PresetSwitcher presetSwitcher(presetManager, switchMatrix, presetLed, latencyTracer);
+
+  presetManager.setCurrentPreset(1);
+  presetSwitcher.switchPreset();
+  pollUntilSwitched(presetSwitcher);
+
+  // The output is connected again once the pedals had the settle time to apply the messages
+  SwitchBudgets budgets;
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(budgets.muteTime + budgets.midiSettleTime, presetSwitcher.getGapTime());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(budgets.maxGapTime, presetSwitcher.getGapTime());
+}
+
+void test_midi_dropped_while_disabled(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  saveMidiPreset(memoryManager, 1);
+  presetManager.reload();
+  while (presetManager.poll()) { }
+
+  SwitchMatrix switchMatrix(2);
+  LedDriver16 presetLed(1);
+  LatencyTracer latencyTracer;
+  PresetSwitcher presetSwitcher(presetManager, switchMatrix, presetLed, latencyTracer);
+
+  uint8_t output[256];
+  Serial.simTake(output, sizeof(output));
+
+  presetSwitcher.setMidiEnabled(false);
+  presetManager.setCurrentPreset(1);
+  presetSwitcher.switchPreset();
+  pollUntilSwitched(presetSwitcher);
+
+  // Nothing sent, and no settle time waited for
+  TEST_ASSERT_EQUAL_UINT32(0, Serial.simTake(output, sizeof(output)));
+  TEST_ASSERT_LESS_THAN_UINT32(SwitchBudgets().midiSettleTime, presetSwitcher.getStageTime(SwitchStage::kMidi));
+}
+
+void test_activation_benchmark(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+  saveMidiPreset(memoryManager, 1);
+  presetManager.reload();
+  while (presetManager.poll()) { }
+
+  SwitchMatrix switchMatrix(2);
+  LedDriver16 presetLed(1);
+  LatencyTracer latencyTracer;
+  PresetSwitcher presetSwitcher(presetManager, switchMatrix, presetLed, latencyTracer);
+
+  // Without the waits, the stages take the time of the buses only
+  SwitchBudgets budgets;
+  budgets.muteTime = 0;
+  budgets.midiSettleTime = 0;
+  presetSwitcher.setBudgets(budgets);
+
+  uint8_t output[256];
+  presetManager.setCurrentPreset(1);
+  presetSwitcher.switchPreset();
+  pollUntilSwitched(presetSwitcher);
+  Serial.simTake(output, sizeof(output));
+
+  uint32_t routeTime = presetSwitcher.getStageTime(SwitchStage::kRoute);
+  uint32_t latchTime = presetSwitcher.getStageTime(SwitchStage::kLatch);
+  uint32_t midiTime = presetSwitcher.getStageTime(SwitchStage::kMidi);
+
+  // Host CPU time of the work a switch does with the plan: copy it and queue the MIDI bytes
+  const PresetPlan& plan = presetManager.getCurrentPlan();
+  double startTime = TestSupport::nowNs();
+  for (uint32_t i = 0; i < c_iterations; i++) {
+    RoutingBitmap routing = plan.routing;
+    uint8_t midiData[c_maxPlanMidiLength];
+    memcpy(midiData, plan.p_midiData, plan.midiLength);
+    TestSupport::keep(routing.rows[i % c_matrixSize] + plan.ledMask + midiData[i % plan.midiLength]);
+  }
+  double planTime = (TestSupport::nowNs() - startTime) / c_iterations;
+
+  // The same, compiled from the record at switch time
+  PresetRecordView record = presetManager.getCurrentPresetRecord();
+  startTime = TestSupport::nowNs();
+  for (uint32_t i = 0; i < c_iterations; i++) {
+    RoutingBitmap routing;
+    Routing::compileRecord(record, memoryManager.getLoopSends(), memoryManager.getLoopReturns(), routing);
+    uint8_t midiData[c_maxPlanMidiLength];
+    uint8_t midiLength = record.getMidiDataLength();
+    memcpy(midiData, record.getMidiData(), midiLength);
+    TestSupport::keep(routing.rows[i % c_matrixSize] + midiData[i % midiLength]);
+  }
+  double compileTime = (TestSupport::nowNs() - startTime) / c_iterations;
+
+  char text[160];
+  snprintf(text, sizeof(text), "Stages: route %u us, latch %u us, MIDI %u us. Host: plan %.1f ns, compiled at switch %.1f ns",
+    unsigned(routeTime), unsigned(latchTime), unsigned(midiTime), planTime, compileTime);
+  TEST_MESSAGE(text);
+
+  // Only the SPI bursts: the matrix rows at 1 MHz and the LED mask at 4 MHz. The MIDI bytes fit
+  // the UART buffer.
+  const uint32_t busTime = 2 * c_matrixSize * 8 + 2 * 2;
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(busTime + 20, routeTime + latchTime);
+  TEST_ASSERT_LESS_THAN_UINT32(1000, midiTime);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(plan.p_midiData, output, plan.midiLength);
+  TEST_ASSERT_TRUE(planTime < compileTime);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_midi_written_across_polls);
+  RUN_TEST(test_output_muted_until_midi_settled);
+  RUN_TEST(test_midi_dropped_while_disabled);
+  RUN_TEST(test_activation_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,110 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_record_view.h"
+
+// Host CPU time of reading a cached record: deserialized into a Preset, or read in place through
+// a PresetRecordView like a preset switch does. The time is the host's, not the target's, only
+// the ratio matters.
+
+static const uint32_t c_iterations = 100000;
+static const uint8_t c_runs = 5;  // The fastest run is kept
+
+/// Read what a preset switch needs from a Preset: the loop states and orders and the MIDI bytes
+static uint32_t readPreset(const Preset& t_preset) {
+  uint32_t sum = 0;
+
+  for (uint8_t i = 0; i < t_preset.getLoopsCount(); i++) {
+    sum += t_preset.getLoopState(i) + t_preset.getLoopOrder(i);
+  }
+
+  for (uint8_t j = 0; j < t_preset.getMidiMessagesCount(); j++) {
+    sum += t_preset.getMidiMessageStatusByte(j) + t_preset.getMidiMessageDataByte1(j) + t_preset.getMidiMessageDataByte2(j);
+  }
+
+  return sum;
+}
+
+/// Read the same from the record
+static uint32_t readRecord(const PresetRecordView& t_record) {
+  uint32_t sum = t_record.getLoopStates();
+
+  for (uint8_t i = 0; i < t_record.getLoopsCount(); i++) {
+    sum += t_record.getLoopOrder(i);
+  }
+
+  const uint8_t* midiData = t_record.getMidiData();
+  uint8_t midiLength = t_record.getMidiDataLength();
+  for (uint8_t i = 0; i < midiLength; i++) {
+    sum += midiData[i];
+  }
+
+  return sum;
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_deserialize_against_view(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  uint8_t record[c_presetSize];
+  uint8_t length = memoryManager.serializePreset(TestSupport::makePreset(1, 2, c_maxRoutedLoops, c_maxMidiMessages, 5), record);
+
+  Preset preset;
+  memoryManager.deserializePreset(record, 1, 2, preset);
+
+  // The view reads the same fields in place
+  PresetRecordView view(record);
+  TEST_ASSERT_EQUAL_UINT8(preset.getLoopsCount(), view.getLoopsCount());
+  TEST_ASSERT_EQUAL_UINT8(preset.getLoopOrder(5), view.getLoopOrder(5));
+  MidiMessageCursor cursor = view.beginMidiMessages();
+  for (uint8_t j = 0; j < preset.getMidiMessagesCount(); j++) {
+    uint8_t statusByte, dataByte1, dataByte2;
+    view.readMidiMessage(cursor, statusByte, dataByte1, dataByte2);
+    TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessageStatusByte(j), statusByte);
+    TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessageDataByte1(j), dataByte1);
+  }
+
+  double deserializeTime = 1e30;
+  double viewTime = 1e30;
+  for (uint8_t run = 0; run < c_runs; run++) {
+    double startTime = TestSupport::nowNs();
+    for (uint32_t i = 0; i < c_iterations; i++) {
+      memoryManager.deserializePreset(record, 1, 2, preset);
+      TestSupport::keep(readPreset(preset));
+    }
+    double time = (TestSupport::nowNs() - startTime) / c_iterations;
+    if (time < deserializeTime) {
+      deserializeTime = time;
+    }
+
+    startTime = TestSupport::nowNs();
+    for (uint32_t i = 0; i < c_iterations; i++) {
+      TestSupport::keep(readRecord(PresetRecordView(record)));
+    }
+    time = (TestSupport::nowNs() - startTime) / c_iterations;
+    if (time < viewTime) {
+      viewTime = time;
+    }
+  }
+
+  char text[100];
+  snprintf(text, sizeof(text), "Record of %u bytes: deserialize %.1f ns, view %.1f ns, %.1fx",
+    unsigned(length), deserializeTime, viewTime, deserializeTime / viewTime);
+  TEST_MESSAGE(text);
+
+  TEST_ASSERT_TRUE(viewTime < deserializeTime);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_deserialize_against_view);
+  return UNITY_END();
+}
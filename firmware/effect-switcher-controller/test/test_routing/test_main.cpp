@@ -0,0 +1,232 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <algorithm>
+
+#include "logic/memory.h"
+#include "logic/routing.h"
+
+// Routing compiler: the crosspoints of every loop ordering and state of small presets, checked by
+// following the signal from the input jack
+
+static const uint8_t c_maxPermutedLoops = 6;
+
+static uint8_t s_loopSends[c_maxLoops];
+static uint8_t s_loopReturns[c_maxLoops];
+
+/// Compile a preset through its record, like the bank cache does
+static void compile(const Preset& t_preset, RoutingBitmap& t_bitmap) {
+  MemoryManager memoryManager(0);
+  uint8_t record[c_presetSize];
+  memoryManager.serializePreset(t_preset, record);
+  Routing::compileRecord(PresetRecordView(record), s_loopSends, s_loopReturns, t_bitmap);
+}
+
+/// Follow the signal from the input jack to the output jack
+/// @return Number of loops traversed, their indexes in `t_path`, -1 if the chain is broken
+static int8_t traceChain(const RoutingBitmap& t_bitmap, uint8_t t_loopsCount, uint8_t* t_path) {
+  uint8_t source = c_matrixInputJack;
+
+  for (uint8_t hops = 0; hops <= t_loopsCount; hops++) {
+    // The source drives a single matrix output
+    int8_t output = -1;
+    for (uint8_t y = 0; y < c_matrixSize; y++) {
+      if (bitRead(t_bitmap.rows[y], source)) {
+        if (output >= 0) {
+          return -1;
+        }
+        output = y;
+      }
+    }
+
+    if (output == c_matrixOutputJack) {
+      return hops;
+    }
+
+    int8_t loop = -1;
+    for (uint8_t i = 0; i < t_loopsCount && loop < 0; i++) {
+      if (s_loopSends[i] == output) {
+        loop = i;
+      }
+    }
+    if (loop < 0) {
+      return -1;
+    }
+
+    t_path[hops] = loop;
+    source = s_loopReturns[loop];
+  }
+
+  return -1;
+}
+
+static uint8_t countCrosspoints(const RoutingBitmap& t_bitmap) {
+  uint8_t count = 0;
+
+  for (uint8_t y = 0; y < c_matrixSize; y++) {
+    for (uint8_t x = 0; x < c_matrixSize; x++) {
+      count += bitRead(t_bitmap.rows[y], x);
+    }
+  }
+
+  return count;
+}
+
+void setUp(void) {
+  resetSimulation();
+
+  // Sends and returns spread over the loop channels, no loop is wired to its own index
+  for (uint8_t i = 0; i < c_maxLoops; i++) {
+    s_loopSends[i] = (i * 4) % (c_matrixSize - 1);
+    s_loopReturns[i] = (i * 7 + 3) % (c_matrixSize - 1);
+  }
+}
+
+void tearDown(void) { }
+
+void test_every_ordering_permutation(void) {
+  uint32_t cases = 0;
+
+  for (uint8_t loopsCount = 1; loopsCount <= c_maxPermutedLoops; loopsCount++) {
+    uint8_t orders[c_maxPermutedLoops];
+    for (uint8_t i = 0; i < loopsCount; i++) {
+      orders[i] = i;
+    }
+
+    do {
+      for (uint8_t states = 0; states < (1 << loopsCount); states++) {
+        Preset preset(0, 0, loopsCount, 0);
+        for (uint8_t i = 0; i < loopsCount; i++) {
+          preset.setLoopOrder(i, orders[i]);
+          preset.setLoopState(i, bitRead(states, i));
+        }
+
+        RoutingBitmap bitmap;
+        compile(preset, bitmap);
+
+        // The active loops in order, the bypassed ones left out
+        uint8_t expected[c_maxPermutedLoops];
+        uint8_t activeCount = 0;
+        for (uint8_t order = 0; order < loopsCount; order++) {
+          for (uint8_t i = 0; i < loopsCount; i++) {
+            if (orders[i] == order && bitRead(states, i)) {
+              expected[activeCount++] = i;
+            }
+          }
+        }
+
+        uint8_t path[c_maxPermutedLoops];
+        TEST_ASSERT_EQUAL_INT8(activeCount, traceChain(bitmap, loopsCount, path));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, path, activeCount);
+        TEST_ASSERT_EQUAL_UINT8(activeCount + 1, countCrosspoints(bitmap));
+        cases++;
+      }
+    } while (std::next_permutation(orders, orders + loopsCount));
+  }
+
+  char text[60];
+  snprintf(text, sizeof(text), "%u orderings and states routed", unsigned(cases));
+  TEST_MESSAGE(text);
+}
+
+void test_no_active_loop(void) {
+  Preset preset(0, 0, 4, 0);
+  RoutingBitmap bitmap;
+  compile(preset, bitmap);
+
+  // The input jack straight to the output jack
+  TEST_ASSERT_EQUAL_HEX16(1u << c_matrixInputJack, bitmap.rows[c_matrixOutputJack]);
+  TEST_ASSERT_EQUAL_UINT8(1, countCrosspoints(bitmap));
+
+  Preset empty(0, 0, 0, 0);
+  compile(empty, bitmap);
+  TEST_ASSERT_EQUAL_HEX16(1u << c_matrixInputJack, bitmap.rows[c_matrixOutputJack]);
+}
+
+void test_shared_order_chained_by_index(void) {
+  Preset preset(0, 0, 4, 0);
+  const uint8_t orders[] = { 1, 0, 1, 0 };
+  for (uint8_t i = 0; i < 4; i++) {
+    preset.setLoopOrder(i, orders[i]);
+    preset.setLoopState(i, true);
+  }
+
+  RoutingBitmap bitmap;
+  compile(preset, bitmap);
+
+  uint8_t path[4];
+  const uint8_t expected[] = { 1, 3, 0, 2 };
+  TEST_ASSERT_EQUAL_INT8(4, traceChain(bitmap, 4, path));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, path, 4);
+}
+
+void test_unroutable_loops_bypassed(void) {
+  Preset preset(0, 0, 4, 0);
+  for (uint8_t i = 0; i < 4; i++) {
+    preset.setLoopOrder(i, i);
+    preset.setLoopState(i, true);
+  }
+
+  // Loop 1 sends to the output jack, loop 2 shares the send of loop 0, loop 3 is fine
+  s_loopSends[1] = c_matrixOutputJack;
+  s_loopSends[2] = s_loopSends[0];
+
+  RoutingBitmap bitmap;
+  compile(preset, bitmap);
+
+  uint8_t path[4];
+  const uint8_t expected[] = { 0, 3 };
+  TEST_ASSERT_EQUAL_INT8(2, traceChain(bitmap, 4, path));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, path, 2);
+  TEST_ASSERT_EQUAL_UINT8(3, countCrosspoints(bitmap));
+  TEST_ASSERT_FALSE(Routing::checkTable(s_loopSends, s_loopReturns));
+}
+
+void test_default_table_routes_every_loop(void) {
+  {
+    MemoryManager memoryManager(0);
+    memoryManager.openStore();
+    memoryManager.flush();
+  }
+
+  // The table written with the store, read back at the next boot
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+  memcpy(s_loopSends, memoryManager.getLoopSends(), c_maxLoops);
+  memcpy(s_loopReturns, memoryManager.getLoopReturns(), c_maxLoops);
+  TEST_ASSERT_TRUE(Routing::checkTable(s_loopSends, s_loopReturns));
+
+  // Every loop a preset holds, active and chained in index order
+  Preset preset(0, 0, c_maxLoops, 0);
+  for (uint8_t i = 0; i < c_maxLoops; i++) {
+    preset.setLoopOrder(i, i);
+    preset.setLoopState(i, true);
+  }
+
+  // The loop past the matrix channels isn't stored
+  uint8_t record[c_presetSize];
+  memoryManager.serializePreset(preset, record);
+  PresetRecordView view(record);
+  TEST_ASSERT_EQUAL_UINT8(c_maxRoutedLoops, view.getLoopsCount());
+
+  RoutingBitmap bitmap;
+  Routing::compileRecord(view, memoryManager.getLoopSends(), memoryManager.getLoopReturns(), bitmap);
+
+  uint8_t path[c_maxRoutedLoops];
+  uint8_t expected[c_maxRoutedLoops];
+  for (uint8_t i = 0; i < c_maxRoutedLoops; i++) {
+    expected[i] = i;
+  }
+  TEST_ASSERT_EQUAL_INT8(c_maxRoutedLoops, traceChain(bitmap, c_maxRoutedLoops, path));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, path, c_maxRoutedLoops);
+  TEST_ASSERT_EQUAL_UINT8(c_maxRoutedLoops + 1, countCrosspoints(bitmap));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_ordering_permutation);
+  RUN_TEST(test_no_active_loop);
+  RUN_TEST(test_shared_order_chained_by_index);
+  RUN_TEST(test_unroutable_loops_bypassed);
+  RUN_TEST(test_default_table_routes_every_loop);
+  return UNITY_END();
+}
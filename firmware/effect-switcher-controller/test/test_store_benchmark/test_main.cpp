@@ -0,0 +1,128 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+
+// Storage costs on the simulated M95256: bus transactions, bytes clocked and simulated time,
+// the time includes the write cycles and the log lines sent at the current log level
+
+struct Measure {
+  uint32_t startTime;
+};
+
+static Measure beginMeasure() {
+  // Logs of the previous steps are out of the UART first
+  Serial.flush();
+  eepromModel.resetStats();
+
+  Measure measure;
+  measure.startTime = SimClock::now();
+  return measure;
+}
+
+static const M95256Stats& endMeasure(const char* t_operation, const Measure& t_measure) {
+  const M95256Stats& stats = eepromModel.getStats();
+  uint32_t time = SimClock::now() - t_measure.startTime;
+
+  char text[120];
+  snprintf(text, sizeof(text), "%-22s %5u transactions %6u bytes %3u write cycles %4u.%02u ms", t_operation,
+    unsigned(stats.transactions), unsigned(stats.bytes), unsigned(stats.writeCycles), unsigned(time / 1000), unsigned(time % 1000 / 10));
+  TEST_MESSAGE(text);
+
+  return stats;
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_save_and_load_preset(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  Preset preset = TestSupport::makePreset(0, 0, c_maxRoutedLoops, 4, 1);
+
+  Measure measure = beginMeasure();
+  memoryManager.savePreset(0, 0, preset);
+  memoryManager.flush();
+  M95256Stats stats = endMeasure("Save new preset", measure);
+  TEST_ASSERT_GREATER_THAN(0, stats.writeCycles);
+
+  measure = beginMeasure();
+  memoryManager.savePreset(0, 0, preset);
+  memoryManager.flush();
+  stats = endMeasure("Save unchanged preset", measure);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.writeCycles);
+
+  preset.toggleLoopState(0);
+  measure = beginMeasure();
+  memoryManager.savePreset(0, 0, preset);
+  memoryManager.flush();
+  stats = endMeasure("Save edited preset", measure);
+  TEST_ASSERT_GREATER_THAN(0, stats.writeCycles);
+
+  Preset loaded;
+  measure = beginMeasure();
+  memoryManager.loadPreset(0, 0, loaded);
+  stats = endMeasure("Load preset", measure);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.writeCycles);
+  TEST_ASSERT_EQUAL_UINT8(preset.getLoopState(0), loaded.getLoopState(0));
+  TEST_ASSERT_EQUAL_UINT8(4, loaded.getMidiMessagesCount());
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().ignoredInstructions);
+}
+
+void test_bank_switch(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  for (uint8_t bank = 0; bank < c_maxPresetBanks; bank++) {
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+      memoryManager.savePreset(bank, presetIndex, TestSupport::makePreset(bank, presetIndex, 8, 2, bank * c_presetsPerBank + presetIndex));
+    }
+  }
+  memoryManager.flush();
+
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+
+  // A bank not cached is loaded from storage
+  Measure measure = beginMeasure();
+  presetManager.setPresetBank(2);
+  presetManager.completeBankLoad();
+  M95256Stats stats = endMeasure("Bank switch, miss", measure);
+  TEST_ASSERT_EQUAL_UINT8(2, presetManager.getCurrentBank());
+  TEST_ASSERT_EQUAL_UINT32(0, stats.writeCycles);
+
+  // The adjacent banks are prefetched in idle time
+  for (uint8_t i = 0; i < 20; i++) {
+    presetManager.poll();
+    memoryManager.poll();
+  }
+
+  measure = beginMeasure();
+  presetManager.setPresetBankUp();
+  stats = endMeasure("Bank switch, prefetched", measure);
+  TEST_ASSERT_EQUAL_UINT8(3, presetManager.getCurrentBank());
+  TEST_ASSERT_EQUAL_UINT32(0, stats.transactions);
+  TEST_ASSERT_EQUAL_UINT16(1, presetManager.getPrefetchHits());
+  TEST_ASSERT_EQUAL_UINT8(8, presetManager.getCurrentPreset()->getLoopsCount());
+
+  // The device state of the switches is stored once, after the save delay
+  delay(c_deviceStateSaveDelay);
+  measure = beginMeasure();
+  memoryManager.poll();
+  memoryManager.flush();
+  stats = endMeasure("Device state", measure);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.writeCycles);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_save_and_load_preset);
+  RUN_TEST(test_bank_switch);
+  return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+#include <stdlib.h>
+
+#include "logic/memory.h"
+
+// Compaction of the preset heap, run in slices from MemoryManager::poll once the heap runs low
+
+static PresetRecords s_records;
+
+static Preset makeRandomPreset(uint8_t t_bank, uint8_t t_presetIndex) {
+  uint8_t loopsCount = rand() % (c_maxRoutedLoops + 1);
+  uint8_t midiMessagesCount = rand() % 16;
+  return TestSupport::makePreset(t_bank, t_presetIndex, loopsCount, midiMessagesCount, rand());
+}
+
+/// Edit random presets with random lengths until the heap runs low and a compaction is requested
+static void fragmentPresetHeap(MemoryManager& t_memoryManager) {
+  srand(13);
+
+  for (uint16_t i = 0; i < 5000 && !t_memoryManager.isCompacting(); i++) {
+    uint16_t preset = rand() % c_presetsCount;
+    Preset edit = makeRandomPreset(preset / c_presetsPerBank, preset % c_presetsPerBank);
+    t_memoryManager.savePreset(preset / c_presetsPerBank, preset % c_presetsPerBank, edit);
+  }
+  t_memoryManager.flush();
+
+  TEST_ASSERT_TRUE(t_memoryManager.isCompacting());
+}
+
+/// Poll like the main loop until the compaction is done
+/// @return Longest poll, in simulated µs
+static uint32_t pollUntilCompacted(MemoryManager& t_memoryManager) {
+  uint32_t longestPoll = 0;
+
+  for (uint32_t i = 0; i < 200000 && t_memoryManager.isCompacting(); i++) {
+    uint32_t startTime = SimClock::now();
+    t_memoryManager.poll();
+    uint32_t pollTime = SimClock::now() - startTime;
+    if (pollTime > longestPoll) {
+      longestPoll = pollTime;
+    }
+    SimClock::advance(1000);
+  }
+  t_memoryManager.flush();
+
+  TEST_ASSERT_FALSE(t_memoryManager.isCompacting());
+  return longestPoll;
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_compaction_runs_from_poll(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+  fragmentPresetHeap(memoryManager);
+  TestSupport::snapshotRecords(memoryManager, s_records);
+  uint16_t freeBefore = memoryManager.getPresetHeapFree();
+
+  uint32_t longestPoll = pollUntilCompacted(memoryManager);
+
+  char text[80];
+  snprintf(text, sizeof(text), "Heap free %u -> %u bytes, longest poll %u us", freeBefore,
+    memoryManager.getPresetHeapFree(), unsigned(longestPoll));
+  TEST_MESSAGE(text);
+
+  // A poll never waits for a write cycle
+  TEST_ASSERT_LESS_THAN_UINT32(M95256Model::c_writeTime, longestPoll);
+  TEST_ASSERT_GREATER_THAN_UINT16(freeBefore, memoryManager.getPresetHeapFree());
+  TestSupport::assertRecordsKept(memoryManager, s_records);
+
+  // The compacted heap is found again from the index at the next boot
+  uint16_t freeAfter = memoryManager.getPresetHeapFree();
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  TEST_ASSERT_EQUAL_UINT16(freeAfter, rebooted.getPresetHeapFree());
+  TestSupport::assertRecordsKept(rebooted, s_records);
+}
+
+void test_saves_during_compaction(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+  fragmentPresetHeap(memoryManager);
+
+  // Start the compaction, then store presets at the top of the heap and in place while it runs
+  for (uint8_t i = 0; i < 100; i++) {
+    memoryManager.poll();
+    SimClock::advance(100);
+  }
+  TEST_ASSERT_TRUE(memoryManager.isCompacting());
+
+  for (uint16_t i = 0; i < 40; i++) {
+    uint16_t preset = (i * 97) % c_presetsCount;
+    Preset edit = makeRandomPreset(preset / c_presetsPerBank, preset % c_presetsPerBank);
+    memoryManager.savePreset(preset / c_presetsPerBank, preset % c_presetsPerBank, edit);
+    for (uint8_t j = 0; j < 50; j++) {
+      memoryManager.poll();
+      SimClock::advance(100);
+    }
+  }
+  memoryManager.flush();
+  TestSupport::snapshotRecords(memoryManager, s_records);
+
+  pollUntilCompacted(memoryManager);
+  TestSupport::assertRecordsKept(memoryManager, s_records);
+
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  TEST_ASSERT_EQUAL_UINT16(memoryManager.getPresetHeapFree(), rebooted.getPresetHeapFree());
+}
+
+void test_full_heap_save_retried_after_compaction(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+  fragmentPresetHeap(memoryManager);
+
+  // Fill the heap until a save is refused, it never compacts inline
+  srand(7);
+  Preset refused;
+  uint16_t refusedPreset = 0;
+  bool saved = true;
+  for (uint16_t i = 0; i < 5000 && saved; i++) {
+    refusedPreset = rand() % c_presetsCount;
+    refused = makeRandomPreset(refusedPreset / c_presetsPerBank, refusedPreset % c_presetsPerBank);
+    saved = memoryManager.savePreset(refusedPreset / c_presetsPerBank, refusedPreset % c_presetsPerBank, refused);
+  }
+  TEST_ASSERT_FALSE(saved);
+
+  pollUntilCompacted(memoryManager);
+  TEST_ASSERT_TRUE(memoryManager.savePreset(refusedPreset / c_presetsPerBank, refusedPreset % c_presetsPerBank, refused));
+  memoryManager.flush();
+
+  Preset loaded;
+  memoryManager.loadPreset(refusedPreset / c_presetsPerBank, refusedPreset % c_presetsPerBank, loaded);
+  TEST_ASSERT_EQUAL_UINT8(refused.getLoopsCount(), loaded.getLoopsCount());
+  TEST_ASSERT_EQUAL_UINT8(refused.getMidiMessagesCount(), loaded.getMidiMessagesCount());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_compaction_runs_from_poll);
+  RUN_TEST(test_saves_during_compaction);
+  RUN_TEST(test_full_heap_save_retried_after_compaction);
+  return UNITY_END();
+}
@@ -0,0 +1,369 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+
+// Stores written by the former firmwares, opened by the current one
+
+constexpr uint8_t c_fixtureBanksCount = 6;
+
+// FootSwitchConfig bytes: mode, latching, loop, target bank, target preset, two MIDI messages
+static void makeFootSwitchConfig(uint8_t t_bank, uint8_t t_footSwitch, uint8_t* t_config) {
+  memset(t_config, 0, c_footSwitchConfigSize);
+  t_config[0] = uint8_t(FootSwitchMode::kPresetSelect);
+  t_config[4] = t_footSwitch % c_presetsPerBank;
+
+  // Bank 3 sends a MIDI message with its fifth switch
+  if (t_bank == 3 && t_footSwitch == 4) {
+    t_config[0] = uint8_t(FootSwitchMode::kSendMidiMessage);
+    t_config[5] = 0xC0;
+    t_config[6] = 12;
+  }
+}
+
+// A preset per slot of the fixtures, each with its own counts
+static Preset makePreset(uint8_t t_bank, uint8_t t_presetIndex) {
+  uint8_t loopsCount = (t_bank + t_presetIndex) % (c_maxRoutedLoops + 1);
+  return TestSupport::makePreset(t_bank, t_presetIndex, loopsCount, t_presetIndex, t_bank * c_presetsPerBank + t_presetIndex);
+}
+
+static void pokeStoreHeader(uint8_t t_schema) {
+  uint8_t header[c_storeHeaderSize];
+  memset(header, 0xFF, c_storeHeaderSize);
+  header[0] = highByte(c_storeMagic);
+  header[1] = lowByte(c_storeMagic);
+  header[2] = t_schema;
+  header[3] = Utils::crc8(header, 3);
+  TestSupport::pokeArray(c_storeHeaderAddress, header, c_storeHeaderSize);
+}
+
+static void pokeDeviceState(uint8_t t_bank, uint8_t t_preset) {
+  uint8_t slot[c_deviceStateSlotSize] = { 0, t_bank, t_preset, 0 };
+  slot[3] = Utils::crc8(slot, 3);
+  TestSupport::pokeArray(c_deviceStateAddress, slot, c_deviceStateSlotSize);
+}
+
+// Schema 0: the device state on 2 bytes, a 128-byte slot per preset of the first 4 banks and their
+// six FootSwitchConfigs
+static void buildSchema0Store() {
+  eepromModel.erase();
+  eepromModel.poke(0, 2);
+  eepromModel.poke(1, 1);
+
+  for (uint8_t bank = 0; bank < c_schema0BanksCount; bank++) {
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+      Preset preset = makePreset(bank, presetIndex);
+      uint8_t slot[c_schema0PresetSize];
+      memset(slot, 0, c_schema0PresetSize);
+      slot[0] = bank;
+      slot[1] = presetIndex;
+      slot[2] = preset.getLoopsCount();
+      slot[3] = preset.getMidiMessagesCount();
+
+      for (uint8_t i = 0; i < preset.getLoopsCount(); i++) {
+        uint8_t* loop = &slot[4 + i * 4];
+        loop[0] = preset.getLoopState(i);
+        loop[1] = preset.getLoopOrder(i);
+        loop[2] = preset.getLoopSend(i);
+        loop[3] = preset.getLoopReturn(i);
+      }
+
+      uint8_t* message = &slot[4 + preset.getLoopsCount() * 4];
+      for (uint8_t j = 0; j < preset.getMidiMessagesCount(); j++, message += 4) {
+        message[0] = preset.getMidiMessageStatusByte(j);
+        message[1] = preset.getMidiMessageDataByte1(j);
+        message[2] = preset.getMidiMessageDataByte2(j);
+      }
+
+      TestSupport::pokeArray(c_schema0PresetsAddress + (bank * c_presetsPerBank + presetIndex) * c_schema0PresetSize,
+        slot, c_schema0PresetSize);
+    }
+
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      uint8_t config[c_footSwitchConfigSize];
+      makeFootSwitchConfig(bank, i, config);
+      TestSupport::pokeArray(c_schema0FootSwitchConfigsAddress + bank * c_bankFootSwitchConfigsSize + i * c_footSwitchConfigSize,
+        config, c_footSwitchConfigSize);
+    }
+  }
+}
+
+// Schema 1: the areas of the current schema up to the preset index, then the six FootSwitchConfigs
+// of each bank and the records from 0x30BD
+static void buildSchema1Store(MemoryManager& t_memoryManager) {
+  eepromModel.erase();
+  pokeStoreHeader(1);
+  pokeDeviceState(2, 1);
+
+  uint8_t routingTable[c_routingTableSize];
+  for (uint8_t i = 0; i < c_maxLoops; i++) {
+    routingTable[i] = i;
+    routingTable[c_maxLoops + i] = i;
+  }
+  uint16_t crc = Utils::crc16(routingTable, c_routingTableSize - 2);
+  routingTable[c_routingTableSize - 2] = highByte(crc);
+  routingTable[c_routingTableSize - 1] = lowByte(crc);
+  TestSupport::pokeArray(c_routingTableAddress, routingTable, c_routingTableSize);
+
+  uint16_t heapTop = c_schema1PresetHeapAddress;
+  for (uint8_t bank = 0; bank < c_fixtureBanksCount; bank++) {
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+      uint8_t record[c_presetSize];
+      uint8_t length = t_memoryManager.serializePreset(makePreset(bank, presetIndex), record);
+      TestSupport::pokeArray(heapTop, record, length);
+
+      uint8_t entry[c_presetIndexEntrySize] = { highByte(heapTop), lowByte(heapTop), length };
+      TestSupport::pokeArray(c_presetIndexAddress + bank * c_bankIndexSize + presetIndex * c_presetIndexEntrySize, entry, c_presetIndexEntrySize);
+      heapTop += length;
+    }
+  }
+
+  for (uint8_t bank = 0; bank < c_schema1BanksCount; bank++) {
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      uint8_t config[c_footSwitchConfigSize];
+      makeFootSwitchConfig(bank, i, config);
+      TestSupport::pokeArray(c_schema1FootSwitchConfigsAddress + bank * c_bankFootSwitchConfigsSize + i * c_footSwitchConfigSize,
+        config, c_footSwitchConfigSize);
+    }
+  }
+}
+
+static void assertPresetsMigrated(MemoryManager& t_memoryManager, uint8_t t_banksCount = c_fixtureBanksCount) {
+  for (uint8_t bank = 0; bank < t_banksCount; bank++) {
+    for (uint8_t presetIndex = 0; presetIndex < c_presetsPerBank; presetIndex++) {
+      uint8_t expected[c_presetSize];
+      uint8_t record[c_presetSize];
+      uint8_t length = t_memoryManager.serializePreset(makePreset(bank, presetIndex), expected);
+
+      t_memoryManager.loadPresetRecord(bank, presetIndex, record);
+      TEST_ASSERT_EQUAL_MEMORY(expected, record, length);
+    }
+  }
+}
+
+static void assertFootSwitchesMigrated(MemoryManager& t_memoryManager, uint8_t t_banksCount) {
+  for (uint8_t bank = 0; bank < t_banksCount; bank++) {
+    FootSwitchConfig configs[c_footSwitchConfigPerBank];
+    t_memoryManager.loadFootSwitchConfigs(bank, configs);
+
+    for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+      uint8_t expected[c_footSwitchConfigSize];
+      makeFootSwitchConfig(bank, i, expected);
+      TEST_ASSERT_EQUAL_UINT8(expected[0], uint8_t(configs[i].getMode()));
+      TEST_ASSERT_EQUAL_UINT8(expected[4], configs[i].getTargetPreset());
+      TEST_ASSERT_EQUAL_UINT8(expected[6], configs[i].getMidiMessageDataByte1(0));
+    }
+  }
+}
+
+
+static void assertDeviceState(MemoryManager& t_memoryManager, uint8_t t_bank, uint8_t t_preset) {
+  uint8_t bank = 0xFF;
+  uint8_t preset = 0xFF;
+  t_memoryManager.loadDeviceState(bank, preset);
+  TEST_ASSERT_EQUAL_UINT8(t_bank, bank);
+  TEST_ASSERT_EQUAL_UINT8(t_preset, preset);
+}
+
+static void assertSchema2Header() {
+  TEST_ASSERT_EQUAL_HEX8(highByte(c_storeMagic), eepromModel.peek(c_storeHeaderAddress));
+  TEST_ASSERT_EQUAL_HEX8(lowByte(c_storeMagic), eepromModel.peek(c_storeHeaderAddress + 1));
+  TEST_ASSERT_EQUAL_UINT8(c_storeSchemaVersion, eepromModel.peek(c_storeHeaderAddress + 2));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(c_storeHeaderAddress + c_storeMigrationOffset));
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_schema0_migrated(void) {
+  buildSchema0Store();
+
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  assertSchema2Header();
+  assertPresetsMigrated(memoryManager, c_schema0BanksCount);
+  assertFootSwitchesMigrated(memoryManager, c_schema0BanksCount);
+  assertDeviceState(memoryManager, 2, 1);
+
+  // The routing of the loops is moved to the routing table
+  Preset preset;
+  memoryManager.loadPreset(3, 3, preset);
+  TEST_ASSERT_EQUAL_UINT8(6, preset.getLoopsCount());
+  TEST_ASSERT_EQUAL_UINT8(5, preset.getLoopSend(5));
+
+  // Opened again without any write
+  eepromModel.resetStats();
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().writeCycles);
+}
+
+void test_schema0_invalid_slot_migrated_empty(void) {
+  buildSchema0Store();
+
+  // A slot that doesn't hold its own bank and preset numbers
+  eepromModel.poke(c_schema0PresetsAddress + (1 * c_presetsPerBank + 2) * c_schema0PresetSize, 9);
+
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  Preset preset;
+  memoryManager.loadPreset(1, 2, preset);
+  TEST_ASSERT_EQUAL_UINT8(0, preset.getLoopsCount());
+  TEST_ASSERT_EQUAL_UINT8(0, preset.getMidiMessagesCount());
+
+  uint8_t expected[c_presetSize];
+  uint8_t record[c_presetSize];
+  uint8_t length = memoryManager.serializePreset(makePreset(1, 3), expected);
+  memoryManager.loadPresetRecord(1, 3, record);
+  TEST_ASSERT_EQUAL_MEMORY(expected, record, length);
+}
+
+void test_schema0_migration_power_cut(void) {
+  uint16_t cuts = 0;
+
+  for (int32_t cutAfter = 0; ; cutAfter += 37) {
+    buildSchema0Store();
+
+    bool cut = false;
+    eepromModel.cutPowerAfter(cutAfter);
+    try {
+      MemoryManager memoryManager(0);
+      memoryManager.openStore();
+    }
+    catch (PowerCut&) {
+      cut = true;
+      cuts++;
+    }
+    eepromModel.cutPowerAfter(-1);
+    eepromModel.powerCycle();
+
+    // The migration is started again, or resumed from its copy
+    MemoryManager rebooted(0);
+    rebooted.openStore();
+    rebooted.recover();
+
+    assertSchema2Header();
+    assertPresetsMigrated(rebooted, c_schema0BanksCount);
+    assertFootSwitchesMigrated(rebooted, c_schema0BanksCount);
+    assertDeviceState(rebooted, 2, 1);
+
+    if (!cut) {
+      break;
+    }
+  }
+
+  TEST_ASSERT_GREATER_THAN_UINT16(10, cuts);
+}
+
+void test_schema1_migrated(void) {
+  MemoryManager memoryManager(0);
+  buildSchema1Store(memoryManager);
+
+  memoryManager.openStore();
+
+  assertSchema2Header();
+  assertPresetsMigrated(memoryManager);
+  assertFootSwitchesMigrated(memoryManager, c_schema1BanksCount);
+  assertDeviceState(memoryManager, 2, 1);
+  TEST_ASSERT_EQUAL_UINT16(0, memoryManager.getQuarantinedRecords());
+
+  // Opened again without any write
+  eepromModel.resetStats();
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().writeCycles);
+}
+
+void test_schema1_migration_power_cut(void) {
+  uint16_t cuts = 0;
+
+  for (int32_t cutAfter = 0; ; cutAfter += 37) {
+    MemoryManager memoryManager(0);
+    buildSchema1Store(memoryManager);
+
+    bool cut = false;
+    eepromModel.cutPowerAfter(cutAfter);
+    try {
+      memoryManager.openStore();
+    }
+    catch (PowerCut&) {
+      cut = true;
+      cuts++;
+    }
+    eepromModel.cutPowerAfter(-1);
+    eepromModel.powerCycle();
+
+    MemoryManager rebooted(0);
+    rebooted.openStore();
+    rebooted.recover();
+    rebooted.validateStore();
+
+    assertSchema2Header();
+    assertPresetsMigrated(rebooted);
+    assertFootSwitchesMigrated(rebooted, c_schema1BanksCount);
+    assertDeviceState(rebooted, 2, 1);
+
+    if (!cut) {
+      break;
+    }
+  }
+
+  TEST_ASSERT_GREATER_THAN_UINT16(10, cuts);
+}
+
+void test_schema1_interrupted_write_recovered_before_migration(void) {
+  MemoryManager memoryManager(0);
+  buildSchema1Store(memoryManager);
+
+  // Schema 1 firmware committed new footswitches of bank 3 and lost power while writing them
+  uint16_t address = c_schema1FootSwitchConfigsAddress + 3 * c_bankFootSwitchConfigsSize;
+  uint8_t configs[c_bankFootSwitchConfigsSize];
+  for (uint8_t i = 0; i < c_footSwitchConfigPerBank; i++) {
+    makeFootSwitchConfig(3, i, &configs[i * c_footSwitchConfigSize]);
+  }
+  configs[4 * c_footSwitchConfigSize + 6] = 42;
+  TestSupport::pokeArray(c_shadowDataAddress, configs, c_bankFootSwitchConfigsSize);
+  TestSupport::pokeArray(address, configs, 30);
+
+  uint16_t dataCrc = Utils::fletcher16(configs, c_bankFootSwitchConfigsSize);
+  uint8_t header[c_shadowHeaderSize] = { c_shadowCommitted, highByte(address), lowByte(address),
+    c_bankFootSwitchConfigsSize, highByte(dataCrc), lowByte(dataCrc), 0xFF, 0xFF, 0, 0, 0, 0 };
+  header[11] = Utils::crc8(&header[1], c_shadowHeaderSize - 2);
+  TestSupport::pokeArray(c_shadowHeaderAddress, header, c_shadowHeaderSize);
+
+  memoryManager.openStore();
+  memoryManager.recover();
+  memoryManager.validateStore();
+
+  assertSchema2Header();
+  TEST_ASSERT_EQUAL_HEX8(c_shadowReleased, eepromModel.peek(c_shadowHeaderAddress));
+
+  // The write completed in the schema 1 layout was migrated with the others
+  FootSwitchConfig config;
+  memoryManager.loadFootSwitchConfig(3, 4, config);
+  TEST_ASSERT_EQUAL_UINT8(42, config.getMidiMessageDataByte1(0));
+
+  // Nothing was written at its schema 1 address, now in the index of the new banks
+  for (uint16_t i = 0; i < c_bankFootSwitchConfigsSize; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0xFF, eepromModel.peek(address + i));
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, memoryManager.getQuarantinedRecords());
+  assertPresetsMigrated(memoryManager);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_schema0_migrated);
+  RUN_TEST(test_schema0_invalid_slot_migrated_empty);
+  RUN_TEST(test_schema0_migration_power_cut);
+  RUN_TEST(test_schema1_migrated);
+  RUN_TEST(test_schema1_migration_power_cut);
+  RUN_TEST(test_schema1_interrupted_write_recovered_before_migration);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+
+// Store validation at boot and the scrubber: a corrupted record is repaired from its shadow copy
+// or quarantined
+
+/// Flip a byte in the middle of the stored record of a preset
+static void corruptRecord(uint8_t t_bank, uint8_t t_presetIndex) {
+  uint8_t entry[c_presetIndexEntrySize];
+  TestSupport::peekArray(c_presetIndexAddress + t_bank * c_bankIndexSize + t_presetIndex * c_presetIndexEntrySize,
+    entry, c_presetIndexEntrySize);
+
+  uint16_t address = ((entry[0] << 8) | entry[1]) + entry[2] / 2;
+  eepromModel.poke(address, eepromModel.peek(address) ^ 0x5A);
+}
+
+/// Run the scrubber over every index entry
+static void scrubStore(MemoryManager& t_memoryManager) {
+  for (uint16_t i = 0; i < c_indexEntriesCount; i++) {
+    SimClock::advance(c_scrubInterval * 1000);
+    t_memoryManager.scrub();
+    t_memoryManager.flush();
+  }
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_corrupted_record_repaired(void) {
+  Preset preset = TestSupport::makePreset(5, 3, c_maxRoutedLoops, 4, 9);
+  {
+    MemoryManager memoryManager(0);
+    memoryManager.openStore();
+    memoryManager.savePreset(5, 3, preset);
+    memoryManager.flush();
+  }
+
+  // The last shadow commit was for this record
+  corruptRecord(5, 3);
+
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  rebooted.recover();
+  rebooted.validateStore();
+
+  scrubStore(rebooted);
+  TEST_ASSERT_EQUAL_UINT16(1, rebooted.getRepairedRecords());
+  TEST_ASSERT_EQUAL_UINT16(0, rebooted.getQuarantinedRecords());
+
+  uint8_t expected[c_presetSize];
+  uint8_t record[c_presetSize];
+  uint8_t length = rebooted.serializePreset(preset, expected);
+  rebooted.loadPresetRecord(5, 3, record);
+  TEST_ASSERT_EQUAL_MEMORY(expected, record, length);
+}
+
+void test_corrupted_record_quarantined(void) {
+  {
+    MemoryManager memoryManager(0);
+    memoryManager.openStore();
+    memoryManager.savePreset(5, 3, TestSupport::makePreset(5, 3, c_maxRoutedLoops, 4, 9));
+    memoryManager.savePreset(0, 1, TestSupport::makePreset(0, 1, 2, 1, 4));
+    memoryManager.flush();
+  }
+
+  // The shadow area holds another record
+  corruptRecord(5, 3);
+
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  rebooted.recover();
+  rebooted.validateStore();
+
+  scrubStore(rebooted);
+  TEST_ASSERT_EQUAL_UINT16(0, rebooted.getRepairedRecords());
+  TEST_ASSERT_EQUAL_UINT16(1, rebooted.getQuarantinedRecords());
+
+  // Read as never saved, the entry is still counted on the next boot
+  Preset loaded;
+  rebooted.loadPreset(5, 3, loaded);
+  TEST_ASSERT_EQUAL_UINT8(0, loaded.getLoopsCount());
+
+  MemoryManager again(0);
+  again.openStore();
+  again.recover();
+  again.validateStore();
+  TEST_ASSERT_EQUAL_UINT16(1, again.getQuarantinedRecords());
+
+  // Saving the preset again moves it to a new extent
+  Preset preset = TestSupport::makePreset(5, 3, 3, 2, 11);
+  TEST_ASSERT_TRUE(again.savePreset(5, 3, preset));
+  again.flush();
+  again.loadPreset(5, 3, loaded);
+  TEST_ASSERT_EQUAL_UINT8(3, loaded.getLoopsCount());
+}
+
+void test_corrupted_entry_checked_first(void) {
+  {
+    MemoryManager memoryManager(0);
+    memoryManager.openStore();
+    memoryManager.savePreset(100, 2, TestSupport::makePreset(100, 2, 4, 2, 6));
+    memoryManager.flush();
+  }
+
+  // An entry pointing past the preset heap
+  uint16_t indexAddress = c_presetIndexAddress + 100 * c_bankIndexSize + 2 * c_presetIndexEntrySize;
+  eepromModel.poke(indexAddress, 0xFF);
+
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  rebooted.recover();
+  rebooted.validateStore();
+
+  // The boot scan points the scrubber at it, a single slice quarantines it
+  SimClock::advance(c_scrubInterval * 1000);
+  rebooted.scrub();
+  rebooted.flush();
+  TEST_ASSERT_EQUAL_UINT16(1, rebooted.getQuarantinedRecords());
+  TEST_ASSERT_EQUAL_UINT8(c_quarantinedLength, eepromModel.peek(indexAddress + 2));
+}
+
+void test_scrub_waits_for_writes(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+  memoryManager.validateStore();
+  memoryManager.flush();
+
+  // A queued write keeps the scrubber off the bus
+  memoryManager.savePreset(0, 0, TestSupport::makePreset(0, 0, 4, 2, 1));
+  SimClock::advance(c_scrubInterval * 1000);
+  eepromModel.resetStats();
+  memoryManager.scrub();
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().readInstructions);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_corrupted_record_repaired);
+  RUN_TEST(test_corrupted_record_quarantined);
+  RUN_TEST(test_corrupted_entry_checked_first);
+  RUN_TEST(test_scrub_waits_for_writes);
+  return UNITY_END();
+}
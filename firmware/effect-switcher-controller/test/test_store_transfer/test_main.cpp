@@ -0,0 +1,332 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+#include <stdlib.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+#include "logic/store_transfer.h"
+
+// Store dump and restore over the simulated serial port, with the host side of the protocol
+
+/// @brief A frame received by the host
+struct HostFrame {
+  TransferCommand command;
+  uint16_t sequence;
+  uint8_t fields[c_transferFrameSize];
+  uint8_t fieldsLength;
+};
+
+/// @brief Frame parser of the host, the bytes sent out of a frame are counted
+struct HostReceiver {
+  uint8_t frame[c_transferFrameSize];
+  uint8_t length = 0;
+  bool inFrame = false;
+  bool framesSeen = false;  // A frame started, the log text sent before it is expected
+  uint16_t strayBytes = 0;  // Bytes sent out of a frame once the transfer started
+};
+
+static uint8_t s_image[EEPROM_SIZE];  // Pages received by the dump, at their EEPROM address
+static uint16_t s_imagePages[EEPROM_SIZE / EEPROM_PAGE_SIZE];
+static uint16_t s_imagePagesCount = 0;
+static PresetRecords s_records;
+static PresetRecords s_previousRecords;
+static uint8_t s_eeprom[EEPROM_SIZE];
+
+static void sendFrame(TransferCommand t_command, uint16_t t_sequence, const uint8_t* t_fields = nullptr, uint8_t t_fieldsLength = 0) {
+  uint8_t frame[c_transferFrameSize + 1];
+  uint8_t length = 0;
+
+  frame[length++] = 0xF0;
+  frame[length++] = c_transferManufacturerId;
+  frame[length++] = uint8_t(t_command);
+  frame[length++] = (t_sequence >> 7) & 0x7F;
+  frame[length++] = t_sequence & 0x7F;
+  for (uint8_t i = 0; i < t_fieldsLength; i++) {
+    frame[length++] = t_fields[i];
+  }
+
+  uint16_t crc = Utils::crc16(&frame[1], length - 1);
+  frame[length++] = crc >> 14;
+  frame[length++] = (crc >> 7) & 0x7F;
+  frame[length++] = crc & 0x7F;
+  frame[length++] = 0xF7;
+
+  Serial.simFeed(frame, length);
+}
+
+static bool receiveFrame(HostReceiver& t_receiver, bool t_transferRunning, HostFrame& t_frame) {
+  uint8_t data;
+
+  while (Serial.simTake(&data, 1) == 1) {
+    if (data == 0xF0) {
+      t_receiver.inFrame = true;
+      t_receiver.framesSeen = true;
+      t_receiver.length = 0;
+    }
+    else if (!t_receiver.inFrame) {
+      if (t_receiver.framesSeen && t_transferRunning) {
+        t_receiver.strayBytes++;
+      }
+    }
+    else if (data == 0xF7) {
+      t_receiver.inFrame = false;
+
+      uint8_t fieldsEnd = t_receiver.length - 3;
+      uint16_t crc = (uint16_t(t_receiver.frame[fieldsEnd]) << 14) | (t_receiver.frame[fieldsEnd + 1] << 7) |
+        t_receiver.frame[fieldsEnd + 2];
+      TEST_ASSERT_EQUAL_UINT16(Utils::crc16(t_receiver.frame, fieldsEnd), crc);
+
+      t_frame.command = static_cast<TransferCommand>(t_receiver.frame[1]);
+      t_frame.sequence = (t_receiver.frame[2] << 7) | t_receiver.frame[3];
+      t_frame.fieldsLength = fieldsEnd - 4;
+      memcpy(t_frame.fields, &t_receiver.frame[4], t_frame.fieldsLength);
+      return true;
+    }
+    else {
+      TEST_ASSERT_FALSE(data & 0x80);
+      t_receiver.frame[t_receiver.length++] = data;
+    }
+  }
+
+  return false;
+}
+
+static uint8_t packPage(uint16_t t_page, uint8_t* t_fields) {
+  uint8_t length = 0;
+  const uint8_t* data = &s_image[t_page * EEPROM_PAGE_SIZE];
+
+  t_fields[length++] = t_page >> 7;
+  t_fields[length++] = t_page & 0x7F;
+  for (uint8_t i = 0; i < EEPROM_PAGE_SIZE; i += 7) {
+    uint8_t& highBits = t_fields[length++];
+    highBits = 0;
+
+    for (uint8_t j = 0; j < 7 && i + j < EEPROM_PAGE_SIZE; j++) {
+      if (data[i + j] & 0x80) {
+        bitSet(highBits, j);
+      }
+      t_fields[length++] = data[i + j] & 0x7F;
+    }
+  }
+
+  return length;
+}
+
+static void savePresets(MemoryManager& t_memoryManager, unsigned t_seed) {
+  srand(t_seed);
+
+  for (uint8_t i = 0; i < 40; i++) {
+    uint8_t bank = rand() % 20;
+    uint8_t presetIndex = rand() % c_presetsPerBank;
+    uint8_t loopsCount = rand() % (c_maxRoutedLoops + 1);
+    uint8_t midiMessagesCount = rand() % 8;
+    t_memoryManager.savePreset(bank, presetIndex, TestSupport::makePreset(bank, presetIndex, loopsCount, midiMessagesCount, rand()));
+  }
+  t_memoryManager.flush();
+}
+
+/// Dump the store like the host, a bank switch in the middle logs while the frames are sent
+/// @return Bytes sent out of a frame during the dump
+static uint16_t dumpStore(StoreTransfer& t_storeTransfer, PresetManager& t_presetManager) {
+  HostReceiver receiver;
+  HostFrame frame;
+  s_imagePagesCount = 0;
+
+  sendFrame(TransferCommand::kDumpRequest, 0);
+  t_storeTransfer.poll();
+  TEST_ASSERT_EQUAL(TransferState::kDumping, t_storeTransfer.getState());
+
+  for (uint16_t i = 0; i < 10000 && t_storeTransfer.getState() != TransferState::kIdle; i++) {
+    while (receiveFrame(receiver, true, frame)) {
+      if (frame.command == TransferCommand::kPage) {
+        uint16_t page = (frame.fields[0] << 7) | frame.fields[1];
+        const uint8_t* packed = &frame.fields[2];
+        for (uint8_t j = 0; j < EEPROM_PAGE_SIZE; j += 7) {
+          uint8_t highBits = *packed++;
+          for (uint8_t k = 0; k < 7 && j + k < EEPROM_PAGE_SIZE; k++) {
+            s_image[page * EEPROM_PAGE_SIZE + j + k] = *packed++ | (bitRead(highBits, k) << 7);
+          }
+        }
+        s_imagePages[s_imagePagesCount++] = page;
+      }
+      sendFrame(TransferCommand::kAck, frame.sequence);
+    }
+
+    if (s_imagePagesCount == 10) {
+      t_presetManager.setPresetBank(9);
+    }
+    t_presetManager.poll();
+    t_storeTransfer.poll();
+    SimClock::advance(1000);
+  }
+
+  TEST_ASSERT_EQUAL(TransferState::kIdle, t_storeTransfer.getState());
+  TEST_ASSERT_GREATER_THAN_UINT16(0, s_imagePagesCount);
+  return receiver.strayBytes;
+}
+
+/// Send the dumped image back, one frame at a time
+/// @param t_framesCount Frames to send, the whole image with its end frame when 0
+/// @return Bytes sent out of a frame during the restore
+static uint16_t restoreStore(StoreTransfer& t_storeTransfer, uint16_t t_framesCount = 0) {
+  HostReceiver receiver;
+  HostFrame frame;
+  uint8_t fields[c_transferFrameSize];
+  uint16_t lastFrame = s_imagePagesCount + 1;
+  if (t_framesCount == 0) {
+    t_framesCount = lastFrame + 1;
+  }
+
+  for (uint16_t sequence = 0; sequence < t_framesCount; sequence++) {
+    if (sequence == 0) {
+      fields[0] = c_storeSchemaVersion;
+      fields[1] = s_imagePagesCount >> 7;
+      fields[2] = s_imagePagesCount & 0x7F;
+      sendFrame(TransferCommand::kBegin, sequence, fields, 3);
+    }
+    else if (sequence < lastFrame) {
+      sendFrame(TransferCommand::kPage, sequence, fields, packPage(s_imagePages[sequence - 1], fields));
+    }
+    else {
+      sendFrame(TransferCommand::kEnd, sequence);
+    }
+
+    bool acknowledged = false;
+    for (uint16_t i = 0; i < 100 && !acknowledged; i++) {
+      t_storeTransfer.poll();
+      while (receiveFrame(receiver, t_storeTransfer.getState() != TransferState::kIdle, frame)) {
+        TEST_ASSERT_EQUAL(TransferCommand::kAck, frame.command);
+        acknowledged = frame.sequence == sequence;
+      }
+      SimClock::advance(1000);
+    }
+    TEST_ASSERT_TRUE(acknowledged);
+  }
+
+  return receiver.strayBytes;
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_dump_and_restore_round_trip(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  LatencyTracer latencyTracer;
+  StoreTransfer storeTransfer(memoryManager, presetManager, latencyTracer);
+  presetManager.initialize();
+
+  savePresets(memoryManager, 1);
+  TestSupport::snapshotRecords(memoryManager, s_records);
+
+  // No log text cuts the frames
+  TEST_ASSERT_EQUAL_UINT16(0, dumpStore(storeTransfer, presetManager));
+
+  savePresets(memoryManager, 2);
+  TEST_ASSERT_EQUAL_UINT16(0, restoreStore(storeTransfer));
+  TEST_ASSERT_EQUAL(TransferState::kIdle, storeTransfer.getState());
+  TestSupport::assertRecordsKept(memoryManager, s_records);
+
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  TestSupport::assertRecordsKept(rebooted, s_records);
+}
+
+void test_abandoned_restore_keeps_store(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  LatencyTracer latencyTracer;
+  StoreTransfer storeTransfer(memoryManager, presetManager, latencyTracer);
+  presetManager.initialize();
+
+  savePresets(memoryManager, 1);
+  dumpStore(storeTransfer, presetManager);
+  savePresets(memoryManager, 2);
+  TestSupport::snapshotRecords(memoryManager, s_records);
+
+  // The host goes away after half the pages
+  restoreStore(storeTransfer, s_imagePagesCount / 2);
+  for (uint16_t i = 0; i < 6000 && storeTransfer.getState() != TransferState::kIdle; i++) {
+    storeTransfer.poll();
+    SimClock::advance(1000);
+  }
+  TEST_ASSERT_EQUAL(TransferState::kIdle, storeTransfer.getState());
+
+  TestSupport::assertRecordsKept(memoryManager, s_records);
+  MemoryManager rebooted(0);
+  rebooted.openStore();
+  TestSupport::assertRecordsKept(rebooted, s_records);
+}
+
+void test_staged_restore_resumed_after_power_cut(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  LatencyTracer latencyTracer;
+  StoreTransfer storeTransfer(memoryManager, presetManager, latencyTracer);
+  presetManager.initialize();
+
+  savePresets(memoryManager, 1);
+  TestSupport::snapshotRecords(memoryManager, s_records);
+  dumpStore(storeTransfer, presetManager);
+  savePresets(memoryManager, 2);
+  TestSupport::snapshotRecords(memoryManager, s_previousRecords);
+
+  // Every page is received, the power is cut while they are copied once the end frame arrives
+  restoreStore(storeTransfer, s_imagePagesCount + 1);
+  memoryManager.flush();
+  TestSupport::peekArray(0, s_eeprom, EEPROM_SIZE);
+
+  uint16_t keptCuts = 0;
+  uint16_t restoredCuts = 0;
+  for (int32_t cutAfter = 0; ; cutAfter += 97) {
+    TestSupport::pokeArray(0, s_eeprom, EEPROM_SIZE);
+
+    // The staged pages are found again from the page count, like after the end frame
+    MemoryManager interrupted(0);
+    TEST_ASSERT_TRUE(interrupted.beginStoreRestore(s_imagePagesCount));
+
+    bool cut = false;
+    eepromModel.cutPowerAfter(cutAfter);
+    try {
+      interrupted.endStoreRestore();
+    }
+    catch (PowerCut&) {
+      cut = true;
+    }
+    eepromModel.cutPowerAfter(-1);
+    eepromModel.powerCycle();
+
+    MemoryManager rebooted(0);
+    rebooted.openStore();
+    rebooted.recover();
+
+    // The previous store until the restore is marked, the restored one from there
+    if (TestSupport::isStoreHolding(rebooted, s_records)) {
+      restoredCuts += cut;
+    }
+    else {
+      TEST_ASSERT_TRUE(TestSupport::isStoreHolding(rebooted, s_previousRecords));
+      TEST_ASSERT_TRUE(cut);
+      keptCuts++;
+    }
+
+    if (!cut) {
+      break;
+    }
+  }
+
+  TEST_ASSERT_GREATER_THAN_UINT16(0, keptCuts);
+  TEST_ASSERT_GREATER_THAN_UINT16(1, restoredCuts);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_dump_and_restore_round_trip);
+  RUN_TEST(test_abandoned_restore_keeps_store);
+  RUN_TEST(test_staged_restore_resumed_after_power_cut);
+  return UNITY_END();
+}
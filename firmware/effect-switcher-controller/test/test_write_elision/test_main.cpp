@@ -0,0 +1,127 @@
+#include <unity.h>
+#include <native_sim.h>
+#include <test_support.h>
+
+#include "logic/memory.h"
+#include "logic/preset_manager.h"
+
+// Write elision: a record save only writes the bytes that differ from the EEPROM
+
+static Preset makePreset(uint8_t t_bank, uint8_t t_presetIndex) {
+  Preset preset = TestSupport::makePreset(t_bank, t_presetIndex, c_maxRoutedLoops, 6, 3);
+
+  // The last message is a Control Change, its second data byte is edited
+  preset.setMidiMessageStatusByte(5, 0xB1);
+  preset.setMidiMessageDataByte2(5, 100);
+  return preset;
+}
+
+/// Save a preset and wait until it is stored
+/// @return Bytes of the record programmed in the array, the shadow copy of the commit included
+static uint32_t saveAndMeasure(MemoryManager& t_memoryManager, const Preset& t_preset) {
+  t_memoryManager.resetWriteStats();
+  eepromModel.resetStats();
+
+  t_memoryManager.savePreset(t_preset.getBank(), t_preset.getPreset(), t_preset);
+  t_memoryManager.flush();
+
+  return eepromModel.getStats().programmedBytes;
+}
+
+void setUp(void) {
+  resetSimulation();
+}
+
+void tearDown(void) { }
+
+void test_unchanged_save_skipped(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  Preset preset = makePreset(1, 2);
+  uint8_t record[c_presetSize];
+  uint8_t length = memoryManager.serializePreset(preset, record);
+  saveAndMeasure(memoryManager, preset);
+
+  // Nothing is written, every byte is counted as skipped
+  TEST_ASSERT_EQUAL_UINT32(0, saveAndMeasure(memoryManager, preset));
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().writeCycles);
+  TEST_ASSERT_EQUAL_UINT32(0, memoryManager.getBytesWritten());
+  TEST_ASSERT_EQUAL_UINT32(length, memoryManager.getBytesSkipped());
+}
+
+void test_edit_writes_changed_bytes(void) {
+  MemoryManager memoryManager(0);
+  memoryManager.openStore();
+
+  Preset preset = makePreset(1, 2);
+  uint8_t record[c_presetSize];
+  uint8_t length = memoryManager.serializePreset(preset, record);
+  uint32_t fullSave = saveAndMeasure(memoryManager, preset);
+
+  // A loop toggled: its state byte and the CRC trailer, they share an EEPROM page so the bytes
+  // between them are written in the same span and the 3 header bytes are left alone
+  preset.toggleLoopState(4);
+  uint32_t editSave = saveAndMeasure(memoryManager, preset);
+  uint32_t written = memoryManager.getBytesWritten();
+  char text[100];
+  snprintf(text, sizeof(text), "Loop toggled: %u bytes written, %u skipped, %u programmed against %u for a new record",
+    unsigned(written), unsigned(memoryManager.getBytesSkipped()), unsigned(editSave), unsigned(fullSave));
+  TEST_MESSAGE(text);
+
+  TEST_ASSERT_GREATER_THAN_UINT32(0, written);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(3, memoryManager.getBytesSkipped());
+  TEST_ASSERT_EQUAL_UINT32(length, written + memoryManager.getBytesSkipped());
+  TEST_ASSERT_LESS_THAN_UINT32(fullSave, editSave);
+
+  // A MIDI value changed, the messages before it are left alone
+  preset.setMidiMessageDataByte2(5, 1);
+  saveAndMeasure(memoryManager, preset);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(4, memoryManager.getBytesWritten());
+
+  Preset loaded;
+  memoryManager.loadPreset(1, 2, loaded);
+  TEST_ASSERT_EQUAL_UINT8(preset.getLoopState(4), loaded.getLoopState(4));
+  TEST_ASSERT_EQUAL_UINT8(1, loaded.getMidiMessageDataByte2(5));
+  TEST_ASSERT_EQUAL_UINT8(preset.getMidiMessageDataByte1(0), loaded.getMidiMessageDataByte1(0));
+}
+
+void test_current_preset_save_elided(void) {
+  MemoryManager memoryManager(0);
+  PresetManager presetManager(memoryManager);
+  presetManager.initialize();
+
+  Preset* preset = presetManager.getCurrentPreset();
+  preset->setLoopsCount(6);
+  presetManager.saveCurrentPreset();
+  presetManager.flush();
+
+  // Saved again from the menu without an edit
+  memoryManager.resetWriteStats();
+  eepromModel.resetStats();
+  presetManager.saveCurrentPreset();
+  presetManager.flush();
+  TEST_ASSERT_EQUAL_UINT32(0, memoryManager.getBytesWritten());
+  TEST_ASSERT_EQUAL_UINT32(0, eepromModel.getStats().programmedBytes);
+
+  // One loop toggled in the menu: the changed bytes of each page are written as one span, the
+  // 3 header bytes before the loop states are left alone
+  memoryManager.resetWriteStats();
+  presetManager.toggleLoopState(3);
+  presetManager.saveCurrentPreset();
+  presetManager.flush();
+  TEST_ASSERT_GREATER_THAN_UINT32(0, memoryManager.getBytesWritten());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(3, memoryManager.getBytesSkipped());
+
+  Preset loaded;
+  memoryManager.loadPreset(0, 0, loaded);
+  TEST_ASSERT_EQUAL_UINT8(presetManager.getCurrentPreset()->getLoopState(3), loaded.getLoopState(3));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_unchanged_save_skipped);
+  RUN_TEST(test_edit_writes_changed_bytes);
+  RUN_TEST(test_current_preset_save_elided);
+  return UNITY_END();
+}